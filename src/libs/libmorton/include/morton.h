@@ -8,6 +8,7 @@
 
 #include "morton2D.h"
 #include "morton3D.h"
+#include "morton_batch.h"
 
 #if defined(__BMI2__) || defined(__AVX2__)
 #include "morton_BMI.h"
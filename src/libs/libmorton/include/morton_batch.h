@@ -0,0 +1,278 @@
+#pragma once
+
+// Libmorton - Batched 3D Morton encoding/decoding (64-bit codes, 21-bit coordinates)
+// These methods encode/decode whole arrays at once. Unlike the stubs in morton.h, the implementation is picked
+// at runtime (CPUID), so a generic build still uses BMI2 / AVX2 / AVX-512 when the CPU has them.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "morton3D.h"
+
+// x86-64 compilers which can compile instruction set specific functions without global -m flags
+#if defined(__GNUC__) && defined(__x86_64__) && (defined(__clang__) || __GNUC__ >= 5)
+#define LIBMORTON_BATCH_X86
+#define LIBMORTON_BATCH_TARGET(t) __attribute__((target(t)))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64) && _MSC_VER >= 1910
+#define LIBMORTON_BATCH_X86
+#define LIBMORTON_BATCH_TARGET(t)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace libmorton {
+	// Available implementations, in the order they are preferred (when the CPU supports them)
+	enum MortonBatchMethod { BATCH_AVX512 = 0, BATCH_AVX2 = 1, BATCH_BMI2 = 2, BATCH_MAGICBITS = 3, BATCH_SLUT = 4 };
+	static const char* const MORTON_BATCH_METHOD_NAMES[5] = { "avx512", "avx2", "bmi2", "magicbits", "slut" };
+
+	namespace batch_detail {
+		// Magic bits masks, same as magicbit3D_masks64_encode
+		static const uint64_t BATCH_MASKS[6] = { 0x1fffff, 0x1f00000000ffff, 0x1f0000ff0000ff, 0x100f00f00f00f00f, 0x10c30c30c30c30c3, 0x1249249249249249 };
+
+		typedef void (*EncodeFunction)(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n);
+		typedef void (*DecodeFunction)(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n);
+
+		// PORTABLE: one code at a time with the scalar methods from morton3D.h
+		inline void encode_sLUT(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n) {
+			for (size_t i = 0; i < n; i++) { m[i] = m3D_e_sLUT<uint_fast64_t, uint_fast32_t>(x[i], y[i], z[i]); }
+		}
+		inline void decode_sLUT(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				uint_fast32_t cx, cy, cz;
+				m3D_d_sLUT<uint_fast64_t, uint_fast32_t>(m[i], cx, cy, cz);
+				x[i] = static_cast<uint32_t>(cx); y[i] = static_cast<uint32_t>(cy); z[i] = static_cast<uint32_t>(cz);
+			}
+		}
+		inline void encode_magicbits(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n) {
+			for (size_t i = 0; i < n; i++) { m[i] = m3D_e_magicbits<uint_fast64_t, uint_fast32_t>(x[i], y[i], z[i]); }
+		}
+		inline void decode_magicbits(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				uint_fast32_t cx, cy, cz;
+				m3D_d_magicbits<uint_fast64_t, uint_fast32_t>(m[i], cx, cy, cz);
+				x[i] = static_cast<uint32_t>(cx); y[i] = static_cast<uint32_t>(cy); z[i] = static_cast<uint32_t>(cz);
+			}
+		}
+
+#if defined(LIBMORTON_BATCH_X86)
+		// BMI2: deposit / extract every coordinate with one instruction
+		LIBMORTON_BATCH_TARGET("bmi2")
+		inline void encode_BMI2(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				m[i] = _pdep_u64(x[i], 0x9249249249249249ULL) | _pdep_u64(y[i], 0x2492492492492492ULL) | _pdep_u64(z[i], 0x4924924924924924ULL);
+			}
+		}
+		LIBMORTON_BATCH_TARGET("bmi2")
+		inline void decode_BMI2(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				x[i] = static_cast<uint32_t>(_pext_u64(m[i], 0x9249249249249249ULL));
+				y[i] = static_cast<uint32_t>(_pext_u64(m[i], 0x2492492492492492ULL));
+				z[i] = static_cast<uint32_t>(_pext_u64(m[i], 0x4924924924924924ULL));
+			}
+		}
+
+		// AVX2: magic bits on 4 codes at once
+		LIBMORTON_BATCH_TARGET("avx2")
+		inline __m256i split3_AVX2(__m256i a) {
+			a = _mm256_and_si256(a, _mm256_set1_epi64x(BATCH_MASKS[0]));
+			a = _mm256_and_si256(_mm256_or_si256(a, _mm256_slli_epi64(a, 32)), _mm256_set1_epi64x(BATCH_MASKS[1]));
+			a = _mm256_and_si256(_mm256_or_si256(a, _mm256_slli_epi64(a, 16)), _mm256_set1_epi64x(BATCH_MASKS[2]));
+			a = _mm256_and_si256(_mm256_or_si256(a, _mm256_slli_epi64(a, 8)), _mm256_set1_epi64x(BATCH_MASKS[3]));
+			a = _mm256_and_si256(_mm256_or_si256(a, _mm256_slli_epi64(a, 4)), _mm256_set1_epi64x(BATCH_MASKS[4]));
+			a = _mm256_and_si256(_mm256_or_si256(a, _mm256_slli_epi64(a, 2)), _mm256_set1_epi64x(BATCH_MASKS[5]));
+			return a;
+		}
+		LIBMORTON_BATCH_TARGET("avx2")
+		inline __m128i compact3_AVX2(__m256i a) {
+			a = _mm256_and_si256(a, _mm256_set1_epi64x(BATCH_MASKS[5]));
+			a = _mm256_and_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 2)), _mm256_set1_epi64x(BATCH_MASKS[4]));
+			a = _mm256_and_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 4)), _mm256_set1_epi64x(BATCH_MASKS[3]));
+			a = _mm256_and_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 8)), _mm256_set1_epi64x(BATCH_MASKS[2]));
+			a = _mm256_and_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 16)), _mm256_set1_epi64x(BATCH_MASKS[1]));
+			a = _mm256_and_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 32)), _mm256_set1_epi64x(BATCH_MASKS[0]));
+			// gather the low halves of the 4 lanes
+			return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(a, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+		}
+		LIBMORTON_BATCH_TARGET("avx2")
+		inline void encode_AVX2(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n) {
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				__m256i mx = split3_AVX2(_mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+				__m256i my = split3_AVX2(_mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i))));
+				__m256i mz = split3_AVX2(_mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(z + i))));
+				__m256i code = _mm256_or_si256(mx, _mm256_or_si256(_mm256_slli_epi64(my, 1), _mm256_slli_epi64(mz, 2)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(m + i), code);
+			}
+			encode_magicbits(x + i, y + i, z + i, m + i, n - i);
+		}
+		LIBMORTON_BATCH_TARGET("avx2")
+		inline void decode_AVX2(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n) {
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				__m256i code = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(x + i), compact3_AVX2(code));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), compact3_AVX2(_mm256_srli_epi64(code, 1)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), compact3_AVX2(_mm256_srli_epi64(code, 2)));
+			}
+			decode_magicbits(m + i, x + i, y + i, z + i, n - i);
+		}
+
+		// AVX-512: magic bits on 8 codes at once
+		LIBMORTON_BATCH_TARGET("avx512f")
+		inline __m512i split3_AVX512(__m512i a) {
+			a = _mm512_and_si512(a, _mm512_set1_epi64(BATCH_MASKS[0]));
+			a = _mm512_and_si512(_mm512_or_si512(a, _mm512_slli_epi64(a, 32)), _mm512_set1_epi64(BATCH_MASKS[1]));
+			a = _mm512_and_si512(_mm512_or_si512(a, _mm512_slli_epi64(a, 16)), _mm512_set1_epi64(BATCH_MASKS[2]));
+			a = _mm512_and_si512(_mm512_or_si512(a, _mm512_slli_epi64(a, 8)), _mm512_set1_epi64(BATCH_MASKS[3]));
+			a = _mm512_and_si512(_mm512_or_si512(a, _mm512_slli_epi64(a, 4)), _mm512_set1_epi64(BATCH_MASKS[4]));
+			a = _mm512_and_si512(_mm512_or_si512(a, _mm512_slli_epi64(a, 2)), _mm512_set1_epi64(BATCH_MASKS[5]));
+			return a;
+		}
+		LIBMORTON_BATCH_TARGET("avx512f")
+		inline __m256i compact3_AVX512(__m512i a) {
+			a = _mm512_and_si512(a, _mm512_set1_epi64(BATCH_MASKS[5]));
+			a = _mm512_and_si512(_mm512_xor_si512(a, _mm512_srli_epi64(a, 2)), _mm512_set1_epi64(BATCH_MASKS[4]));
+			a = _mm512_and_si512(_mm512_xor_si512(a, _mm512_srli_epi64(a, 4)), _mm512_set1_epi64(BATCH_MASKS[3]));
+			a = _mm512_and_si512(_mm512_xor_si512(a, _mm512_srli_epi64(a, 8)), _mm512_set1_epi64(BATCH_MASKS[2]));
+			a = _mm512_and_si512(_mm512_xor_si512(a, _mm512_srli_epi64(a, 16)), _mm512_set1_epi64(BATCH_MASKS[1]));
+			a = _mm512_and_si512(_mm512_xor_si512(a, _mm512_srli_epi64(a, 32)), _mm512_set1_epi64(BATCH_MASKS[0]));
+			return _mm512_cvtepi64_epi32(a);
+		}
+		LIBMORTON_BATCH_TARGET("avx512f")
+		inline void encode_AVX512(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n) {
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m512i mx = split3_AVX512(_mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i))));
+				__m512i my = split3_AVX512(_mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i))));
+				__m512i mz = split3_AVX512(_mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(z + i))));
+				__m512i code = _mm512_or_si512(mx, _mm512_or_si512(_mm512_slli_epi64(my, 1), _mm512_slli_epi64(mz, 2)));
+				_mm512_storeu_si512(reinterpret_cast<void*>(m + i), code);
+			}
+			encode_magicbits(x + i, y + i, z + i, m + i, n - i);
+		}
+		LIBMORTON_BATCH_TARGET("avx512f")
+		inline void decode_AVX512(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n) {
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m512i code = _mm512_loadu_si512(reinterpret_cast<const void*>(m + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i), compact3_AVX512(code));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), compact3_AVX512(_mm512_srli_epi64(code, 1)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(z + i), compact3_AVX512(_mm512_srli_epi64(code, 2)));
+			}
+			decode_magicbits(m + i, x + i, y + i, z + i, n - i);
+		}
+
+		// CPUID leaf / subleaf into regs (eax, ebx, ecx, edx)
+		inline void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+			int r[4];
+			__cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+			for (int i = 0; i < 4; i++) { regs[i] = static_cast<unsigned int>(r[i]); }
+#else
+			__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		}
+
+		// Register state the OS saves on context switches (XCR0)
+		inline uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			unsigned int lo, hi;
+			__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+		}
+#endif
+
+		// Which methods this CPU can run, and which of those are worth using
+		inline void detectSupport(bool supported[5], bool preferred[5]) {
+			for (int i = 0; i < 5; i++) { supported[i] = preferred[i] = (i >= BATCH_MAGICBITS); }
+#if defined(LIBMORTON_BATCH_X86)
+			unsigned int regs[4];
+			cpuid(0, 0, regs);
+			unsigned int max_leaf = regs[0];
+			bool amd = (regs[1] == 0x68747541); // "Auth"enticAMD
+			if (max_leaf < 7) { return; }
+			cpuid(1, 0, regs);
+			unsigned int family = (regs[0] >> 8) & 0xf;
+			if (family == 0xf) { family += (regs[0] >> 20) & 0xff; }
+			bool osxsave = (regs[2] & (1u << 27)) != 0;
+			uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+			cpuid(7, 0, regs);
+			supported[BATCH_BMI2] = (regs[1] & (1u << 8)) != 0;
+			supported[BATCH_AVX2] = (regs[1] & (1u << 5)) != 0 && (xcr0 & 0x6) == 0x6; // + XMM/YMM state
+			supported[BATCH_AVX512] = (regs[1] & (1u << 16)) != 0 && (xcr0 & 0xe6) == 0xe6; // + opmask/ZMM state
+			preferred[BATCH_AVX512] = supported[BATCH_AVX512];
+			preferred[BATCH_AVX2] = supported[BATCH_AVX2];
+			// AMD before Zen 3 implements pdep/pext in microcode: much slower than magic bits
+			preferred[BATCH_BMI2] = supported[BATCH_BMI2] && !(amd && family < 0x19);
+#endif
+		}
+
+		// Pick the fastest method this CPU supports
+		inline MortonBatchMethod detectMethod() {
+			bool supported[5], preferred[5];
+			detectSupport(supported, preferred);
+			int i = 0;
+			while (!preferred[i]) { i++; }
+			return static_cast<MortonBatchMethod>(i);
+		}
+
+		struct BatchFunctions {
+			MortonBatchMethod method;
+			EncodeFunction encode;
+			DecodeFunction decode;
+		};
+
+		inline void setMethod(BatchFunctions &f, MortonBatchMethod method) {
+			f.method = method;
+			switch (method) {
+#if defined(LIBMORTON_BATCH_X86)
+			case BATCH_AVX512: f.encode = encode_AVX512; f.decode = decode_AVX512; break;
+			case BATCH_AVX2: f.encode = encode_AVX2; f.decode = decode_AVX2; break;
+			case BATCH_BMI2: f.encode = encode_BMI2; f.decode = decode_BMI2; break;
+#endif
+			case BATCH_SLUT: f.encode = encode_sLUT; f.decode = decode_sLUT; break;
+			default: f.method = BATCH_MAGICBITS; f.encode = encode_magicbits; f.decode = decode_magicbits; break;
+			}
+		}
+
+		// The selected functions, detected once on first use
+		inline BatchFunctions& functions() {
+			static BatchFunctions f = []() { BatchFunctions b; setMethod(b, detectMethod()); return b; }();
+			return f;
+		}
+	}
+
+	// ENCODE n 3D Morton codes: m[i] = morton3D_64_encode(x[i], y[i], z[i])
+	inline void morton3D_64_encode_n(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* m, size_t n) {
+		batch_detail::functions().encode(x, y, z, m, n);
+	}
+
+	// DECODE n 3D Morton codes: morton3D_64_decode(m[i], x[i], y[i], z[i])
+	inline void morton3D_64_decode_n(const uint64_t* m, uint32_t* x, uint32_t* y, uint32_t* z, size_t n) {
+		batch_detail::functions().decode(m, x, y, z, n);
+	}
+
+	// The method the batched functions use
+	inline MortonBatchMethod morton3D_64_batch_method() {
+		return batch_detail::functions().method;
+	}
+
+	// Force a method (by name, see MORTON_BATCH_METHOD_NAMES), for benchmarking. Call this before using the batched functions
+	// from several threads. Returns false if the name is unknown or the CPU doesn't support the method.
+	inline bool morton3D_64_batch_select(const char* name) {
+		for (int i = 0; i < 5; i++) {
+			if (strcmp(name, MORTON_BATCH_METHOD_NAMES[i]) != 0) { continue; }
+			bool supported[5], preferred[5];
+			batch_detail::detectSupport(supported, preferred);
+			if (!supported[i]) { return false; }
+			batch_detail::setMethod(batch_detail::functions(), static_cast<MortonBatchMethod>(i));
+			return true;
+		}
+		return false;
+	}
+}
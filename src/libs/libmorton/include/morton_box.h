@@ -0,0 +1,163 @@
+#pragma once
+
+// Libmorton - Axis-aligned boxes in 3D Morton order (64-bit codes, 21-bit coordinates)
+// A box [min, max] (inclusive) covers a set of morton codes which is not contiguous: it falls apart in runs along the curve.
+// These methods decompose a box into those runs (or into the aligned octree cells that form them), and jump from a code
+// to the next / previous code inside the box (BIGMIN / LITMAX, Tropf and Herzog 1981), so scans over morton-ordered
+// data only touch the codes in the box.
+
+#include <stdint.h>
+#include <vector>
+
+namespace libmorton {
+	// A run of consecutive morton codes, first and last included
+	struct MortonRange {
+		uint_fast64_t first;
+		uint_fast64_t last;
+	};
+
+	// An aligned octree cell: codes start .. start + 8^level - 1, which is a cube with side 2^level
+	struct MortonCell {
+		uint_fast64_t start;
+		unsigned int level;
+	};
+
+	namespace box_detail {
+		// Bits of each dimension in a morton code
+		static const uint_fast64_t BOX_DIM_MASKS[3] = { 0x1249249249249249ULL, 0x2492492492492492ULL, 0x4924924924924924ULL };
+		static const int BOX_TOP_BIT = 62; // highest bit of a 64-bit code with 21-bit coordinates
+
+		// Set bit i of v, clear the lower bits of v that belong to the same dimension ("1000..." in Tropf and Herzog)
+		inline uint_fast64_t loadOnes(uint_fast64_t v, int i) {
+			uint_fast64_t below = BOX_DIM_MASKS[i % 3] & ((static_cast<uint_fast64_t>(1) << i) - 1);
+			return (v & ~below) | (static_cast<uint_fast64_t>(1) << i);
+		}
+
+		// Clear bit i of v, set the lower bits of v that belong to the same dimension ("0111...")
+		inline uint_fast64_t loadZeros(uint_fast64_t v, int i) {
+			uint_fast64_t below = BOX_DIM_MASKS[i % 3] & ((static_cast<uint_fast64_t>(1) << i) - 1);
+			return (v & ~(static_cast<uint_fast64_t>(1) << i)) | below;
+		}
+
+		inline void boxCellsRecurse(uint_fast64_t start, unsigned int level, uint_fast32_t x, uint_fast32_t y, uint_fast32_t z,
+			const uint_fast32_t min[3], const uint_fast32_t max[3], std::vector<MortonCell> &cells) {
+			uint_fast32_t side = static_cast<uint_fast32_t>(1) << level;
+			if (x > max[0] || y > max[1] || z > max[2] || x + side - 1 < min[0] || y + side - 1 < min[1] || z + side - 1 < min[2]) {
+				return; // no overlap
+			}
+			if (x >= min[0] && y >= min[1] && z >= min[2] && x + side - 1 <= max[0] && y + side - 1 <= max[1] && z + side - 1 <= max[2]) {
+				MortonCell cell = { start, level };
+				cells.push_back(cell);
+				return; // fully inside
+			}
+			uint_fast32_t half = side / 2;
+			uint_fast64_t child_size = static_cast<uint_fast64_t>(1) << (3 * (level - 1));
+			for (unsigned int i = 0; i < 8; i++) {
+				boxCellsRecurse(start + i * child_size, level - 1, x + (i & 1) * half, y + ((i >> 1) & 1) * half, z + ((i >> 2) & 1) * half, min, max, cells);
+			}
+		}
+	}
+
+	// Is morton code m inside the box with corner codes box_min and box_max?
+	inline bool morton3D_64_in_box(const uint_fast64_t m, const uint_fast64_t box_min, const uint_fast64_t box_max) {
+		for (int d = 0; d < 3; d++) {
+			uint_fast64_t mask = box_detail::BOX_DIM_MASKS[d];
+			if ((m & mask) < (box_min & mask) || (m & mask) > (box_max & mask)) { return false; }
+		}
+		return true;
+	}
+
+	// BIGMIN: find the smallest code > m inside the box with corner codes box_min and box_max.
+	// Returns false if there is none.
+	inline bool morton3D_64_box_next(const uint_fast64_t m, uint_fast64_t box_min, uint_fast64_t box_max, uint_fast64_t &next) {
+		if (m >= box_max) { return false; }
+		uint_fast64_t z = m + 1;
+		if (morton3D_64_in_box(z, box_min, box_max)) {
+			next = z;
+			return true;
+		}
+		// z is outside the box: walk down the bits, keeping track of the part of the box above z
+		bool found = false;
+		for (int i = box_detail::BOX_TOP_BIT; i >= 0; i--) {
+			unsigned int bits = static_cast<unsigned int>(((z >> i) & 1) << 2 | ((box_min >> i) & 1) << 1 | ((box_max >> i) & 1));
+			switch (bits) {
+			case 1: // 001: the box straddles this bit: its upper half is a candidate, continue in its lower half
+				next = box_detail::loadOnes(box_min, i);
+				found = true;
+				box_max = box_detail::loadZeros(box_max, i);
+				break;
+			case 3: // 011: what's left of the box is above z
+				next = box_min;
+				return true;
+			case 4: // 100: what's left of the box is below z
+				return found;
+			case 5: // 101: continue in the upper half of the box
+				box_min = box_detail::loadOnes(box_min, i);
+				break;
+			default: // 000, 111: nothing to decide here (010 and 110 can't happen when box_min <= box_max)
+				break;
+			}
+		}
+		return found;
+	}
+
+	// LITMAX: find the largest code < m inside the box with corner codes box_min and box_max.
+	// Returns false if there is none.
+	inline bool morton3D_64_box_prev(const uint_fast64_t m, uint_fast64_t box_min, uint_fast64_t box_max, uint_fast64_t &prev) {
+		if (m <= box_min) { return false; }
+		uint_fast64_t z = m - 1;
+		if (morton3D_64_in_box(z, box_min, box_max)) {
+			prev = z;
+			return true;
+		}
+		// z is outside the box: walk down the bits, keeping track of the part of the box below z
+		bool found = false;
+		for (int i = box_detail::BOX_TOP_BIT; i >= 0; i--) {
+			unsigned int bits = static_cast<unsigned int>(((z >> i) & 1) << 2 | ((box_min >> i) & 1) << 1 | ((box_max >> i) & 1));
+			switch (bits) {
+			case 1: // 001: continue in the lower half of the box
+				box_max = box_detail::loadZeros(box_max, i);
+				break;
+			case 3: // 011: what's left of the box is above z
+				return found;
+			case 4: // 100: what's left of the box is below z
+				prev = box_max;
+				return true;
+			case 5: // 101: the box straddles this bit: its lower half is a candidate, continue in its upper half
+				prev = box_detail::loadZeros(box_max, i);
+				found = true;
+				box_min = box_detail::loadOnes(box_min, i);
+				break;
+			default:
+				break;
+			}
+		}
+		return found;
+	}
+
+	// Decompose the box [min, max] into the smallest list of aligned octree cells, in morton order (appended to cells).
+	// The cost is proportional to the number of cells times the number of levels.
+	inline void morton3D_64_box_cells(const uint_fast32_t min[3], const uint_fast32_t max[3], std::vector<MortonCell> &cells) {
+		unsigned int levels = 0;
+		while (levels < 21 && ((max[0] | max[1] | max[2]) >> levels) != 0) {
+			levels++;
+		}
+		box_detail::boxCellsRecurse(0, levels, 0, 0, 0, min, max, cells);
+	}
+
+	// Decompose the box [min, max] into the smallest list of runs of consecutive morton codes, in morton order (appended to ranges)
+	inline void morton3D_64_box_ranges(const uint_fast32_t min[3], const uint_fast32_t max[3], std::vector<MortonRange> &ranges) {
+		std::vector<MortonCell> cells;
+		morton3D_64_box_cells(min, max, cells);
+		for (size_t i = 0; i < cells.size(); i++) {
+			uint_fast64_t last = cells[i].start + ((static_cast<uint_fast64_t>(1) << (3 * cells[i].level)) - 1);
+			if (!ranges.empty() && ranges.back().last + 1 == cells[i].start) {
+				ranges.back().last = last; // cells which follow each other on the curve form one run
+			}
+			else {
+				MortonRange range = { cells[i].start, last };
+				ranges.push_back(range);
+			}
+		}
+	}
+}
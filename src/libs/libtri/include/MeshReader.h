@@ -0,0 +1,1199 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <glm/glm.hpp>
+#include "tri_util.h"
+#include "VertexCache.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <process.h>
+#define MESH_PROCESS_ID _getpid()
+#else
+#include <unistd.h>
+#define MESH_PROCESS_ID getpid()
+#endif
+
+using namespace std;
+
+// Streaming readers for PLY (ascii and binary), OBJ and STL (ascii and binary) meshes: they give the triangles of a mesh a batch at a time,
+// without loading it. Opening a mesh reads its vertices into a VertexCache (which stays within a memory limit) and computes their
+// bounding box. STL files have no shared vertices: opening one only reads it once for its bounding box.
+// The faces are read when we ask for triangles, polygons are split into a fan of triangles.
+// In the colored version, triangles get the colors of their vertices, and the average of their vertex normals as normal
+// (or, if the mesh has no normals or we recompute them, the normal of the triangle itself). STL triangles get their facet normal.
+// Input is read in batches of MESH_BATCH lines or records. The records of a batch are parsed in parallel when we can tell where each
+// of them starts without parsing the ones before: ascii PLY records and OBJ lines are a line each, binary PLY vertices without lists
+// and binary STL facets have a fixed size. Binary PLY faces (lists) are read one after the other. The triangles of a batch of faces are made in parallel,
+// as long as the vertices are in memory.
+
+enum MeshFormat { MESH_PLY, MESH_OBJ, MESH_STL, MESH_UNKNOWN };
+
+// A vertex as we keep it: position, and in the colored version, color and normal
+struct MeshVertex{
+	glm::vec3 position;
+#ifndef BINARY_VOXELIZATION
+	glm::vec3 color;
+	glm::vec3 normal;
+#endif
+};
+
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+struct PlyProperty{
+	string name;
+	PlyType type; // type of the value, or of the list items
+	bool is_list;
+	PlyType count_type; // type of the list length
+};
+
+struct PlyElement{
+	string name;
+	::uint64_t count;
+	vector<PlyProperty> properties;
+};
+
+// Where the values of a PLY vertex are
+struct PlyVertexLayout{
+	size_t x, y, z;
+	size_t nx, ny, nz;
+	size_t r, g, b;
+	glm::vec3 color_scale;
+};
+
+// An OBJ face line, with the number of vertices and normals before it (which its relative indices count back from)
+struct ObjFaceLine{
+	char* text;
+	::uint64_t vertices_before;
+	::uint64_t normals_before;
+};
+
+#define MESH_INPUT_BUFFERSIZE (4 * 1024 * 1024)
+#define MESH_BATCH 65536 // lines, vertices or faces we read and parse at once
+#define STL_HEADER_SIZE 84 // binary STL: 80 byte header and a facet count
+#define STL_FACET_SIZE 50 // binary STL: normal, 3 vertices and an attribute
+
+class MeshReader{
+public:
+	AABox<glm::vec3> bbox; // of all vertices
+	size_t n_triangles; // triangles we gave so far
+	size_t n_skipped; // triangles we skipped, because they use a vertex which doesn't exist
+	size_t n_faces; // faces of the mesh, counted when we open it (a polygon gives more than one triangle)
+	bool has_colors;
+	bool has_normals;
+
+	MeshReader();
+	~MeshReader();
+
+	static MeshFormat formatOf(const string &filename);
+	// Open a mesh and read its vertices (keeping at most memory_limit bytes of them in memory). Returns false if we can't read it.
+	bool open(const string &filename, ::uint64_t memory_limit, bool recompute_normals);
+	// Get the triangles of the next batch of faces (which can be none, if they were all skipped). Returns false when there are no more.
+	bool getTriangles(vector<Triangle> &triangles);
+	void close();
+
+	size_t vertexCount() const { return (vertices == NULL) ? 0 : vertices->n_vertices; }
+	bool verticesOnDisk() const { return vertices != NULL && vertices->onDisk(); }
+	size_t vertexPageReads() const { return (vertices == NULL) ? 0 : vertices->page_reads; }
+	::uint64_t memoryUsed() const { return ((vertices == NULL) ? 0 : vertices->memoryUsed()) + ((obj_normals == NULL) ? 0 : obj_normals->memoryUsed()); }
+
+private:
+	MeshFormat format;
+	string filename;
+	FILE* file;
+	bool recompute_normals;
+	VertexCache<MeshVertex>* vertices;
+	string spillFilename(const char* kind) const;
+
+	// the batch of faces (polygons) we're splitting in triangles
+	vector<vector<::uint64_t> > faces; // vertex index of every corner
+	vector<vector<::int64_t> > face_normals; // (OBJ) normal index of every corner, -1 if it has none
+	vector<size_t> face_first; // index of the first triangle of every face
+	vector<char> triangle_ok; // false for triangles which use a vertex that doesn't exist
+
+	// input: text and binary data go through the same buffer
+	vector<char> input;
+	size_t input_pos;
+	size_t input_end;
+	char* cursor; // the line readLine read
+	vector<char*> lines; // the lines readLines read
+	vector<double> batch_values; // values parsed from a batch of lines or records
+	vector<char> batch_bytes; // a batch of binary records
+	bool swap_bytes;
+	bool fillInput();
+	char* nextLine(bool may_read);
+	bool readLine();
+	size_t readLines(size_t max_lines);
+	bool readBytes(void* dst, size_t n);
+
+	// PLY
+	bool ply_binary;
+	vector<PlyElement> ply_elements;
+	size_t ply_face_element;
+	::uint64_t ply_faces_left;
+	size_t ply_face_list; // the list property with the vertex indices
+	PlyVertexLayout ply_layout;
+	vector<double> ply_values; // of one record
+	bool openPLY();
+	bool readPLYHeader();
+	bool readPLYRecord(const PlyElement &e, size_t list_property, vector<::uint64_t>* list);
+	bool skipPLYElement(const PlyElement &e);
+	bool readPLYVertices(const PlyElement &ve);
+	MeshVertex plyVertex(const double* values) const;
+	size_t readPLYFaces();
+
+	// OBJ
+	::uint64_t obj_vertices_seen; // vertices and normals we've passed while reading faces (for relative indices)
+	::uint64_t obj_normals_seen;
+	VertexCache<glm::vec3>* obj_normals;
+	vector<ObjFaceLine> obj_face_lines;
+	bool openOBJ();
+	size_t readOBJFaces();
+
+	// STL
+	bool stl_binary;
+	::uint64_t stl_facets_left; // (binary)
+	glm::vec3 stl_normal; // (ascii) the facet we're in
+	glm::vec3 stl_corners[3];
+	int stl_n_corners;
+	bool openSTL();
+	bool readSTLTriangles(vector<Triangle> &triangles);
+	void makeSTLTriangle(const glm::vec3 corners[3], Triangle &t) const;
+#ifndef BINARY_VOXELIZATION
+	void setSTLNormal(const glm::vec3 &normal, Triangle &t) const;
+#endif
+
+	void addVertex(const MeshVertex &v);
+	bool makeTriangle(size_t f, size_t a, size_t b, size_t c, Triangle &t);
+
+	MeshReader(const MeshReader&);
+	MeshReader& operator=(const MeshReader&);
+};
+
+inline MeshReader::MeshReader() : n_triangles(0), n_skipped(0), n_faces(0), has_colors(false), has_normals(false), format(MESH_UNKNOWN), file(NULL),
+	recompute_normals(false), vertices(NULL), input_pos(0), input_end(0), cursor(NULL), swap_bytes(false), ply_binary(false),
+	ply_face_element(0), ply_faces_left(0), ply_face_list(0), obj_vertices_seen(0), obj_normals_seen(0), obj_normals(NULL), stl_binary(false),
+	stl_facets_left(0), stl_n_corners(0){
+}
+
+inline MeshReader::~MeshReader(){
+	close();
+}
+
+inline MeshFormat MeshReader::formatOf(const string &filename){
+	size_t dot = filename.find_last_of(".");
+	if (dot == string::npos){
+		return MESH_UNKNOWN;
+	}
+	string extension = filename.substr(dot + 1);
+	for (size_t i = 0; i < extension.size(); i++){
+		extension[i] = static_cast<char>(tolower(extension[i]));
+	}
+	if (extension == "ply"){ return MESH_PLY; }
+	if (extension == "obj"){ return MESH_OBJ; }
+	if (extension == "stl"){ return MESH_STL; }
+	return MESH_UNKNOWN;
+}
+
+// Temporary file next to the mesh, for the vertices (or OBJ normals) which don't fit in memory. The process id and a counter make
+// it unique, so runs on the same mesh at the same time (like tri_convert and svo_builder) don't overwrite each other's files.
+inline string MeshReader::spillFilename(const char* kind) const{
+	static std::atomic<unsigned int> counter(0);
+	return filename + string(".") + val_to_string(MESH_PROCESS_ID) + string("_") + val_to_string(counter++) + string(".") + kind;
+}
+
+inline bool MeshReader::open(const string &filename, ::uint64_t memory_limit, bool recompute_normals){
+	close();
+	this->filename = filename;
+	this->recompute_normals = recompute_normals;
+	format = formatOf(filename);
+	if (format == MESH_UNKNOWN){
+		cout << "Can't stream " << filename << ": only .ply, .obj and .stl files can be streamed." << endl;
+		return false;
+	}
+	file = fopen(filename.c_str(), "rb");
+	if (file == NULL){
+		cout << "Could not open " << filename << endl;
+		return false;
+	}
+	setvbuf(file, NULL, _IONBF, 0); // we do our own buffering
+	n_triangles = 0;
+	n_skipped = 0;
+	n_faces = 0;
+	bbox = AABox<glm::vec3>(glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX), glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+	::uint64_t normal_limit = 0;
+#ifndef BINARY_VOXELIZATION
+	if (format == MESH_OBJ){ // OBJ normals are kept apart from the vertices
+		normal_limit = memory_limit / 4;
+		obj_normals = new VertexCache<glm::vec3>(spillFilename("normals"), normal_limit);
+	}
+#endif
+	vertices = new VertexCache<MeshVertex>(spillFilename("vertices"), memory_limit - normal_limit);
+	bool ok = (format == MESH_PLY) ? openPLY() : (format == MESH_OBJ) ? openOBJ() : openSTL();
+	vertices->finish();
+	if (bbox.min.x > bbox.max.x){ // no vertices
+		bbox = AABox<glm::vec3>();
+	}
+	return ok;
+}
+
+inline void MeshReader::close(){
+	if (file != NULL){
+		fclose(file);
+		file = NULL;
+	}
+	delete vertices;
+	vertices = NULL;
+	delete obj_normals;
+	obj_normals = NULL;
+	input_pos = input_end = 0;
+	ply_elements.clear();
+	ply_faces_left = 0;
+	stl_facets_left = 0;
+}
+
+inline bool MeshReader::getTriangles(vector<Triangle> &triangles){
+	if (format == MESH_STL){
+		return readSTLTriangles(triangles);
+	}
+	size_t n_batch = (format == MESH_PLY) ? readPLYFaces() : readOBJFaces();
+	triangles.clear();
+	if (n_batch == 0){
+		return false;
+	}
+	// a face with k corners gives a fan of k - 2 triangles: corners 0, j, j + 1
+	face_first.resize(n_batch + 1);
+	face_first[0] = 0;
+	for (size_t f = 0; f < n_batch; f++){
+		size_t corners = faces[f].size();
+		face_first[f + 1] = face_first[f] + ((corners >= 3) ? corners - 2 : 0);
+	}
+	triangles.resize(face_first[n_batch]);
+	triangle_ok.resize(triangles.size());
+	// the vertex caches can only be used by several threads at once while they're in memory
+	bool parallel = !vertices->onDisk() && (obj_normals == NULL || !obj_normals->onDisk());
+#pragma omp parallel for schedule(dynamic, 1024) if(parallel)
+	for (int64_t f = 0; f < (int64_t) n_batch; f++){
+		for (size_t j = 1; j + 1 < faces[f].size(); j++){
+			size_t t = face_first[f] + j - 1;
+			triangle_ok[t] = makeTriangle(static_cast<size_t>(f), 0, j, j + 1, triangles[t]);
+		}
+	}
+	// drop the triangles which use vertices the mesh doesn't have
+	size_t n = 0;
+	for (size_t t = 0; t < triangles.size(); t++){
+		if (triangle_ok[t]){
+			if (n != t){ triangles[n] = triangles[t]; }
+			n++;
+		}
+	}
+	n_skipped += triangles.size() - n;
+	n_triangles += n;
+	triangles.resize(n);
+	return true;
+}
+
+inline void MeshReader::addVertex(const MeshVertex &v){
+	bbox.min = glm::min(bbox.min, v.position);
+	bbox.max = glm::max(bbox.max, v.position);
+	vertices->add(v);
+}
+
+// Make a triangle out of corners a, b and c of face f of the batch. Returns false if it uses a vertex that doesn't exist.
+inline bool MeshReader::makeTriangle(size_t f, size_t a, size_t b, size_t c, Triangle &t){
+	const vector<::uint64_t> &face = faces[f];
+	size_t n_vertices = vertexCount();
+	if (face[a] >= n_vertices || face[b] >= n_vertices || face[c] >= n_vertices){
+		return false;
+	}
+	MeshVertex v0 = vertices->get(static_cast<size_t>(face[a]));
+	MeshVertex v1 = vertices->get(static_cast<size_t>(face[b]));
+	MeshVertex v2 = vertices->get(static_cast<size_t>(face[c]));
+	t.v0 = v0.position;
+	t.v1 = v1.position;
+	t.v2 = v2.position;
+#ifndef BINARY_VOXELIZATION
+	t.v0_color = v0.color;
+	t.v1_color = v1.color;
+	t.v2_color = v2.color;
+	bool corner_normals = has_normals && !recompute_normals;
+	if (corner_normals && format == MESH_OBJ){ // OBJ normals belong to the corners of a face
+		const vector<::int64_t> &normals = face_normals[f];
+		corner_normals = normals[a] >= 0 && normals[b] >= 0 && normals[c] >= 0
+			&& (size_t) normals[a] < obj_normals->n_vertices && (size_t) normals[b] < obj_normals->n_vertices && (size_t) normals[c] < obj_normals->n_vertices;
+		if (corner_normals){
+			v0.normal = obj_normals->get(static_cast<size_t>(normals[a]));
+			v1.normal = obj_normals->get(static_cast<size_t>(normals[b]));
+			v2.normal = obj_normals->get(static_cast<size_t>(normals[c]));
+		}
+	}
+	if (corner_normals){
+		glm::vec3 to_normalize = (v0.normal + v1.normal + v2.normal) / 3.0f;
+		t.normal = glm::normalize(to_normalize);
+	}
+	else {
+		t.normal = glm::normalize(glm::cross(v0.position - v1.position, v1.position - v2.position));
+	}
+#endif
+	return true;
+}
+
+// INPUT
+
+// Move what we haven't used of the input buffer to its front, and read more after it. Returns false if there was nothing more to read.
+inline bool MeshReader::fillInput(){
+	if (input.empty()){
+		input.resize(MESH_INPUT_BUFFERSIZE + 1); // + 1: room to end a last line which has no newline
+	}
+	size_t left = input_end - input_pos;
+	if (left > 0 && input_pos > 0){
+		memmove(&input[0], &input[input_pos], left);
+	}
+	input_pos = 0;
+	input_end = left;
+	if (input_end == input.size() - 1){ // a line which doesn't fit
+		input.resize(2 * (input.size() - 1) + 1);
+	}
+	size_t n = fread(&input[input_end], 1, input.size() - 1 - input_end, file);
+	input_end += n;
+	return n > 0;
+}
+
+// The next line in the input buffer (its newline replaced by a 0), or NULL at the end of the file. If there's no complete line
+// left in the buffer, we read more if we may, and return NULL if we may not.
+inline char* MeshReader::nextLine(bool may_read){
+	while (true){
+		size_t left = input_end - input_pos;
+		char* start = (left == 0) ? NULL : &input[input_pos];
+		char* newline = (left == 0) ? NULL : static_cast<char*>(memchr(start, '\n', left));
+		if (newline != NULL){
+			*newline = '\0';
+			input_pos += static_cast<size_t>(newline - start) + 1;
+			return start;
+		}
+		if (!may_read){
+			return NULL;
+		}
+		if (!fillInput()){
+			if (input_end == input_pos){
+				return NULL;
+			}
+			input[input_end] = '\0'; // the last line, without newline
+			start = &input[input_pos];
+			input_pos = input_end;
+			return start;
+		}
+	}
+}
+
+// Read the next line of a text file, cursor points to its start
+inline bool MeshReader::readLine(){
+	cursor = nextLine(true);
+	return cursor != NULL;
+}
+
+inline bool isBlankLine(const char* l){
+	while (isspace(static_cast<unsigned char>(*l))){ l++; }
+	return *l == '\0';
+}
+
+// Read up to max_lines lines into lines, returns how many (0 at the end of the file). They stay valid until we read more.
+// Blank lines are skipped, so every line is a record (of a PLY element) or a command.
+inline size_t MeshReader::readLines(size_t max_lines){
+	lines.clear();
+	char* l = nextLine(true);
+	while (l != NULL){
+		if (!isBlankLine(l)){
+			lines.push_back(l);
+			if (lines.size() == max_lines){
+				break;
+			}
+		}
+		l = nextLine(lines.empty()); // reading more moves the buffer: only while we hold no lines
+	}
+	return lines.size();
+}
+
+inline bool MeshReader::readBytes(void* dst, size_t n){
+	char* out = static_cast<char*>(dst);
+	while (n > 0){
+		if (input_pos == input_end && !fillInput()){
+			return false;
+		}
+		size_t k = std::min(n, input_end - input_pos);
+		memcpy(out, &input[input_pos], k);
+		input_pos += k;
+		out += k;
+		n -= k;
+	}
+	return true;
+}
+
+// Parse up to max_values numbers from text, returns how many there were
+inline int parseNumbers(const char* text, double* values, int max_values){
+	int n = 0;
+	char* end;
+	while (n < max_values){
+		values[n] = strtod(text, &end);
+		if (end == text){
+			break;
+		}
+		text = end;
+		n++;
+	}
+	return n;
+}
+
+// PLY
+
+inline PlyType plyTypeOf(const string &name){
+	if (name == "char" || name == "int8"){ return PLY_INT8; }
+	if (name == "uchar" || name == "uint8"){ return PLY_UINT8; }
+	if (name == "short" || name == "int16"){ return PLY_INT16; }
+	if (name == "ushort" || name == "uint16"){ return PLY_UINT16; }
+	if (name == "int" || name == "int32"){ return PLY_INT32; }
+	if (name == "uint" || name == "uint32"){ return PLY_UINT32; }
+	if (name == "float" || name == "float32"){ return PLY_FLOAT32; }
+	if (name == "double" || name == "float64"){ return PLY_FLOAT64; }
+	return PLY_INVALID;
+}
+
+inline size_t plyTypeSize(PlyType type){
+	static const size_t sizes[PLY_INVALID] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+	return sizes[type];
+}
+
+// Scale of a color property: integer colors go from 0 to their maximum value, float colors from 0 to 1
+inline float plyColorScale(PlyType type){
+	if (type == PLY_UINT8 || type == PLY_INT8){ return 1.0f / 255.0f; }
+	if (type == PLY_UINT16 || type == PLY_INT16){ return 1.0f / 65535.0f; }
+	return 1.0f;
+}
+
+// A vertex index from a PLY list: negative ones don't exist
+inline ::uint64_t plyIndex(double value){
+	return (value < 0) ? ~static_cast<::uint64_t>(0) : static_cast<::uint64_t>(value);
+}
+
+inline size_t findPlyProperty(const PlyElement &e, const char* name, const char* alt1, const char* alt2){
+	for (size_t i = 0; i < e.properties.size(); i++){
+		const string &n = e.properties[i].name;
+		if (n == name || (alt1 != NULL && n == alt1) || (alt2 != NULL && n == alt2)){
+			return i;
+		}
+	}
+	return e.properties.size();
+}
+
+// Decode a binary PLY value
+inline double decodePLYValue(PlyType type, const char* data, bool swap_bytes){
+	unsigned char bytes[8];
+	size_t size = plyTypeSize(type);
+	memcpy(bytes, data, size);
+	if (swap_bytes){
+		std::reverse(bytes, bytes + size);
+	}
+	switch (type){
+	case PLY_INT8: { ::int8_t v; memcpy(&v, bytes, 1); return v; }
+	case PLY_UINT8: { ::uint8_t v; memcpy(&v, bytes, 1); return v; }
+	case PLY_INT16: { ::int16_t v; memcpy(&v, bytes, 2); return v; }
+	case PLY_UINT16: { ::uint16_t v; memcpy(&v, bytes, 2); return v; }
+	case PLY_INT32: { ::int32_t v; memcpy(&v, bytes, 4); return v; }
+	case PLY_UINT32: { ::uint32_t v; memcpy(&v, bytes, 4); return v; }
+	case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+	default: { double v; memcpy(&v, bytes, 8); return v; }
+	}
+}
+
+// Decode a binary PLY record of an element without lists into values
+inline void decodePLYRecord(const PlyElement &e, const char* data, bool swap_bytes, double* values){
+	for (size_t i = 0; i < e.properties.size(); i++){
+		values[i] = decodePLYValue(e.properties[i].type, data, swap_bytes);
+		data += plyTypeSize(e.properties[i].type);
+	}
+}
+
+// Parse an ascii PLY record of an element from a line: its values go to values (the length, for lists), the items of list property
+// list_property (if any) to list. Returns false if the line doesn't hold the whole record.
+inline bool parsePLYLine(const PlyElement &e, const char* text, double* values, size_t list_property, vector<::uint64_t>* list){
+	if (list != NULL){ list->clear(); }
+	char* end;
+	for (size_t i = 0; i < e.properties.size(); i++){
+		const PlyProperty &p = e.properties[i];
+		values[i] = strtod(text, &end);
+		if (end == text){
+			return false;
+		}
+		text = end;
+		if (!p.is_list){
+			continue;
+		}
+		for (::uint64_t k = 0; k < static_cast<::uint64_t>(values[i]); k++){
+			double value = strtod(text, &end);
+			if (end == text){
+				return false;
+			}
+			text = end;
+			if (i == list_property && list != NULL){
+				list->push_back(plyIndex(value));
+			}
+		}
+	}
+	return true;
+}
+
+inline bool MeshReader::readPLYHeader(){
+	if (!readLine() || strncmp(cursor, "ply", 3) != 0){
+		cout << filename << " is not a PLY file." << endl;
+		return false;
+	}
+	bool has_format = false;
+	while (readLine()){
+		char keyword[64] = "", a[64] = "", b[64] = "", c[64] = "", d[64] = "";
+		int n = sscanf(cursor, "%63s %63s %63s %63s %63s", keyword, a, b, c, d);
+		string k = keyword;
+		if (k == "end_header"){
+			if (!has_format){
+				cout << filename << " has no PLY format line." << endl;
+				return false;
+			}
+			return true;
+		}
+		if (k == "format" && n >= 2){
+			string f = a;
+			if (f == "ascii"){
+				ply_binary = false;
+			}
+			else if (f == "binary_little_endian" || f == "binary_big_endian"){
+				ply_binary = true;
+				unsigned int one = 1;
+				bool little_endian_host = (*reinterpret_cast<unsigned char*>(&one) == 1);
+				swap_bytes = (f == "binary_little_endian") != little_endian_host;
+			}
+			else {
+				cout << filename << " has an unknown PLY format: " << f << endl;
+				return false;
+			}
+			has_format = true;
+		}
+		else if (k == "element" && n >= 3){
+			PlyElement e;
+			e.name = a;
+			e.count = strtoull(b, NULL, 10);
+			ply_elements.push_back(e);
+		}
+		else if (k == "property" && n >= 3 && !ply_elements.empty()){
+			PlyProperty p;
+			p.is_list = (string(a) == "list");
+			if (p.is_list && n >= 5){
+				p.count_type = plyTypeOf(b);
+				p.type = plyTypeOf(c);
+				p.name = d;
+			}
+			else {
+				p.count_type = PLY_INVALID;
+				p.type = plyTypeOf(a);
+				p.name = b;
+			}
+			if (p.type == PLY_INVALID || (p.is_list && p.count_type == PLY_INVALID)){
+				cout << filename << " has a PLY property we can't read: " << cursor << endl;
+				return false;
+			}
+			ply_elements.back().properties.push_back(p);
+		}
+		// comment, obj_info: nothing to do
+	}
+	cout << filename << " ends in its PLY header." << endl;
+	return false;
+}
+
+// Read one record of an element: its values go to ply_values, the items of list property list_property (if any) to list
+inline bool MeshReader::readPLYRecord(const PlyElement &e, size_t list_property, vector<::uint64_t>* list){
+	ply_values.resize(e.properties.size());
+	if (!ply_binary){
+		do { // skip empty lines
+			if (!readLine()){ return false; }
+			while (isspace(static_cast<unsigned char>(*cursor))){ cursor++; }
+		} while (*cursor == '\0');
+		return parsePLYLine(e, cursor, ply_values.data(), list_property, list);
+	}
+	if (list != NULL){ list->clear(); }
+	char bytes[8];
+	for (size_t i = 0; i < e.properties.size(); i++){
+		const PlyProperty &p = e.properties[i];
+		if (!p.is_list){
+			if (!readBytes(bytes, plyTypeSize(p.type))){ return false; }
+			ply_values[i] = decodePLYValue(p.type, bytes, swap_bytes);
+			continue;
+		}
+		if (!readBytes(bytes, plyTypeSize(p.count_type))){ return false; }
+		double count = decodePLYValue(p.count_type, bytes, swap_bytes);
+		for (::uint64_t k = 0; k < static_cast<::uint64_t>(count); k++){
+			if (!readBytes(bytes, plyTypeSize(p.type))){ return false; }
+			if (i == list_property && list != NULL){
+				list->push_back(plyIndex(decodePLYValue(p.type, bytes, swap_bytes)));
+			}
+		}
+		ply_values[i] = count;
+	}
+	return true;
+}
+
+inline bool MeshReader::skipPLYElement(const PlyElement &e){
+	for (::uint64_t r = 0; r < e.count; r++){
+		if (!readPLYRecord(e, e.properties.size(), NULL)){
+			cout << filename << " ends in its " << e.name << " element." << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+inline MeshVertex MeshReader::plyVertex(const double* values) const{
+	const PlyVertexLayout &l = ply_layout;
+	MeshVertex v;
+	v.position = glm::vec3(static_cast<float>(values[l.x]), static_cast<float>(values[l.y]), static_cast<float>(values[l.z]));
+#ifndef BINARY_VOXELIZATION
+	v.normal = has_normals ? glm::vec3(static_cast<float>(values[l.nx]), static_cast<float>(values[l.ny]), static_cast<float>(values[l.nz])) : glm::vec3();
+	v.color = has_colors ? glm::vec3(static_cast<float>(values[l.r]) * l.color_scale[0], static_cast<float>(values[l.g]) * l.color_scale[1], static_cast<float>(values[l.b]) * l.color_scale[2]) : glm::vec3();
+#endif
+	return v;
+}
+
+// Read the vertex element, a batch at a time
+inline bool MeshReader::readPLYVertices(const PlyElement &ve){
+	size_t n_properties = ve.properties.size();
+	size_t record_size = 0; // of a binary vertex, 0 if it has a list
+	for (size_t i = 0; i < n_properties; i++){
+		if (ve.properties[i].is_list){
+			record_size = 0;
+			break;
+		}
+		record_size += plyTypeSize(ve.properties[i].type);
+	}
+	vector<MeshVertex> batch;
+	::uint64_t left = ve.count;
+	while (left > 0){
+		size_t n = static_cast<size_t>(std::min(left, static_cast<::uint64_t>(MESH_BATCH)));
+		batch_values.resize(n * n_properties);
+		bool ok = true;
+		if (!ply_binary){ // a line each
+			n = readLines(n);
+			int64_t bad = 0;
+#pragma omp parallel for reduction(+:bad)
+			for (int64_t i = 0; i < (int64_t) n; i++){
+				if (!parsePLYLine(ve, lines[i], &batch_values[i * n_properties], n_properties, NULL)){ bad++; }
+			}
+			ok = (n > 0 && bad == 0);
+		}
+		else if (record_size > 0){ // a fixed size each
+			batch_bytes.resize(n * record_size);
+			ok = readBytes(&batch_bytes[0], n * record_size);
+#pragma omp parallel for if(ok)
+			for (int64_t i = 0; i < (int64_t) n; i++){
+				decodePLYRecord(ve, &batch_bytes[i * record_size], swap_bytes, &batch_values[i * n_properties]);
+			}
+		}
+		else { // one after the other
+			for (size_t i = 0; i < n && ok; i++){
+				ok = readPLYRecord(ve, n_properties, NULL);
+				std::copy(ply_values.begin(), ply_values.end(), batch_values.begin() + i * n_properties);
+			}
+		}
+		if (!ok){
+			cout << filename << " ends in its vertex element, or has a vertex we can't read." << endl;
+			return false;
+		}
+		batch.resize(n);
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t) n; i++){
+			batch[i] = plyVertex(&batch_values[i * n_properties]);
+		}
+		for (size_t i = 0; i < n; i++){
+			addVertex(batch[i]);
+		}
+		left -= n;
+	}
+	return true;
+}
+
+inline bool MeshReader::openPLY(){
+	if (!readPLYHeader()){
+		return false;
+	}
+	size_t vertex_element = ply_elements.size();
+	ply_face_element = ply_elements.size();
+	for (size_t i = 0; i < ply_elements.size(); i++){
+		if (ply_elements[i].name == "vertex" && vertex_element == ply_elements.size()){ vertex_element = i; }
+		if (ply_elements[i].name == "face" && ply_face_element == ply_elements.size()){ ply_face_element = i; }
+		if (ply_elements[i].name == "tristrips"){
+			cout << filename << " stores triangle strips, which can't be streamed." << endl;
+			return false;
+		}
+	}
+	if (vertex_element == ply_elements.size()){
+		cout << filename << " has no vertex element." << endl;
+		return false;
+	}
+	if (ply_face_element < vertex_element){
+		cout << filename << " stores its faces before its vertices, which can't be streamed." << endl;
+		return false;
+	}
+	const PlyElement &ve = ply_elements[vertex_element];
+	PlyVertexLayout &l = ply_layout;
+	l.x = findPlyProperty(ve, "x", NULL, NULL);
+	l.y = findPlyProperty(ve, "y", NULL, NULL);
+	l.z = findPlyProperty(ve, "z", NULL, NULL);
+	if (l.x == ve.properties.size() || l.y == ve.properties.size() || l.z == ve.properties.size()){
+		cout << filename << " has vertices without x, y and z." << endl;
+		return false;
+	}
+#ifndef BINARY_VOXELIZATION
+	l.nx = findPlyProperty(ve, "nx", "normal_x", NULL);
+	l.ny = findPlyProperty(ve, "ny", "normal_y", NULL);
+	l.nz = findPlyProperty(ve, "nz", "normal_z", NULL);
+	l.r = findPlyProperty(ve, "red", "diffuse_red", "r");
+	l.g = findPlyProperty(ve, "green", "diffuse_green", "g");
+	l.b = findPlyProperty(ve, "blue", "diffuse_blue", "b");
+	has_normals = l.nx < ve.properties.size() && l.ny < ve.properties.size() && l.nz < ve.properties.size();
+	has_colors = l.r < ve.properties.size() && l.g < ve.properties.size() && l.b < ve.properties.size();
+	l.color_scale = has_colors ? glm::vec3(plyColorScale(ve.properties[l.r].type), plyColorScale(ve.properties[l.g].type), plyColorScale(ve.properties[l.b].type)) : glm::vec3();
+#endif
+
+	// skip what comes before the vertices, read them, and skip what comes between the vertices and the faces
+	for (size_t i = 0; i < vertex_element; i++){
+		if (!skipPLYElement(ply_elements[i])){ return false; }
+	}
+	if (!readPLYVertices(ve)){
+		return false;
+	}
+	if (ply_face_element == ply_elements.size()){ // a point cloud
+		ply_faces_left = 0;
+		return true;
+	}
+	for (size_t i = vertex_element + 1; i < ply_face_element; i++){
+		if (!skipPLYElement(ply_elements[i])){ return false; }
+	}
+	const PlyElement &fe = ply_elements[ply_face_element];
+	ply_face_list = findPlyProperty(fe, "vertex_indices", "vertex_index", NULL);
+	if (ply_face_list == fe.properties.size() || !fe.properties[ply_face_list].is_list){
+		cout << filename << " has faces without a vertex_indices list." << endl;
+		return false;
+	}
+	ply_faces_left = fe.count;
+	n_faces = static_cast<size_t>(fe.count);
+	return true;
+}
+
+// Read the next batch of faces, returns how many (0 after the last one)
+inline size_t MeshReader::readPLYFaces(){
+	size_t n = static_cast<size_t>(std::min(ply_faces_left, static_cast<::uint64_t>(MESH_BATCH)));
+	if (n == 0){
+		return 0;
+	}
+	const PlyElement &fe = ply_elements[ply_face_element];
+	if (faces.size() < n){
+		faces.resize(n);
+		face_normals.resize(n);
+	}
+	bool ok = true;
+	if (!ply_binary){ // a line each
+		size_t n_properties = fe.properties.size();
+		n = readLines(n);
+		batch_values.resize(n * n_properties);
+		int64_t bad = 0;
+#pragma omp parallel for reduction(+:bad)
+		for (int64_t i = 0; i < (int64_t) n; i++){
+			if (!parsePLYLine(fe, lines[i], &batch_values[i * n_properties], ply_face_list, &faces[i])){ bad++; }
+		}
+		ok = (n > 0 && bad == 0);
+	}
+	else { // lists: one after the other
+		for (size_t i = 0; i < n && ok; i++){
+			ok = readPLYRecord(fe, ply_face_list, &faces[i]);
+		}
+	}
+	if (!ok){
+		cout << filename << " ends in its face element, or has a face we can't read." << endl;
+		ply_faces_left = 0;
+		return 0;
+	}
+	ply_faces_left -= n;
+	return n;
+}
+
+// OBJ
+
+inline bool isOBJVertexLine(const char* l){ return l[0] == 'v' && (l[1] == ' ' || l[1] == '\t'); }
+inline bool isOBJNormalLine(const char* l){ return l[0] == 'v' && l[1] == 'n' && (l[2] == ' ' || l[2] == '\t'); }
+inline bool isOBJFaceLine(const char* l){ return l[0] == 'f' && (l[1] == ' ' || l[1] == '\t'); }
+
+// Parse a normal line. Only normals with 3 coordinates are kept, and readOBJFaces counts the normals by this same rule,
+// so the normal indices of the faces point at the normals we have.
+inline bool parseOBJNormal(const char* l, double* values){
+	return isOBJNormalLine(l) && parseNumbers(l + 2, values, 3) == 3;
+}
+
+// Parse the corners of an OBJ face line (after the f): v, v/vt, v//vn or v/vt/vn. Indices start at 1, negative indices count back
+// from the last vertex or normal before the face. Faces with less than 3 corners are left empty.
+inline void parseOBJFace(const ObjFaceLine &f, vector<::uint64_t> &face, vector<::int64_t> &normals){
+	face.clear();
+	normals.clear();
+	const char* cursor = f.text;
+	while (true){
+		char* end;
+		long long index = strtoll(cursor, &end, 10);
+		if (end == cursor){
+			break;
+		}
+		cursor = end;
+		face.push_back((index > 0) ? static_cast<::uint64_t>(index - 1) : (index < 0 && (::uint64_t)(-index) <= f.vertices_before) ? f.vertices_before - static_cast<::uint64_t>(-index) : ~static_cast<::uint64_t>(0));
+		::int64_t normal = -1;
+		if (*cursor == '/'){
+			cursor++;
+			strtoll(cursor, &end, 10); // texture coordinate: not used
+			cursor = end;
+			if (*cursor == '/'){
+				cursor++;
+				long long n = strtoll(cursor, &end, 10);
+				if (end != cursor){
+					normal = (n > 0) ? n - 1 : ((n < 0 && (::uint64_t)(-n) <= f.normals_before) ? static_cast<::int64_t>(f.normals_before) + n : -1);
+				}
+				cursor = end;
+			}
+		}
+		normals.push_back(normal);
+		while (*cursor != '\0' && !isspace(static_cast<unsigned char>(*cursor))){ cursor++; } // anything we don't know
+	}
+	if (face.size() < 3){
+		face.clear();
+		normals.clear();
+	}
+}
+
+// Read the vertices and count the faces (the colored version also reads the normals, into the obj_normals open() made)
+inline bool MeshReader::openOBJ(){
+	// first pass: vertices (and normals), which faces may use before they're defined
+	vector<double> values;
+	vector<int> counts;
+	size_t n;
+	while ((n = readLines(MESH_BATCH)) > 0){
+		// parse the numbers on the vertex (and normal) lines in parallel, then add them in order
+		values.resize(n * 6);
+		counts.resize(n);
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t) n; i++){
+			const char* l = lines[i];
+			counts[i] = 0;
+			if (isOBJVertexLine(l)){
+				counts[i] = parseNumbers(l + 1, &values[i * 6], 6);
+			}
+#ifndef BINARY_VOXELIZATION
+			else if (parseOBJNormal(l, &values[i * 6])){
+				counts[i] = 3;
+			}
+#endif
+		}
+		for (size_t i = 0; i < n; i++){
+			const double* v = &values[i * 6];
+			if (isOBJVertexLine(lines[i])){
+				if (counts[i] < 3){
+					cout << filename << " has a vertex without 3 coordinates: " << lines[i] << endl;
+					return false;
+				}
+				MeshVertex vertex;
+				vertex.position = glm::vec3(static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2]));
+#ifndef BINARY_VOXELIZATION
+				if (counts[i] == 6){ // vertex colors (a common extension)
+					has_colors = true;
+					vertex.color = glm::vec3(static_cast<float>(v[3]), static_cast<float>(v[4]), static_cast<float>(v[5]));
+				}
+				else {
+					vertex.color = glm::vec3();
+				}
+				vertex.normal = glm::vec3();
+#endif
+				addVertex(vertex);
+			}
+#ifndef BINARY_VOXELIZATION
+			else if (isOBJNormalLine(lines[i]) && counts[i] == 3){
+				obj_normals->add(glm::vec3(static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2])));
+				has_normals = true;
+			}
+#endif
+			else if (isOBJFaceLine(lines[i])){
+				n_faces++;
+			}
+		}
+	}
+#ifndef BINARY_VOXELIZATION
+	obj_normals->finish();
+#endif
+	// second pass reads the faces
+	rewind(file);
+	input_pos = input_end = 0;
+	obj_vertices_seen = 0;
+	obj_normals_seen = 0;
+	return true;
+}
+
+// Read the next batch of faces, returns how many (0 after the last one). The vertices and normals before each face line are
+// counted in order, then the faces are parsed in parallel.
+inline size_t MeshReader::readOBJFaces(){
+	obj_face_lines.clear();
+	while (obj_face_lines.empty()){
+		size_t n = readLines(MESH_BATCH);
+		if (n == 0){
+			return 0;
+		}
+		double normal[3];
+		for (size_t i = 0; i < n; i++){
+			const char* l = lines[i];
+			if (isOBJVertexLine(l)){
+				obj_vertices_seen++;
+			}
+			else if (isOBJNormalLine(l)){
+				if (parseOBJNormal(l, normal)){ // the normals openOBJ kept
+					obj_normals_seen++;
+				}
+			}
+			else if (isOBJFaceLine(l)){
+				ObjFaceLine f;
+				f.text = lines[i] + 1;
+				f.vertices_before = obj_vertices_seen;
+				f.normals_before = obj_normals_seen;
+				obj_face_lines.push_back(f);
+			}
+		}
+	}
+	size_t n_batch = obj_face_lines.size();
+	if (faces.size() < n_batch){
+		faces.resize(n_batch);
+		face_normals.resize(n_batch);
+	}
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t) n_batch; i++){
+		parseOBJFace(obj_face_lines[i], faces[i], face_normals[i]);
+	}
+	return n_batch;
+}
+
+// STL
+
+// An STL value (binary STL is little endian)
+inline float stlFloat(const char* data, bool swap_bytes){
+	char bytes[4];
+	memcpy(bytes, data, 4);
+	if (swap_bytes){
+		std::reverse(bytes, bytes + 4);
+	}
+	float v;
+	memcpy(&v, bytes, 4);
+	return v;
+}
+
+inline glm::vec3 stlVector(const char* data, bool swap_bytes){
+	return glm::vec3(stlFloat(data, swap_bytes), stlFloat(data + 4, swap_bytes), stlFloat(data + 8, swap_bytes));
+}
+
+enum StlLine { STL_OTHER, STL_FACET, STL_VERTEX, STL_ENDFACET };
+
+// What an ascii STL line is, and its numbers (the normal of a facet, the position of a vertex)
+inline StlLine parseSTLLine(const char* l, double* values){
+	while (isspace(static_cast<unsigned char>(*l))){ l++; }
+	if (strncmp(l, "vertex", 6) == 0){
+		return (parseNumbers(l + 6, values, 3) == 3) ? STL_VERTEX : STL_OTHER;
+	}
+	if (strncmp(l, "facet", 5) == 0){
+		l += 5;
+		while (isspace(static_cast<unsigned char>(*l))){ l++; }
+		if (strncmp(l, "normal", 6) != 0 || parseNumbers(l + 6, values, 3) != 3){
+			values[0] = values[1] = values[2] = 0.0;
+		}
+		return STL_FACET;
+	}
+	if (strncmp(l, "endfacet", 8) == 0){
+		return STL_ENDFACET;
+	}
+	return STL_OTHER;
+}
+
+// Open an STL file: find out if it's binary (ascii ones start with "solid", but so do some binary ones: we go by the size too),
+// and read it once for the bounding box and the number of facets
+inline bool MeshReader::openSTL(){
+	unsigned int one = 1;
+	swap_bytes = (*reinterpret_cast<unsigned char*>(&one) != 1); // binary STL is little endian
+	has_normals = true; // the facet normals
+#if defined(_WIN32) || defined(_WIN64)
+	_fseeki64(file, 0, SEEK_END);
+	::uint64_t size = static_cast<::uint64_t>(_ftelli64(file));
+#else
+	fseeko(file, 0, SEEK_END);
+	::uint64_t size = static_cast<::uint64_t>(ftello(file));
+#endif
+	rewind(file);
+	char header[STL_HEADER_SIZE];
+	::uint64_t count = 0;
+	stl_binary = false;
+	if (size >= STL_HEADER_SIZE && fread(header, 1, STL_HEADER_SIZE, file) == STL_HEADER_SIZE){
+		::uint32_t c;
+		memcpy(&c, header + 80, 4);
+		if (swap_bytes){ c = (c >> 24) | ((c >> 8) & 0xff00) | ((c << 8) & 0xff0000) | (c << 24); }
+		count = c;
+		stl_binary = (STL_HEADER_SIZE + count * STL_FACET_SIZE == size) || strncmp(header, "solid", 5) != 0;
+	}
+	if (stl_binary){
+		count = std::min(count, (size - STL_HEADER_SIZE) / STL_FACET_SIZE);
+		::uint64_t left = count;
+		while (left > 0){
+			size_t n = static_cast<size_t>(std::min(left, static_cast<::uint64_t>(MESH_BATCH)));
+			batch_bytes.resize(n * STL_FACET_SIZE);
+			if (!readBytes(&batch_bytes[0], n * STL_FACET_SIZE)){
+				cout << filename << " ends in its facets." << endl;
+				return false;
+			}
+			for (size_t i = 0; i < n; i++){
+				for (int k = 0; k < 3; k++){
+					glm::vec3 v = stlVector(&batch_bytes[i * STL_FACET_SIZE + 12 + 12 * k], swap_bytes);
+					bbox.min = glm::min(bbox.min, v);
+					bbox.max = glm::max(bbox.max, v);
+				}
+			}
+			left -= n;
+		}
+		n_faces = static_cast<size_t>(count);
+		stl_facets_left = count;
+#if defined(_WIN32) || defined(_WIN64)
+		_fseeki64(file, STL_HEADER_SIZE, SEEK_SET);
+#else
+		fseeko(file, STL_HEADER_SIZE, SEEK_SET);
+#endif
+		input_pos = input_end = 0;
+		return true;
+	}
+	// ascii: the lines of a batch are parsed in parallel
+	rewind(file);
+	input_pos = input_end = 0;
+	vector<StlLine> kinds;
+	size_t n;
+	while ((n = readLines(MESH_BATCH)) > 0){
+		kinds.resize(n);
+		batch_values.resize(n * 3);
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t) n; i++){
+			kinds[i] = parseSTLLine(lines[i], &batch_values[i * 3]);
+		}
+		for (size_t i = 0; i < n; i++){
+			if (kinds[i] == STL_VERTEX){
+				glm::vec3 v(static_cast<float>(batch_values[i * 3]), static_cast<float>(batch_values[i * 3 + 1]), static_cast<float>(batch_values[i * 3 + 2]));
+				bbox.min = glm::min(bbox.min, v);
+				bbox.max = glm::max(bbox.max, v);
+			}
+			else if (kinds[i] == STL_ENDFACET){
+				n_faces++;
+			}
+		}
+	}
+	rewind(file);
+	input_pos = input_end = 0;
+	stl_n_corners = 0;
+	return true;
+}
+
+inline void MeshReader::makeSTLTriangle(const glm::vec3 corners[3], Triangle &t) const{
+	t.v0 = corners[0];
+	t.v1 = corners[1];
+	t.v2 = corners[2];
+#ifndef BINARY_VOXELIZATION
+	t.v0_color = t.v1_color = t.v2_color = glm::vec3();
+#endif
+}
+
+#ifndef BINARY_VOXELIZATION
+// The normal of a triangle made by makeSTLTriangle: the normal of its facet
+inline void MeshReader::setSTLNormal(const glm::vec3 &normal, Triangle &t) const{
+	if (recompute_normals || normal == glm::vec3()){ // many exporters leave the facet normal 0
+		t.normal = glm::normalize(glm::cross(t.v0 - t.v1, t.v1 - t.v2));
+	}
+	else {
+		t.normal = glm::normalize(normal);
+	}
+}
+#endif
+
+// Read the triangles of the next batch of facets
+inline bool MeshReader::readSTLTriangles(vector<Triangle> &triangles){
+	triangles.clear();
+	if (stl_binary){ // fixed size facets, which we decode in parallel
+		size_t n = static_cast<size_t>(std::min(stl_facets_left, static_cast<::uint64_t>(MESH_BATCH)));
+		if (n == 0){
+			return false;
+		}
+		batch_bytes.resize(n * STL_FACET_SIZE);
+		if (!readBytes(&batch_bytes[0], n * STL_FACET_SIZE)){
+			cout << filename << " ends in its facets." << endl;
+			stl_facets_left = 0;
+			return false;
+		}
+		triangles.resize(n);
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t) n; i++){
+			const char* facet = &batch_bytes[i * STL_FACET_SIZE];
+			glm::vec3 corners[3] = { stlVector(facet + 12, swap_bytes), stlVector(facet + 24, swap_bytes), stlVector(facet + 36, swap_bytes) };
+			makeSTLTriangle(corners, triangles[i]);
+#ifndef BINARY_VOXELIZATION
+			setSTLNormal(stlVector(facet, swap_bytes), triangles[i]);
+#endif
+		}
+		stl_facets_left -= n;
+		n_triangles += n;
+		return true;
+	}
+	// ascii: parse the lines of a batch in parallel, then put the facets together (one can go on in the next batch)
+	size_t n = readLines(MESH_BATCH);
+	if (n == 0){
+		return false;
+	}
+	vector<StlLine> kinds(n);
+	batch_values.resize(n * 3);
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t) n; i++){
+		kinds[i] = parseSTLLine(lines[i], &batch_values[i * 3]);
+	}
+	for (size_t i = 0; i < n; i++){
+		const double* v = &batch_values[i * 3];
+		glm::vec3 value(static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2]));
+		if (kinds[i] == STL_FACET){
+			stl_normal = value;
+			stl_n_corners = 0;
+		}
+		else if (kinds[i] == STL_VERTEX){
+			if (stl_n_corners < 3){ stl_corners[stl_n_corners] = value; }
+			stl_n_corners++;
+		}
+		else if (kinds[i] == STL_ENDFACET){
+			if (stl_n_corners == 3){
+				triangles.push_back(Triangle());
+				makeSTLTriangle(stl_corners, triangles.back());
+#ifndef BINARY_VOXELIZATION
+				setSTLNormal(stl_normal, triangles.back());
+#endif
+			}
+			else {
+				n_skipped++;
+			}
+			stl_n_corners = 0;
+		}
+	}
+	n_triangles += triangles.size();
+	return true;
+}
@@ -25,6 +25,7 @@ public:
 	void getTriangle(Triangle& t);
 	Triangle getTriangle();
 	bool hasNext();
+	bool bufferEmpty();
 	~TriReader();
 private:
 	void fillBuffer();
@@ -72,6 +73,11 @@ inline bool TriReader::hasNext(){
 	return (n_served < n_triangles);
 }
 
+// true if the next getTriangle call has to read from the file
+inline bool TriReader::bufferEmpty(){
+	return (current_tri == buffersize);
+}
+
 inline void TriReader::fillBuffer(){
 	size_t readcount = glm::min(buffersize, n_triangles - n_read); // don't read more than there are
 	readTriangles(file,buffer[0],readcount); // read new triangles
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// The vertices of a mesh we're streaming, addressed by their index. While they fit in the memory limit, they're kept in memory.
+// Beyond that, they go to a temporary file in pages of VERTEX_PAGE_SIZE vertices, which are read back through a cache that
+// drops the least recently used page. Faces of scanned and exported meshes mostly use vertices which are close together in the
+// file, so few pages get read more than once.
+#define VERTEX_PAGE_SIZE 65536
+#define VERTEX_NO_SLOT ((size_t) -1)
+
+template <typename V>
+class VertexCache{
+public:
+	size_t n_vertices;
+	size_t page_reads; // pages read back from the temporary file
+
+	VertexCache(const string &filename, ::uint64_t memory_limit);
+	~VertexCache();
+
+	void add(const V &v);
+	void finish(); // after the last add
+	V get(size_t i);
+	bool onDisk() const { return file != NULL; }
+	// in memory: what the vertices take. On disk: what the page cache takes once it is full
+	::uint64_t memoryUsed() const { return static_cast<::uint64_t>(std::max(pages.size(), max_slots)) * VERTEX_PAGE_SIZE * sizeof(V); }
+
+private:
+	string filename;
+	::uint64_t memory_limit;
+	FILE* file;
+	vector<vector<V> > pages; // in memory: all pages. On disk: the cached pages (one per slot), and the page being added to
+	size_t max_slots;
+	vector<size_t> page_slot; // (on disk) the slot which holds a page, or VERTEX_NO_SLOT
+	vector<size_t> slot_page; // (on disk) the page in a slot
+	vector<::uint64_t> slot_used; // (on disk) when a slot was used last
+	::uint64_t clock;
+	size_t last_page; // the page we used last, and its slot
+	size_t last_slot;
+
+	void spill();
+	size_t loadPage(size_t page);
+
+	VertexCache(const VertexCache&);
+	VertexCache& operator=(const VertexCache&);
+};
+
+template <typename V>
+inline VertexCache<V>::VertexCache(const string &filename, ::uint64_t memory_limit) : n_vertices(0), page_reads(0), filename(filename),
+	memory_limit(memory_limit), file(NULL), max_slots(0), clock(0), last_page(VERTEX_NO_SLOT), last_slot(VERTEX_NO_SLOT){
+}
+
+template <typename V>
+inline VertexCache<V>::~VertexCache(){
+	if (file != NULL){
+		fclose(file);
+		remove(filename.c_str());
+	}
+}
+
+template <typename V>
+inline void VertexCache<V>::add(const V &v){
+	if (pages.empty() || pages.back().size() == VERTEX_PAGE_SIZE){
+		if (file != NULL){ // the page being added to is full: write it out
+			fwrite(&pages.back()[0], sizeof(V), VERTEX_PAGE_SIZE, file);
+			pages.back().clear();
+		}
+		else if (memoryUsed() + VERTEX_PAGE_SIZE * sizeof(V) > memory_limit && !pages.empty()){
+			spill();
+		}
+		if (pages.empty() || pages.back().size() == VERTEX_PAGE_SIZE){
+			pages.push_back(vector<V>());
+			pages.back().reserve(VERTEX_PAGE_SIZE);
+		}
+	}
+	pages.back().push_back(v);
+	n_vertices++;
+}
+
+// Move the full pages we have to the temporary file, and go on with one page in memory
+template <typename V>
+inline void VertexCache<V>::spill(){
+	file = fopen(filename.c_str(), "w+b");
+	if (file == NULL){
+		cout << "Could not create temporary vertex file " << filename << endl;
+		exit(0);
+	}
+	for (size_t p = 0; p < pages.size(); p++){
+		fwrite(&pages[p][0], sizeof(V), pages[p].size(), file);
+	}
+	pages.resize(1);
+	pages[0].clear();
+}
+
+template <typename V>
+inline void VertexCache<V>::finish(){
+	if (file == NULL){
+		return;
+	}
+	if (!pages.empty() && !pages.back().empty()){
+		fwrite(&pages.back()[0], sizeof(V), pages.back().size(), file);
+	}
+	fflush(file);
+	size_t n_pages = (n_vertices + VERTEX_PAGE_SIZE - 1) / VERTEX_PAGE_SIZE;
+	max_slots = static_cast<size_t>(memory_limit / (VERTEX_PAGE_SIZE * sizeof(V)));
+	if (max_slots < 2){ max_slots = 2; }
+	page_slot.assign(n_pages, VERTEX_NO_SLOT);
+	pages.clear();
+	slot_page.clear();
+	slot_used.clear();
+}
+
+// Read a page from the temporary file into a free slot, or into the least recently used one
+template <typename V>
+inline size_t VertexCache<V>::loadPage(size_t page){
+	size_t slot;
+	if (pages.size() < max_slots){
+		slot = pages.size();
+		pages.push_back(vector<V>(VERTEX_PAGE_SIZE));
+		slot_page.push_back(page);
+		slot_used.push_back(0);
+	}
+	else {
+		slot = 0;
+		for (size_t s = 1; s < slot_used.size(); s++){
+			if (slot_used[s] < slot_used[slot]){ slot = s; }
+		}
+		page_slot[slot_page[slot]] = VERTEX_NO_SLOT;
+		slot_page[slot] = page;
+	}
+	size_t count = std::min(static_cast<size_t>(VERTEX_PAGE_SIZE), n_vertices - page * VERTEX_PAGE_SIZE);
+#if defined(_WIN32) || defined(_WIN64)
+	_fseeki64(file, static_cast<__int64>(page) * VERTEX_PAGE_SIZE * sizeof(V), SEEK_SET);
+#else
+	fseeko(file, static_cast<off_t>(page) * VERTEX_PAGE_SIZE * sizeof(V), SEEK_SET);
+#endif
+	if (fread(&pages[slot][0], sizeof(V), count, file) != count){
+		cout << "Could not read back vertices from " << filename << endl;
+		exit(0);
+	}
+	page_slot[page] = slot;
+	page_reads++;
+	return slot;
+}
+
+template <typename V>
+inline V VertexCache<V>::get(size_t i){
+	size_t page = i / VERTEX_PAGE_SIZE;
+	if (file == NULL){
+		return pages[page][i % VERTEX_PAGE_SIZE];
+	}
+	if (page != last_page){
+		last_slot = page_slot[page];
+		if (last_slot == VERTEX_NO_SLOT){
+			last_slot = loadPage(page);
+		}
+		last_page = page;
+		slot_used[last_slot] = ++clock;
+	}
+	return pages[last_slot][i % VERTEX_PAGE_SIZE];
+}
@@ -7,17 +7,19 @@ using namespace std;
 
 // Various file operations, implemented in standard C
 
-// Copy files from src to dst using stdio
-inline void copy_file(const std::string& src, const std::string& dst){
+// Copy files from src to dst using stdio, return false if the copy is incomplete
+inline bool copy_file(const std::string& src, const std::string& dst){
 	char buf[8192];
     size_t size;
 	FILE* source = fopen(src.c_str(), "rb");
     FILE* dest = fopen(dst.c_str(), "wb");
-    while (size = fread(buf, 1, BUFSIZ, source)) {
-        fwrite(buf, 1, size, dest);
+    bool ok = (source != NULL && dest != NULL);
+    while (ok && (size = fread(buf, 1, sizeof(buf), source))) {
+        ok = (fwrite(buf, 1, size, dest) == size);
     }
-    fclose(source);
-    fclose(dest);
+    if (source != NULL) { ok = !ferror(source) && ok; fclose(source); }
+    if (dest != NULL) { ok = (fclose(dest) == 0) && ok; }
+    return ok;
 }
 
 // Check if a file exists using stdio
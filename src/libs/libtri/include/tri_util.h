@@ -53,3 +53,19 @@ struct Triangle {
 		v0_color(v0_color), v1_color(v1_color),v2_color(v2_color){}
 };
 #endif
+
+// create bounding cube around a bounding box (pad if the bbox is not a cube)
+inline AABox<glm::vec3> createMeshBBCube(const AABox<glm::vec3> &bbox){
+	glm::vec3 mesh_min = bbox.min;
+	glm::vec3 mesh_max = bbox.max;
+	glm::vec3 lengths = mesh_max-mesh_min;
+	float maxlength = glm::max(glm::max(lengths.x, lengths.y), lengths.z);
+	for(int i=0; i<3;i++){
+		float delta = maxlength - lengths[i];
+		if(delta != 0){
+			mesh_min[i] = mesh_min[i] - (delta / 2.0f);
+			mesh_max[i] = mesh_max[i] + (delta / 2.0f);
+		}
+	}
+	return AABox<glm::vec3>(mesh_min,mesh_max);
+}
@@ -0,0 +1,173 @@
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#endif
+
+#include <vector>
+#include <string>
+#include <random>
+#include "../svo_builder/OctreeReader.h"
+
+using namespace std;
+
+// Program version
+string version = "1.6.4";
+
+// Program parameters
+string filename = "";
+size_t n_queries = 1000000;
+size_t box_size = 16;
+bool verbose = false;
+
+void printInfo(){
+	cout << "-------------------------------------------------------------" << endl;
+	cout << "Octree Query Benchmark " << version << endl;
+	cout << "Jeroen Baert - jeroen.baert@cs.kuleuven.be - www.forceflow.be" << endl;
+	cout << "-------------------------------------------------------------" << endl << endl;
+}
+
+void printHelp(){
+	std::cout << "Example: octree_bench -f /home/jeroen/bunny.octree" << endl;
+	std::cout << "" << endl;
+	std::cout << "All available program options:" << endl;
+	std::cout << "" << endl;
+	std::cout << "-f <filename.octree>  Path to a .octree header file." << endl;
+	std::cout << "-n <queries>          Number of point queries to run. Default 1000000." << endl;
+	std::cout << "-b <size>             Side length of the box queries, in voxels. Default 16." << endl;
+	std::cout << "-v                    Be very verbose." << endl;
+	std::cout << "-h                    Print help and exit." << endl;
+}
+
+void printInvalid(){
+	std::cout << "Not enough or invalid arguments, please try again.\n" << endl;
+	printHelp();
+}
+
+void parseProgramParameters(int argc, char* argv[]){
+	if (argc < 3){ // not enough arguments
+		printInvalid(); exit(0);
+	}
+	for (int i = 1; i < argc; i++){
+		if (string(argv[i]) == "-f"){
+			filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-n" && i + 1 < argc){
+			int n = atoi(argv[i + 1]);
+			if (n < 1){
+				cout << "Requested number of queries is nonsensical. Use a value >= 1" << endl;
+				printInvalid(); exit(0);
+			}
+			n_queries = static_cast<size_t>(n);
+			i++;
+		}
+		else if (string(argv[i]) == "-b" && i + 1 < argc){
+			int b = atoi(argv[i + 1]);
+			if (b < 1){
+				cout << "Requested box size is nonsensical. Use a value >= 1" << endl;
+				printInvalid(); exit(0);
+			}
+			box_size = static_cast<size_t>(b);
+			i++;
+		}
+		else if (string(argv[i]) == "-v"){
+			verbose = true;
+		}
+		else if (string(argv[i]) == "-h"){
+			printHelp(); exit(0);
+		}
+		else {
+			printInvalid(); exit(0);
+		}
+	}
+}
+
+// Queries per second, for a timer in milliseconds
+double perSecond(size_t n, const Timer &t){
+	return (t.elapsed_time_milliseconds > 0) ? n / (t.elapsed_time_milliseconds / 1000.0) : 0.0;
+}
+
+int main(int argc, char *argv[]){
+	printInfo();
+	parseProgramParameters(argc, argv);
+
+	OctreeReader reader;
+	if (!reader.open(filename)){
+		cout << "Could not open octree " << filename << " - check that the .octree, .octreenodes and .octreedata files exist." << endl;
+		exit(0);
+	}
+	if (verbose){
+		reader.info.print();
+	}
+	uint_fast32_t gridlength = static_cast<uint_fast32_t>(reader.info.gridlength);
+	mt19937_64 rng(1337); // fixed seed, so runs are comparable
+	uniform_int_distribution<uint_fast32_t> coord(0, gridlength - 1);
+
+	// Full traversal: visit every voxel, keep some of them around for hit queries
+	vector<uint_fast64_t> filled;
+	filled.reserve(std::min(n_queries, (size_t) 1048576));
+	size_t n_voxels = 0;
+	OctreeCell all_min = reader.rootCell();
+	OctreeCell all_max = all_min;
+	all_max.x = all_max.y = all_max.z = gridlength - 1;
+	Timer traversal_timer;
+	traversal_timer.start();
+	reader.forEachVoxelInBox(all_min, all_max, [&](uint_fast32_t x, uint_fast32_t y, uint_fast32_t z, size_t){
+		n_voxels++;
+		if (filled.size() < filled.capacity()){
+			filled.push_back(libmorton::morton3D_64_encode(x, y, z));
+		}
+		else { // reservoir sampling
+			size_t r = static_cast<size_t>(rng() % n_voxels);
+			if (r < filled.size()){ filled[r] = libmorton::morton3D_64_encode(x, y, z); }
+		}
+	});
+	traversal_timer.stop();
+	cout << "Full traversal: " << n_voxels << " voxels in " << traversal_timer.elapsed_time_milliseconds << " ms ("
+		<< perSecond(n_voxels, traversal_timer) << " voxels/sec)" << endl;
+
+	// Random point queries (mostly empty space)
+	size_t hits = 0;
+	Timer point_timer;
+	point_timer.start();
+	for (size_t i = 0; i < n_queries; i++){
+		if (reader.findVoxel(coord(rng), coord(rng), coord(rng)) != OCTREE_NO_NODE){ hits++; }
+	}
+	point_timer.stop();
+	cout << "Random point queries: " << n_queries << " queries, " << hits << " hits, " << point_timer.elapsed_time_milliseconds << " ms ("
+		<< perSecond(n_queries, point_timer) << " queries/sec)" << endl;
+
+	// Point queries on filled voxels, fetching their payload
+	if (!filled.empty()){
+		hits = 0;
+		uniform_int_distribution<size_t> pick(0, filled.size() - 1);
+		VoxelData v;
+		Timer hit_timer;
+		hit_timer.start();
+		for (size_t i = 0; i < n_queries; i++){
+			size_t node = reader.findVoxel(filled[pick(rng)]);
+			if (node != OCTREE_NO_NODE && reader.getData(node, v)){ hits++; }
+		}
+		hit_timer.stop();
+		cout << "Filled voxel queries: " << n_queries << " queries, " << hits << " with data, " << hit_timer.elapsed_time_milliseconds << " ms ("
+			<< perSecond(n_queries, hit_timer) << " queries/sec)" << endl;
+	}
+
+	// Box queries
+	size_t n_box_queries = std::max(n_queries / 100, (size_t) 1);
+	uint_fast32_t side = static_cast<uint_fast32_t>(std::min(box_size, reader.info.gridlength));
+	uniform_int_distribution<uint_fast32_t> corner(0, gridlength - side);
+	size_t box_voxels = 0;
+	Timer box_timer;
+	box_timer.start();
+	for (size_t i = 0; i < n_box_queries; i++){
+		OctreeCell min, max;
+		min.x = corner(rng); min.y = corner(rng); min.z = corner(rng); min.size = 1;
+		max.x = min.x + side - 1; max.y = min.y + side - 1; max.z = min.z + side - 1; max.size = 1;
+		reader.forEachVoxelInBox(min, max, [&](uint_fast32_t, uint_fast32_t, uint_fast32_t, size_t){ box_voxels++; });
+	}
+	box_timer.stop();
+	cout << "Box queries (" << side << "^3): " << n_box_queries << " queries, " << box_voxels << " voxels found, " << box_timer.elapsed_time_milliseconds << " ms ("
+		<< perSecond(n_box_queries, box_timer) << " queries/sec)" << endl;
+
+	reader.close();
+}
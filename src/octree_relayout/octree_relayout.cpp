@@ -0,0 +1,157 @@
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#endif
+
+#include <string>
+#include "../svo_builder/OctreeReader.h"
+#include "../svo_builder/OctreeRelayout.h"
+
+using namespace std;
+
+// Program version
+string version = "1.6.4";
+
+// Program parameters
+string filename = "";
+string output_filename = "";
+OctreeNodeOrder node_order = ORDER_SUBTREE;
+int subtree_levels = RELAYOUT_SUBTREE_LEVELS;
+size_t page_size = OCTREE_PAGE_SIZE;
+bool async_io = false;
+bool verbose = false;
+
+void printInfo(){
+	cout << "-------------------------------------------------------------" << endl;
+	cout << "Octree Relayout " << version << endl;
+	cout << "Jeroen Baert - jeroen.baert@cs.kuleuven.be - www.forceflow.be" << endl;
+	cout << "-------------------------------------------------------------" << endl << endl;
+}
+
+void printHelp(){
+	std::cout << "Example: octree_relayout -f /home/jeroen/bunny.octree -o /home/jeroen/bunny_bfs.octree -order breadth_first" << endl;
+	std::cout << "" << endl;
+	std::cout << "All available program options:" << endl;
+	std::cout << "" << endl;
+	std::cout << "-f <filename.octree>  Path to a .octree header file." << endl;
+	std::cout << "-o <filename.octree>  Path to the .octree header file to write." << endl;
+	std::cout << "-order <option>       Node order (Options: subtree (default), breadth_first, paged)" << endl;
+	std::cout << "-levels <n>           Number of sibling group levels per subtree in subtree order. Default 3." << endl;
+	std::cout << "-pagesize <kb>        Size of a page in paged order, in Kb. Default 64." << endl;
+	std::cout << "-async                Write output files from a background thread" << endl;
+	std::cout << "-v                    Be very verbose." << endl;
+	std::cout << "-h                    Print help and exit." << endl;
+}
+
+void printInvalid(){
+	std::cout << "Not enough or invalid arguments, please try again.\n" << endl;
+	printHelp();
+}
+
+void parseProgramParameters(int argc, char* argv[]){
+	if (argc < 5){ // not enough arguments
+		printInvalid(); exit(0);
+	}
+	for (int i = 1; i < argc; i++){
+		if (string(argv[i]) == "-f"){
+			filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-o"){
+			output_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-order"){
+			string order_input = string(argv[i + 1]);
+			if (order_input == "subtree"){
+				node_order = ORDER_SUBTREE;
+			}
+			else if (order_input == "breadth_first"){
+				node_order = ORDER_BREADTH_FIRST;
+			}
+			else if (order_input == "paged"){
+				node_order = ORDER_PAGED;
+			}
+			else {
+				cout << "Unrecognized node order: " << order_input << ", so reverting to subtree order." << endl;
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-levels"){
+			subtree_levels = atoi(argv[i + 1]);
+			if (subtree_levels < 1){
+				cout << "Requested number of subtree levels is nonsensical. Use a value >= 1" << endl;
+				printInvalid(); exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-pagesize"){
+			int page_kb = atoi(argv[i + 1]);
+			if (page_kb < 1){
+				cout << "Requested page size is nonsensical. Use a value >= 1" << endl;
+				printInvalid(); exit(0);
+			}
+			page_size = static_cast<size_t>(page_kb) * 1024;
+			i++;
+		}
+		else if (string(argv[i]) == "-async"){
+			async_io = true;
+		}
+		else if (string(argv[i]) == "-v"){
+			verbose = true;
+		}
+		else if (string(argv[i]) == "-h"){
+			printHelp(); exit(0);
+		}
+		else {
+			printInvalid(); exit(0);
+		}
+	}
+	if (output_filename == "" || output_filename == filename){
+		cout << "I need an output filename which differs from the input filename." << endl;
+		printInvalid(); exit(0);
+	}
+}
+
+int main(int argc, char *argv[]){
+	printInfo();
+	parseProgramParameters(argc, argv);
+
+	OctreeReader reader;
+	if (!reader.open(filename)){
+		cout << "Could not open octree " << filename << " - check that the .octree, .octreenodes and .octreedata files exist." << endl;
+		exit(1);
+	}
+	if (verbose){
+		reader.info.print();
+	}
+	if (reader.info.dag){
+		cout << "This octree is a DAG (shared subtrees), which can't be reordered without expanding it into a tree." << endl;
+		exit(1);
+	}
+	if (node_order == ORDER_PAGED && reader.info.version < OCTREE_VERSION_COMPACT){
+		cout << "Paged octrees need compact nodes. Rebuild the octree with svo_builder -compact." << endl;
+		exit(1);
+	}
+
+	Timer relayout_timer;
+	relayout_timer.start();
+	cout << "Writing nodes in " << NODE_ORDER_NAMES[node_order] << " order ... "; cout.flush();
+	string output_base = output_filename.substr(0, output_filename.find_last_of("."));
+	bool written;
+	if (node_order == ORDER_PAGED){
+		OctreePager pager(reader, page_size, async_io);
+		written = pager.run(output_base);
+	}
+	else {
+		OctreeRelayout relayout(reader, node_order, subtree_levels, async_io);
+		written = relayout.run(output_base);
+	}
+	relayout_timer.stop();
+	if (!written){
+		cout << "Could not write " << output_filename << " completely." << endl;
+		exit(1);
+	}
+	cout << "done in " << relayout_timer.elapsed_time_milliseconds << " ms." << endl;
+
+	reader.close();
+}
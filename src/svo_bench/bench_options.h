@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include "../svo_builder/svo_builder_util.h"
+#include "mesh_generators.h"
+
+using namespace std;
+
+// Command line options shared by svo_bench and svo_verify
+
+// Split a comma-separated list
+inline vector<string> splitList(const string &list){
+	vector<string> items;
+	size_t start = 0;
+	while (start <= list.size()){
+		size_t end = list.find(',', start);
+		if (end == string::npos){ end = list.size(); }
+		if (end > start){ items.push_back(list.substr(start, end - start)); }
+		start = end + 1;
+	}
+	return items;
+}
+
+// Parse a -m list of test meshes (or all, which leaves the list empty). Returns false if a name is unknown.
+inline bool parseMeshList(const string &list, vector<BenchMesh> &meshes){
+	vector<string> names = splitList(list);
+	for (size_t k = 0; k < names.size(); k++){
+		if (names[k] == "all"){
+			meshes.clear();
+			break;
+		}
+		size_t m = 0;
+		while (m < BENCH_MESH_COUNT && names[k] != BENCH_MESH_NAMES[m]){ m++; }
+		if (m == BENCH_MESH_COUNT){
+			cout << "Unrecognized test mesh: " << names[k] << endl;
+			return false;
+		}
+		meshes.push_back(static_cast<BenchMesh>(m));
+	}
+	return true;
+}
+
+// Parse a -s list of gridsizes. Returns false if one isn't a power of 2.
+inline bool parseGridsizeList(const string &list, vector<size_t> &gridsizes){
+	vector<string> sizes = splitList(list);
+	for (size_t k = 0; k < sizes.size(); k++){
+		size_t gridsize = atoi(sizes[k].c_str());
+		if (!isPowerOf2((unsigned int) gridsize)){
+			cout << "Requested gridsize " << sizes[k] << " is not a power of 2" << endl;
+			return false;
+		}
+		gridsizes.push_back(gridsize);
+	}
+	return true;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "../libs/libtri/include/tri_util.h"
+#include "../libs/libtri/include/tri_tools.h"
+
+using namespace std;
+using namespace glm;
+
+// Procedural test meshes for svo_bench, written straight to .tri files (no TriMesh needed).
+// All meshes fit in the unit cube, which is also their .tri bounding box, so they are in the place tri_convert would move them to.
+// Random meshes use a fixed seed: the same options always give the same mesh.
+
+enum BenchMesh { MESH_SPHERE, MESH_TERRAIN, MESH_SOUP, MESH_SLIVERS, MESH_BOXES };
+static const char* const BENCH_MESH_NAMES[5] = { "sphere", "terrain", "soup", "slivers", "boxes" };
+#define BENCH_MESH_COUNT 5
+#define BENCH_MESH_SEED 1337
+
+// Add a triangle, with a face normal and its vertex positions as colors (in the payload version)
+inline void addTriangle(vector<Triangle> &triangles, const vec3 &v0, const vec3 &v1, const vec3 &v2){
+	Triangle t;
+	t.v0 = v0;
+	t.v1 = v1;
+	t.v2 = v2;
+#ifndef BINARY_VOXELIZATION
+	vec3 n = cross(v0 - v1, v1 - v2); // same as tri_convert's computeFaceNormal
+	float length = sqrt(dot(n, n));
+	t.normal = (length > 0.0f) ? n / length : vec3(0.0f, 0.0f, 1.0f);
+	t.v0_color = v0;
+	t.v1_color = v1;
+	t.v2_color = v2;
+#endif
+	triangles.push_back(t);
+}
+
+// A UV sphere around the center of the cube
+inline void generateSphere(size_t n_triangles, vector<Triangle> &triangles){
+	size_t stacks = std::max((size_t) 2, (size_t) sqrt(n_triangles / 4.0));
+	size_t slices = std::max((size_t) 3, n_triangles / (2 * stacks));
+	const float pi = 3.14159265f;
+	const vec3 center(0.5f, 0.5f, 0.5f);
+	const float radius = 0.45f;
+	for (size_t i = 0; i < stacks; i++){
+		float theta0 = pi * i / stacks, theta1 = pi * (i + 1) / stacks;
+		for (size_t j = 0; j < slices; j++){
+			float phi0 = 2.0f * pi * j / slices, phi1 = 2.0f * pi * (j + 1) / slices;
+			vec3 a = center + radius * vec3(sin(theta0) * cos(phi0), sin(theta0) * sin(phi0), cos(theta0));
+			vec3 b = center + radius * vec3(sin(theta1) * cos(phi0), sin(theta1) * sin(phi0), cos(theta1));
+			vec3 c = center + radius * vec3(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
+			vec3 d = center + radius * vec3(sin(theta0) * cos(phi1), sin(theta0) * sin(phi1), cos(theta0));
+			addTriangle(triangles, a, b, c);
+			addTriangle(triangles, a, c, d);
+		}
+	}
+}
+
+// A heightfield: rolling hills with some noise, like a scanned landscape
+inline void generateTerrain(size_t n_triangles, vector<Triangle> &triangles){
+	size_t cells = std::max((size_t) 1, (size_t) sqrt(n_triangles / 2.0));
+	mt19937 rng(BENCH_MESH_SEED);
+	uniform_real_distribution<float> noise(-0.01f, 0.01f);
+	vector<float> heights((cells + 1) * (cells + 1));
+	for (size_t y = 0; y <= cells; y++){
+		for (size_t x = 0; x <= cells; x++){
+			float u = (float) x / cells, v = (float) y / cells;
+			heights[y * (cells + 1) + x] = 0.4f + 0.15f * sin(6.0f * u) * cos(5.0f * v) + 0.05f * sin(23.0f * u + 17.0f * v) + noise(rng);
+		}
+	}
+	for (size_t y = 0; y < cells; y++){
+		for (size_t x = 0; x < cells; x++){
+			float u0 = (float) x / cells, u1 = (float) (x + 1) / cells, v0 = (float) y / cells, v1 = (float) (y + 1) / cells;
+			vec3 a(u0, v0, heights[y * (cells + 1) + x]);
+			vec3 b(u1, v0, heights[y * (cells + 1) + x + 1]);
+			vec3 c(u1, v1, heights[(y + 1) * (cells + 1) + x + 1]);
+			vec3 d(u0, v1, heights[(y + 1) * (cells + 1) + x]);
+			addTriangle(triangles, a, b, c);
+			addTriangle(triangles, a, c, d);
+		}
+	}
+}
+
+// Small triangles with random positions and orientations, all over the cube
+inline void generateSoup(size_t n_triangles, vector<Triangle> &triangles){
+	mt19937 rng(BENCH_MESH_SEED);
+	uniform_real_distribution<float> position(0.05f, 0.95f);
+	uniform_real_distribution<float> offset(-0.02f, 0.02f);
+	for (size_t i = 0; i < n_triangles; i++){
+		vec3 p(position(rng), position(rng), position(rng));
+		addTriangle(triangles, p, p + vec3(offset(rng), offset(rng), offset(rng)), p + vec3(offset(rng), offset(rng), offset(rng)));
+	}
+}
+
+// Long, thin triangles along the axes, which cross a large part of the cube (and often several partitions),
+// like the triangles of extruded or lathed CAD parts. A triangle is tested against every voxel in its bounding box,
+// so slivers cost a lot of tests per voxel they fill.
+inline void generateSlivers(size_t n_triangles, vector<Triangle> &triangles){
+	mt19937 rng(BENCH_MESH_SEED);
+	uniform_real_distribution<float> position(0.05f, 0.95f);
+	uniform_real_distribution<float> length(0.1f, 0.4f);
+	uniform_real_distribution<float> width(-0.002f, 0.002f);
+	for (size_t i = 0; i < n_triangles; i++){
+		vec3 a(position(rng), position(rng), position(rng));
+		int axis = static_cast<int>(i % 3);
+		vec3 b = a + vec3(width(rng), width(rng), width(rng));
+		b[axis] = std::min(a[axis] + length(rng), 0.99f);
+		vec3 c = (a + b) * 0.5f + vec3(width(rng), width(rng), width(rng));
+		addTriangle(triangles, a, b, c);
+	}
+}
+
+// Axis-aligned boxes of all sizes, packed close together, like a CAD model of a machine or a building
+inline void generateBoxes(size_t n_triangles, vector<Triangle> &triangles){
+	mt19937 rng(BENCH_MESH_SEED);
+	uniform_real_distribution<float> position(0.05f, 0.95f);
+	uniform_real_distribution<float> size(-2.5f, -1.0f); // log10 of the side length
+	size_t n_boxes = std::max((size_t) 1, n_triangles / 12);
+	for (size_t i = 0; i < n_boxes; i++){
+		vec3 lo(position(rng), position(rng), position(rng));
+		vec3 hi = lo + vec3(pow(10.0f, size(rng)), pow(10.0f, size(rng)), pow(10.0f, size(rng)));
+		hi = glm::min(hi, vec3(0.95f, 0.95f, 0.95f));
+		vec3 c[8];
+		for (int k = 0; k < 8; k++){
+			c[k] = vec3((k & 1) ? hi.x : lo.x, (k & 2) ? hi.y : lo.y, (k & 4) ? hi.z : lo.z);
+		}
+		static const int faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+		for (int f = 0; f < 6; f++){
+			addTriangle(triangles, c[faces[f][0]], c[faces[f][1]], c[faces[f][2]]);
+			addTriangle(triangles, c[faces[f][0]], c[faces[f][2]], c[faces[f][3]]);
+		}
+	}
+}
+
+// Generate one of the meshes, with about n_triangles triangles
+inline void generateMesh(BenchMesh mesh, size_t n_triangles, vector<Triangle> &triangles){
+	triangles.clear();
+	triangles.reserve(n_triangles + 16);
+	switch (mesh){
+	case MESH_SPHERE: generateSphere(n_triangles, triangles); break;
+	case MESH_TERRAIN: generateTerrain(n_triangles, triangles); break;
+	case MESH_SOUP: generateSoup(n_triangles, triangles); break;
+	case MESH_SLIVERS: generateSlivers(n_triangles, triangles); break;
+	case MESH_BOXES: generateBoxes(n_triangles, triangles); break;
+	}
+}
+
+// Write triangles as base_filename.tri / .tridata, the way tri_convert does
+inline TriInfo writeTriFile(const string &base_filename, vector<Triangle> &triangles){
+	FILE* tri_out = fopen((base_filename + string(".tridata")).c_str(), "wb");
+	if (!triangles.empty()){
+		writeTriangles(tri_out, triangles[0], triangles.size());
+	}
+	fclose(tri_out);
+
+	TriInfo tri_info;
+	tri_info.base_filename = base_filename;
+	tri_info.version = 1;
+	tri_info.mesh_bbox = AABox<vec3>(vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 1.0f, 1.0f));
+	tri_info.n_triangles = triangles.size();
+#ifdef BINARY_VOXELIZATION
+	tri_info.geometry_only = 1;
+#else
+	tri_info.geometry_only = 0;
+#endif
+	writeTriHeader(base_filename + string(".tri"), tri_info);
+	return tri_info;
+}
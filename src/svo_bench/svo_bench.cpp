@@ -0,0 +1,254 @@
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#endif
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+#include "../svo_builder/globals.h"
+#include "../svo_builder/partitioner.h"
+#include "../svo_builder/voxelizer.h"
+#include "../svo_builder/OctreeBuilder.h"
+#include "../svo_builder/PartitionVoxels.h"
+#include "mesh_generators.h"
+#include "bench_options.h"
+
+using namespace std;
+
+// Program version
+string version = "1.6.4";
+
+// Program parameters
+vector<BenchMesh> meshes;
+vector<size_t> gridsizes;
+size_t n_triangles = 100000;
+size_t n_partitions = 8;
+float sparseness_limit = 0.10f;
+string output_base = "svo_bench";
+bool keep_files = false;
+bool verbose = false;
+
+void printInfo(){
+	cout << "-------------------------------------------------------------" << endl;
+#ifdef BINARY_VOXELIZATION
+	cout << "SVO Builder Benchmark " << version << " - Geometry only version" << endl;
+#else
+	cout << "SVO Builder Benchmark " << version << endl;
+#endif
+	cout << "Jeroen Baert - jeroen.baert@cs.kuleuven.be - www.forceflow.be" << endl;
+	cout << "-------------------------------------------------------------" << endl << endl;
+}
+
+void printHelp(){
+	std::cout << "Example: svo_bench -m sphere,terrain -s 256,512 -n 200000" << endl;
+	std::cout << "" << endl;
+	std::cout << "All available program options:" << endl;
+	std::cout << "" << endl;
+	std::cout << "-m <meshes>           Comma-separated test meshes (sphere, terrain, soup, slivers, boxes) or all. Default all." << endl;
+	std::cout << "-s <gridsizes>        Comma-separated voxel gridsizes, powers of 2. Default 128,256,512." << endl;
+	std::cout << "-n <triangles>        Number of triangles per mesh (approximately). Default 100000." << endl;
+	std::cout << "-p <partitions>       Number of partitions, a power of 8. Default 8." << endl;
+	std::cout << "-d <percentage>       Sparseness optimization limit, like svo_builder -d. Default 10." << endl;
+	std::cout << "-o <base>             Base filename for the generated .tri and output files. Default svo_bench." << endl;
+	std::cout << "-keep                 Keep the generated .tri files and octrees." << endl;
+	std::cout << "-v                    Be very verbose." << endl;
+	std::cout << "-h                    Print help and exit." << endl;
+}
+
+void printInvalid(){
+	std::cout << "Not enough or invalid arguments, please try again.\n" << endl;
+	printHelp();
+}
+
+void parseProgramParameters(int argc, char* argv[]){
+	for (int i = 1; i < argc; i++){
+		if (string(argv[i]) == "-m" && i + 1 < argc){
+			if (!parseMeshList(argv[i + 1], meshes)){
+				printInvalid(); exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-s" && i + 1 < argc){
+			if (!parseGridsizeList(argv[i + 1], gridsizes)){
+				printInvalid(); exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-n" && i + 1 < argc){
+			int n = atoi(argv[i + 1]);
+			if (n < 1){
+				cout << "Requested number of triangles is nonsensical. Use a value >= 1" << endl;
+				printInvalid(); exit(0);
+			}
+			n_triangles = static_cast<size_t>(n);
+			i++;
+		}
+		else if (string(argv[i]) == "-p" && i + 1 < argc){
+			int p = atoi(argv[i + 1]);
+			size_t power = 1;
+			while (power < (size_t) std::max(p, 1)){ power *= 8; }
+			if (p < 1 || power != (size_t) p){
+				cout << "Requested number of partitions is not a power of 8" << endl;
+				printInvalid(); exit(0);
+			}
+			n_partitions = power;
+			i++;
+		}
+		else if (string(argv[i]) == "-d" && i + 1 < argc){
+			int percent = atoi(argv[i + 1]);
+			if (percent < 0){
+				cout << "Requested data memory limit is nonsensical. Use a value > 0" << endl;
+				printInvalid(); exit(0);
+			}
+			sparseness_limit = percent / 100.0f;
+			i++;
+		}
+		else if (string(argv[i]) == "-o" && i + 1 < argc){
+			output_base = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-keep"){
+			keep_files = true;
+		}
+		else if (string(argv[i]) == "-v"){
+			verbose = true;
+		}
+		else if (string(argv[i]) == "-h"){
+			printHelp(); exit(0);
+		}
+		else {
+			printInvalid(); exit(0);
+		}
+	}
+	if (meshes.empty()){
+		for (int m = 0; m < BENCH_MESH_COUNT; m++){ meshes.push_back(static_cast<BenchMesh>(m)); }
+	}
+	if (gridsizes.empty()){
+		gridsizes.push_back(128);
+		gridsizes.push_back(256);
+		gridsizes.push_back(512);
+	}
+}
+
+// Items per second, for a timer in milliseconds
+double perSecond(size_t n, const Timer &t){
+	return (t.elapsed_time_milliseconds > 0) ? n / (t.elapsed_time_milliseconds / 1000.0) : 0.0;
+}
+
+// One line of the results table (a throughput of "-" means the stage doesn't handle triangles / voxels)
+void printResult(const string &mesh, size_t gridsize, const string &stage, const Timer &t, size_t triangles, size_t voxels){
+	char line[256], triangle_rate[32], voxel_rate[32];
+	sprintf(triangle_rate, triangles ? "%.0f" : "-", perSecond(triangles, t));
+	sprintf(voxel_rate, voxels ? "%.0f" : "-", perSecond(voxels, t));
+	sprintf(line, "%-8s %6u  %-10s %12.3f %14s %14s", mesh.c_str(), (unsigned int) gridsize, stage.c_str(), t.elapsed_time_milliseconds, triangle_rate, voxel_rate);
+	cout << line << endl;
+}
+
+// Remove the octree files the builder wrote
+void removeOctreeFiles(const string &base_filename){
+	remove((base_filename + string(".octree")).c_str());
+	remove((base_filename + string(".octreenodes")).c_str());
+	remove((base_filename + string(".octreedata")).c_str());
+}
+
+// Run partitioning, voxelization and SVO building for one mesh and gridsize, and print the throughput of every stage
+void benchGridsize(const string &mesh, const TriInfo &tri_info, size_t gridsize){
+	size_t parts = std::min(n_partitions, gridsize * gridsize * gridsize); // at least one voxel per partition
+	Timer total_timer, partition_timer, voxelize_timer, build_timer;
+	total_timer.start();
+
+	partition_timer.start();
+	TripInfo trip_info = partition(tri_info, parts, gridsize);
+	partition_timer.stop();
+
+	float unitlength = (trip_info.mesh_bbox.max[0] - trip_info.mesh_bbox.min[0]) / (float) trip_info.gridsize;
+	::uint64_t morton_part = (trip_info.gridsize * trip_info.gridsize * trip_info.gridsize) / trip_info.n_partitions;
+	vector<char> voxels((size_t) morton_part);
+	VoxelList data;
+	size_t nfilled = 0;
+	size_t triangles_read = 0;
+	size_t dense_partitions = 0;
+
+	OctreeBuilder builder(trip_info.base_filename, trip_info.gridsize, false);
+	for (size_t i = 0; i < trip_info.n_partitions; i++){
+		if (trip_info.part_tricounts[i] == 0){ continue; }
+		::uint64_t start = i * morton_part;
+		::uint64_t end = (i + 1) * morton_part;
+		bool use_data = true;
+		voxelize_timer.start();
+		string part_data_filename = trip_info.base_filename + string("_") + val_to_string(i) + string(".tripdata");
+		TriReader reader(part_data_filename, trip_info.part_tricounts[i], std::min(trip_info.part_tricounts[i], (size_t) 8192));
+		voxelize_schwarz_method(reader, start, end, unitlength, &voxels[0], data, sparseness_limit, use_data, nfilled, NULL, 0, trip_info.gridsize);
+		voxelize_timer.stop();
+		triangles_read += trip_info.part_tricounts[i];
+		if (!use_data){ dense_partitions++; }
+
+		build_timer.start();
+#ifdef BINARY_VOXELIZATION
+		if (!use_data){
+			addPartitionGrid(builder, &voxels[0], start, morton_part);
+		}
+		else {
+			sortPartitionVoxels(data);
+			addPartitionVoxels(builder, data);
+		}
+#else
+		sortPartitionVoxels(data);
+		addPartitionVoxels(builder, data);
+#endif
+		build_timer.stop();
+	}
+	build_timer.start();
+	if (!builder.finalizeTree()){
+		cout << "Could not write the octree of " << mesh << " at " << gridsize << endl;
+		exit(1);
+	}
+	build_timer.stop();
+	total_timer.stop();
+
+	if (verbose){
+		cout << "  " << mesh << " at " << gridsize << ": " << trip_info.n_partitions << " partitions, " << triangles_read << " triangles read ("
+			<< triangles_read - tri_info.n_triangles << " duplicates), " << nfilled << " voxels, " << dense_partitions << " partitions took the dense path" << endl;
+	}
+	printResult(mesh, gridsize, "partition", partition_timer, tri_info.n_triangles, 0);
+	printResult(mesh, gridsize, "voxelize", voxelize_timer, triangles_read, nfilled);
+	printResult(mesh, gridsize, "build", build_timer, 0, nfilled);
+	printResult(mesh, gridsize, "total", total_timer, tri_info.n_triangles, nfilled);
+
+	removeTripFiles(trip_info);
+	if (!keep_files){
+		removeOctreeFiles(trip_info.base_filename);
+	}
+}
+
+int main(int argc, char *argv[]){
+	printInfo();
+	parseProgramParameters(argc, argv);
+
+	char header[256];
+	sprintf(header, "%-8s %6s  %-10s %12s %14s %14s", "mesh", "grid", "stage", "time (ms)", "triangles/s", "voxels/s");
+	cout << header << endl;
+	for (size_t m = 0; m < meshes.size(); m++){
+		string mesh = BENCH_MESH_NAMES[meshes[m]];
+		string base_filename = output_base + string("_") + mesh;
+		vector<Triangle> triangles;
+		Timer generate_timer;
+		generate_timer.start();
+		generateMesh(meshes[m], n_triangles, triangles);
+		TriInfo tri_info = writeTriFile(base_filename, triangles);
+		generate_timer.stop();
+		if (verbose){
+			cout << "  generated " << base_filename << ".tri: " << tri_info.n_triangles << " triangles in " << generate_timer.elapsed_time_milliseconds << " ms" << endl;
+		}
+		triangles = vector<Triangle>(); // free the mesh, the benchmark reads it from disk
+
+		for (size_t g = 0; g < gridsizes.size(); g++){
+			benchGridsize(mesh, tri_info, gridsizes[g]);
+		}
+		if (!keep_files){
+			remove((base_filename + string(".tri")).c_str());
+			remove((base_filename + string(".tridata")).c_str());
+		}
+	}
+}
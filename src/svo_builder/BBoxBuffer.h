@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include "globals.h"
 #include "intersection.h"
+#include "MemoryTracker.h"
 #include "../libs/libtri/include/tri_tools.h"
 
 using namespace std;
@@ -17,27 +18,28 @@ public:
 	string filename; // filename of the file we're writing to
 	AABox<vec3> bbox_world; // bounding box of the morton grid this buffer represents, in world coords
 	size_t n_triangles; // number of triangles already in
+	size_t n_duplicates; // number of those which also went to another buffer (counted by the partitioner)
 
 	// Buffered
-	vector<Triangle> triangle_buffer; // triangle buffer
+	vector<Triangle, TrackingAllocator<Triangle, MEM_PARTITION_BUFFERS> > triangle_buffer; // triangle buffer
 	size_t buffer_max; // maximum of tris we buffer before writing to disk
 
 	BBoxBuffer();
 	BBoxBuffer(const std::string &filename, AABox<vec3> bbox_world, size_t buffer_max);
 	~BBoxBuffer();
 
-	void processTriangle(Triangle &t, const AABox<vec3> &bbox);
+	bool processTriangle(Triangle &t, const AABox<vec3> &bbox);
 
 private:
 	void flush();
 };
 
 // default constructor
-inline BBoxBuffer::BBoxBuffer() : bbox_world(AABox<vec3>(vec3(),vec3(1,1,1))), n_triangles(0), buffer_max(1024), file(NULL), filename(""){
+inline BBoxBuffer::BBoxBuffer() : bbox_world(AABox<vec3>(vec3(),vec3(1,1,1))), n_triangles(0), n_duplicates(0), buffer_max(1024), file(NULL), filename(""){
 }
 
 // full constructor
-inline BBoxBuffer::BBoxBuffer(const std::string &filename, AABox<vec3> bbox_world, size_t buffer_max): bbox_world(bbox_world), n_triangles(0), buffer_max(buffer_max), file(NULL), filename(filename) {
+inline BBoxBuffer::BBoxBuffer(const std::string &filename, AABox<vec3> bbox_world, size_t buffer_max): bbox_world(bbox_world), n_triangles(0), n_duplicates(0), buffer_max(buffer_max), file(NULL), filename(filename) {
 	triangle_buffer.reserve(buffer_max); // prepare buffer
 	file = NULL;
 }
@@ -60,19 +62,17 @@ inline void BBoxBuffer::flush(){
 	if(file == NULL){ // if the file is not open yet, we open it.
 		file = fopen(filename.c_str(), "wb");
 	}
-	part_algo_timer.stop(); part_io_out_timer.start(); // TIMING
+	PROFILE_SCOPE("writing triangles");
 	writeTriangles(file,triangle_buffer[0],triangle_buffer.size());
-	part_io_out_timer.stop(); part_algo_timer.start();  // TIMING
 	triangle_buffer.clear();
 }
 
-// Check triangle against buffer bounding box and add it to buffer if it is in it.
-inline void BBoxBuffer::processTriangle(Triangle &t, const AABox<vec3> &bbox){
+// Check triangle against buffer bounding box and add it to buffer if it is in it. Returns whether it was added.
+inline bool BBoxBuffer::processTriangle(Triangle &t, const AABox<vec3> &bbox){
 	if(intersectBoxBox(bbox, bbox_world)){ // triangle in this partition
 		if(buffer_max == 0){ // no buffering, just write triangle
-			part_algo_timer.stop(); part_io_out_timer.start(); // TIMING
+			PROFILE_SCOPE("writing triangles");
 			writeTriangle(file, t);
-			part_io_out_timer.stop(); part_algo_timer.start();  // TIMING
 		} else { // add to buffer
 			triangle_buffer.push_back(t);
 			if(triangle_buffer.size() >= buffer_max) { // buffer full, writeout to files
@@ -80,5 +80,7 @@ inline void BBoxBuffer::processTriangle(Triangle &t, const AABox<vec3> &bbox){
 			}
 		}
 		n_triangles++;
+		return true;
 	}
+	return false;
 }
\ No newline at end of file
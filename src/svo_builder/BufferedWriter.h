@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "globals.h"
+#include "MemoryTracker.h"
+
+using namespace std;
+
+// A BufferedWriter collects fixed-size records (octree nodes, voxel data) in a large user-space buffer
+// and writes them to disk in big blocks, instead of doing one fwrite per record.
+// In async mode, full buffers are handed to a background thread while the builder keeps filling a second buffer.
+// A failed write is remembered, and reported by close(): callers must not trust (or move into place) a file for which close() returned false.
+class BufferedWriter{
+public:
+	FILE* file; // the file we'll write our records to
+	string filename; // filename of the file we're writing to
+	size_t record_size; // size of one record, in bytes
+	size_t n_records; // number of records written so far (this is also the index of the next record)
+	bool async; // flush full buffers from a background thread
+
+	BufferedWriter(const std::string &filename, size_t record_size, size_t buffer_bytes, bool async);
+	~BufferedWriter();
+
+	size_t write(const void* record);
+	bool close();
+
+private:
+	vector<char, TrackingAllocator<char, MEM_OUTPUT_BUFFERS> > buffer; // buffer we're currently filling
+	vector<char, TrackingAllocator<char, MEM_OUTPUT_BUFFERS> > flush_buffer; // buffer being written out by the background thread
+	size_t buffer_pos; // current write position in buffer, in bytes
+	thread flusher;
+	atomic<bool> failed; // a write (or closing the file) failed, set from the background thread too
+
+	BufferedWriter(const BufferedWriter&);
+	BufferedWriter& operator=(const BufferedWriter&);
+	void flush();
+	void waitForFlush();
+};
+
+// full constructor
+inline BufferedWriter::BufferedWriter(const std::string &filename, size_t record_size, size_t buffer_bytes, bool async) :
+file(NULL), filename(filename), record_size(record_size), n_records(0), async(async), buffer_pos(0), failed(false){
+	file = fopen(filename.c_str(), "wb");
+	if (file == NULL){
+		cout << "Error: could not open " << filename << " for writing." << endl;
+		exit(1);
+	}
+	setvbuf(file, NULL, _IONBF, 0); // we do our own buffering: big blocks go straight to the OS
+	// make buffer hold a whole number of records (and at least one)
+	size_t buffer_records = std::max(buffer_bytes / record_size, (size_t) 1);
+	buffer.resize(buffer_records * record_size);
+	if (async){
+		flush_buffer.resize(buffer.size());
+	}
+}
+
+// destructor
+inline BufferedWriter::~BufferedWriter(){
+	close();
+}
+
+// Add a record to the buffer, return its index in the output file
+inline size_t BufferedWriter::write(const void* record){
+	if (buffer_pos == buffer.size()){ // buffer full, writeout to file
+		flush();
+	}
+	memcpy(&buffer[buffer_pos], record, record_size);
+	buffer_pos += record_size;
+	n_records++;
+	return n_records - 1;
+}
+
+// Flush remaining records and close the file. Returns false if any of the records didn't make it to disk.
+inline bool BufferedWriter::close(){
+	if (file == NULL){
+		return !failed; // already closed
+	}
+	flush();
+	waitForFlush();
+	if (fclose(file) != 0){
+		failed = true;
+	}
+	file = NULL;
+	if (failed){
+		cout << "Error: could not write " << filename << " (disk full?)" << endl;
+	}
+	return !failed;
+}
+
+// Wait for the background thread to finish writing the previous buffer
+inline void BufferedWriter::waitForFlush(){
+	if (flusher.joinable()){
+		PROFILE_SCOPE("waiting for output");
+		flusher.join();
+	}
+}
+
+// Write the buffer to disk
+inline void BufferedWriter::flush(){
+	if (buffer_pos == 0){
+		return; // nothing to flush here.
+	}
+	if (async){
+		waitForFlush(); // the other buffer has to be on disk before we can reuse it
+		buffer.swap(flush_buffer);
+		FILE* f = file;
+		const char* data = &flush_buffer[0];
+		size_t n_bytes = buffer_pos;
+		atomic<bool>* write_failed = &failed;
+		flusher = thread([f, data, n_bytes, write_failed](){
+			if (fwrite(data, 1, n_bytes, f) != n_bytes){ *write_failed = true; }
+		});
+	}
+	else {
+		PROFILE_SCOPE("writing output");
+		if (fwrite(&buffer[0], 1, buffer_pos, file) != buffer_pos){
+			failed = true;
+		}
+	}
+	buffer_pos = 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "globals.h"
+#include "voxelizer.h"
+#include "OctreeBuilder.h"
+
+using namespace std;
+
+// Builds the octree of a coarser grid from the voxels of the finest grid, so every gridsize doesn't need its own partitioning
+// and voxelization. A coarse voxel is filled if one of the fine voxels inside it is: its morton code is the fine morton code,
+// shifted right by 3 bits for every level the grids are apart. The fine voxels come in morton order, so all fine voxels of a
+// coarse voxel come one after the other (also across partitions), and the coarse voxels come out in morton order too.
+// The payload of a coarse voxel is the average of the payloads of its fine voxels, like -levels makes them.
+// Coarse voxels go to the builder one at a time: its bulk path needs all voxels of a block in one call.
+class CoarseGridBuilder{
+public:
+	size_t gridsize;
+	size_t n_voxels; // coarse voxels we made so far
+	OctreeBuilder* builder;
+
+	// Takes ownership of the builder, which builds an octree of gridsize (levels below the finest grid)
+	CoarseGridBuilder(OctreeBuilder* builder, size_t gridsize, int levels);
+	~CoarseGridBuilder();
+
+	// Fine voxels, sorted, which follow the ones we got before
+	void addVoxels(const VoxelList &data);
+#ifdef BINARY_VOXELIZATION
+	// Fine voxels of a voxel grid of n voxels, from morton code start
+	void addGrid(const char* voxels, ::uint64_t start, ::uint64_t n);
+#endif
+	// Add the last coarse voxel and write the octree
+	bool finalizeTree();
+
+private:
+	int shift;
+	bool has_pending; // the coarse voxel we're adding fine voxels to
+#ifdef BINARY_VOXELIZATION
+	::uint64_t pending;
+#else
+	VoxelData pending; // sums of the payloads of its fine voxels
+	float pending_count;
+#endif
+
+#ifdef BINARY_VOXELIZATION
+	void add(::uint64_t fine_morton);
+#else
+	void add(const VoxelData &fine);
+#endif
+	void flushPending();
+
+	CoarseGridBuilder(const CoarseGridBuilder&);
+	CoarseGridBuilder& operator=(const CoarseGridBuilder&);
+};
+
+inline CoarseGridBuilder::CoarseGridBuilder(OctreeBuilder* builder, size_t gridsize, int levels) : gridsize(gridsize), n_voxels(0), builder(builder),
+	shift(3 * levels), has_pending(false){
+#ifndef BINARY_VOXELIZATION
+	pending_count = 0.0f;
+#endif
+}
+
+inline CoarseGridBuilder::~CoarseGridBuilder(){
+	delete builder;
+}
+
+inline void CoarseGridBuilder::flushPending(){
+	if (!has_pending){
+		return;
+	}
+#ifdef BINARY_VOXELIZATION
+	builder->addVoxel(pending);
+#else
+	VoxelData d = pending;
+	d.color = pending.color / pending_count;
+	if (glm::length(pending.normal) > 0.0f){
+		d.normal = normalize(pending.normal / pending_count);
+	}
+	builder->addVoxel(d);
+#endif
+	has_pending = false;
+	n_voxels++;
+}
+
+#ifdef BINARY_VOXELIZATION
+inline void CoarseGridBuilder::add(::uint64_t fine_morton){
+	::uint64_t morton = fine_morton >> shift;
+	if (has_pending && pending == morton){
+		return;
+	}
+	flushPending();
+	pending = morton;
+	has_pending = true;
+}
+
+inline void CoarseGridBuilder::addGrid(const char* voxels, ::uint64_t start, ::uint64_t n){
+	for (::uint64_t j = 0; j < n; j++){
+		if (voxels[j] != EMPTY_VOXEL){
+			add(start + j);
+		}
+	}
+}
+#else
+inline void CoarseGridBuilder::add(const VoxelData &fine){
+	::uint64_t morton = fine.morton >> shift;
+	if (has_pending && pending.morton == morton){
+		pending.color += fine.color;
+		pending.normal += fine.normal;
+		pending_count++;
+		return;
+	}
+	flushPending();
+	pending = VoxelData(morton, fine.normal, fine.color);
+	pending_count = 1.0f;
+	has_pending = true;
+}
+#endif
+
+inline void CoarseGridBuilder::addVoxels(const VoxelList &data){
+	for (size_t i = 0; i < data.size(); i++){
+		add(data[i]);
+	}
+}
+
+inline bool CoarseGridBuilder::finalizeTree(){
+	flushPending();
+	return builder->finalizeTree();
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <iostream>
+#include "RunReport.h"
+
+using namespace std;
+
+// Memory accounting: the big structures of the builder add what they allocate to a MemoryUse, so we know what we
+// spend our memory limit (-l) on. Containers do this with a TrackingAllocator, arrays we allocate ourselves with
+// MemoryCharge. At the end of every stage, we note the peak of the tracked memory and the peak RSS of the process.
+
+enum MemoryUse { MEM_VOXEL_GRID, MEM_VOXEL_DATA, MEM_PARTITION_BUFFERS, MEM_TRIANGLE_READERS, MEM_OUTPUT_BUFFERS, MEM_DEDUP_TABLES, MEM_MESH_INPUT };
+#define MEMORY_USE_COUNT 7
+static const char* const MEMORY_USE_NAMES[MEMORY_USE_COUNT] = { "voxel grids", "voxel data", "partition buffers", "triangle readers", "output buffers", "dedup tables", "mesh input" };
+
+// Tracked and process memory at the end of a stage
+struct MemoryStage{
+	string name;
+	::uint64_t tracked_peak; // peak of all tracked memory during the stage
+	::uint64_t peak_rss; // peak memory use of the process so far
+};
+
+class MemoryTracker{
+public:
+	static MemoryTracker& instance(){
+		static MemoryTracker tracker;
+		return tracker;
+	}
+
+	inline void add(MemoryUse use, ::uint64_t bytes){
+		::uint64_t now = current[use].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		raise(peak[use], now);
+		raise(stage_peak, total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	}
+
+	inline void remove(MemoryUse use, ::uint64_t bytes){
+		current[use].fetch_sub(bytes, std::memory_order_relaxed);
+		total.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	::uint64_t used(MemoryUse use) const { return current[use].load(std::memory_order_relaxed); }
+	::uint64_t used() const { return total.load(std::memory_order_relaxed); }
+
+	// Close a stage: note its peaks, and start the next stage from what's in use now
+	void endStage(const string &name){
+		std::lock_guard<std::mutex> lock(mutex);
+		MemoryStage s;
+		s.name = name;
+		s.tracked_peak = stage_peak.exchange(used(), std::memory_order_relaxed);
+		s.peak_rss = peakMemoryBytes();
+		stages.push_back(s);
+	}
+
+	// Print the peak of every structure, and the peaks of every stage
+	void print(){
+		std::lock_guard<std::mutex> lock(mutex);
+		char line[256];
+		sprintf(line, "%-40s %12s %12s", "MEMORY (peaks)", "tracked MB", "process MB");
+		cout << line << endl;
+		for (int u = 0; u < MEMORY_USE_COUNT; u++){
+			sprintf(line, "%-40s %12.3f", MEMORY_USE_NAMES[u], peak[u].load() / 1048576.0);
+			cout << line << endl;
+		}
+		for (size_t i = 0; i < stages.size(); i++){
+			sprintf(line, "%-40s %12.3f %12.3f", (string("stage: ") + stages[i].name).c_str(), stages[i].tracked_peak / 1048576.0, stages[i].peak_rss / 1048576.0);
+			cout << line << endl;
+		}
+	}
+
+private:
+	std::atomic< ::uint64_t> current[MEMORY_USE_COUNT];
+	std::atomic< ::uint64_t> peak[MEMORY_USE_COUNT];
+	std::atomic< ::uint64_t> total;
+	std::atomic< ::uint64_t> stage_peak;
+	vector<MemoryStage> stages;
+	std::mutex mutex;
+
+	MemoryTracker() : total(0), stage_peak(0){
+		for (int u = 0; u < MEMORY_USE_COUNT; u++){
+			current[u] = 0;
+			peak[u] = 0;
+		}
+	}
+	MemoryTracker(const MemoryTracker&);
+	MemoryTracker& operator=(const MemoryTracker&);
+
+	static inline void raise(std::atomic< ::uint64_t> &peak, ::uint64_t value){
+		::uint64_t old = peak.load(std::memory_order_relaxed);
+		while (value > old && !peak.compare_exchange_weak(old, value, std::memory_order_relaxed)){}
+	}
+};
+
+// An allocator which adds what a container allocates to a MemoryUse
+template <typename T, int USE>
+struct TrackingAllocator{
+	typedef T value_type;
+	template <typename U> struct rebind { typedef TrackingAllocator<U, USE> other; };
+
+	TrackingAllocator(){}
+	template <typename U> TrackingAllocator(const TrackingAllocator<U, USE>&){}
+
+	T* allocate(size_t n){
+		T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+		MemoryTracker::instance().add(static_cast<MemoryUse>(USE), n * sizeof(T));
+		return p;
+	}
+	void deallocate(T* p, size_t n){
+		MemoryTracker::instance().remove(static_cast<MemoryUse>(USE), n * sizeof(T));
+		::operator delete(p);
+	}
+};
+
+template <typename T, typename U, int USE>
+inline bool operator==(const TrackingAllocator<T, USE>&, const TrackingAllocator<U, USE>&){ return true; }
+template <typename T, typename U, int USE>
+inline bool operator!=(const TrackingAllocator<T, USE>&, const TrackingAllocator<U, USE>&){ return false; }
+
+// Counts memory we allocate ourselves as a MemoryUse, for the lifetime of the object
+class MemoryCharge{
+public:
+	MemoryCharge(MemoryUse use, ::uint64_t bytes) : use(use), bytes(bytes){
+		MemoryTracker::instance().add(use, bytes);
+	}
+	~MemoryCharge(){
+		MemoryTracker::instance().remove(use, bytes);
+	}
+private:
+	MemoryUse use;
+	::uint64_t bytes;
+
+	MemoryCharge(const MemoryCharge&);
+	MemoryCharge& operator=(const MemoryCharge&);
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "../libs/libtri/include/MeshReader.h"
+#include "globals.h"
+#include "MemoryTracker.h"
+
+using namespace std;
+
+// Reads the triangles of a mesh (.ply, .obj or .stl) one at a time, like a TriReader reads them from a .tridata file.
+// Triangles are moved by -origin (the corner of the bounding cube), like tri_convert does, so they are the triangles
+// of the .tridata file tri_convert would have made. The mesh has to be opened already: it reads a batch of faces at a time.
+class MeshTriangleReader{
+public:
+	size_t n_served; // triangles we gave so far
+
+	MeshTriangleReader(MeshReader &mesh, const glm::vec3 &origin);
+	bool hasNext();
+	void getTriangle(Triangle &t);
+	bool bufferEmpty() const { return current == batch.size(); }
+
+private:
+	MeshReader &mesh;
+	glm::vec3 origin;
+	vector<Triangle> batch;
+	size_t current; // next triangle of the batch
+	bool done;
+	MemoryCharge batch_memory;
+
+	void readBatch();
+
+	MeshTriangleReader(const MeshTriangleReader&);
+	MeshTriangleReader& operator=(const MeshTriangleReader&);
+};
+
+inline MeshTriangleReader::MeshTriangleReader(MeshReader &mesh, const glm::vec3 &origin) : n_served(0), mesh(mesh), origin(origin), current(0), done(false),
+	batch_memory(MEM_TRIANGLE_READERS, MESH_BATCH * sizeof(Triangle)){
+}
+
+// Read batches of faces until we have triangles (a batch can have none, if they were all skipped), or until there are no more
+inline void MeshTriangleReader::readBatch(){
+	PROFILE_SCOPE("reading triangles");
+	current = 0;
+	while (!done){
+		if (!mesh.getTriangles(batch)){
+			done = true;
+			batch.clear();
+			return;
+		}
+		if (!batch.empty()){
+			break;
+		}
+	}
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t) batch.size(); i++){
+		Triangle &t = batch[i];
+		t.v0 = t.v0 - origin;
+		t.v1 = t.v1 - origin;
+		t.v2 = t.v2 - origin;
+	}
+}
+
+inline bool MeshTriangleReader::hasNext(){
+	if (current == batch.size() && !done){
+		readBatch();
+	}
+	return current < batch.size();
+}
+
+inline void MeshTriangleReader::getTriangle(Triangle &t){
+	if (!hasNext()){
+		return;
+	}
+	t = batch[current++];
+	n_served++;
+}
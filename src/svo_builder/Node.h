@@ -17,6 +17,7 @@ public:
 	size_t children_base;
 	char children_offset[8];
 
+	unsigned char leaf_mask; // which children are leaf nodes (only needed for the compact node format)
 	VoxelData data_cache; // only if you want to refine octree (clustering)
 
 	Node();
@@ -28,7 +29,7 @@ public:
 };
 
 // Default constructor
-inline Node::Node() : data(0), children_base(0), data_cache(VoxelData()){
+inline Node::Node() : data(0), children_base(0), leaf_mask(0), data_cache(VoxelData()){
 	memset(children_offset, static_cast<char>(NOCHILD), 8);
 }
 
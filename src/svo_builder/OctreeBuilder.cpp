@@ -1,15 +1,17 @@
 #include "OctreeBuilder.h"
 
 // OctreeBuilder constructor: this initializes the builder and sets up the output files, ready to go
-OctreeBuilder::OctreeBuilder(std::string base_filename, size_t gridlength, bool generate_levels) :
-gridlength(gridlength), b_node_pos(0), b_data_pos(0), b_current_morton(0), generate_levels(generate_levels), base_filename(base_filename) {
-	svo_algo_timer.start();
-
+// With build_dag, identical subtrees are only written once, and the output is a directed acyclic graph instead of a tree.
+// A builder with a morton_start other than 0 builds the subtree for the (aligned) cube of gridlength^3 voxels starting there.
+// The node and payload output each get a buffer of output_buffer_bytes (two with async_io).
+OctreeBuilder::OctreeBuilder(std::string base_filename, size_t gridlength, bool generate_levels, bool async_io, bool compact_nodes, OctreeDataFormat data_format, bool dedup_data,
+	bool build_dag, ::uint64_t morton_start, size_t output_buffer_bytes) :
+gridlength(gridlength), b_node_pos(0), b_data_pos(0), b_current_morton(morton_start), generate_levels(generate_levels), compact_nodes(compact_nodes), data_format(data_format), payload_table(NULL), group_table(NULL), has_bbox(false), base_filename(base_filename) {
 	// Open output files
 	string nodes_name = base_filename + string(".octreenodes");
 	string data_name = base_filename + string(".octreedata");
-	node_out = fopen(nodes_name.c_str(), "wb");
-	data_out = fopen(data_name.c_str(), "wb");
+	node_out = new BufferedWriter(nodes_name, compact_nodes ? COMPACTNODE_SIZE : NODE_SIZE, output_buffer_bytes, async_io);
+	data_out = new BufferedWriter(data_name, dataRecordSize(data_format), output_buffer_bytes, async_io);
 
 	// Setup building variables
 	b_maxdepth = log2(static_cast<unsigned int>(gridlength));
@@ -18,65 +20,292 @@ gridlength(gridlength), b_node_pos(0), b_data_pos(0), b_current_morton(0), gener
 		b_buffers[i].reserve(8);
 	}
 
+	// Payload deduplication needs explicit data addresses, compact nodes derive them from their position
+	if (dedup_data && !compact_nodes){
+		payload_table = new PayloadTable(OCTREE_DEDUP_CAPACITY);
+	}
+	// Subtrees are compared without their payloads, so only binary trees without generated levels can be shared
+#ifdef BINARY_VOXELIZATION
+	if (build_dag && !generate_levels){
+		group_table = new NodeGroupTable(OCTREE_DAG_CAPACITY);
+	}
+#endif
+
 	// Fill data arrays
 	uint_fast32_t maxm = static_cast<uint_fast32_t>(gridlength - 1);
-	b_max_morton = morton3D_64_encode(maxm,maxm,maxm);
-	svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-	writeVoxelData(data_out, VoxelData(), b_data_pos); // first data point is NULL
+	b_max_morton = morton_start + morton3D_64_encode(maxm,maxm,maxm);
+	writeVoxelData(*data_out, VoxelData(), data_format, b_data_pos); // first data point is NULL
 #ifdef BINARY_VOXELIZATION
 	VoxelData v = VoxelData(0, vec3(), vec3(1.0, 1.0, 1.0)); // We store a simple white voxel in case of Binary voxelization
-	writeVoxelData(data_out, v, b_data_pos); // all leafs will refer to this
+	writeOutData(v); // all leafs will refer to this
 #endif
-	svo_io_out_timer.stop(); svo_algo_timer.stop();
+}
+
+// OctreeBuilder destructor: release output writers (finalizeTree will already have flushed them)
+OctreeBuilder::~OctreeBuilder(){
+	delete node_out;
+	delete data_out;
+	delete payload_table;
+	delete group_table;
 }
 
 // Finalize the tree: add rest of empty nodes, make sure root node is on top
-void OctreeBuilder::finalizeTree(){
+// Returns false if the octree files could not be written completely.
+bool OctreeBuilder::finalizeTree(){
 	// fill octree
-	if (b_current_morton < b_max_morton){
+	if (b_current_morton <= b_max_morton){
 		fastAddEmpty((b_max_morton - b_current_morton) + 1);
 	}
 
 	// write root node
-	svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-	writeNode(node_out, b_buffers[0][0], b_node_pos);
-	svo_io_out_timer.stop(); svo_algo_timer.start(); // TIMING
+	writeOutNode(b_buffers[0][0]);
 
 	// write header
-	OctreeInfo octree_info(1, base_filename, gridlength, b_node_pos, b_data_pos);
+	int version = compact_nodes ? OCTREE_VERSION_COMPACT : OCTREE_VERSION_LEGACY;
+	OctreeInfo octree_info(version, base_filename, gridlength, b_node_pos, b_data_pos, dataLayout(), data_format);
+	octree_info.dag = (group_table != NULL);
+	octree_info.levels = generate_levels;
+	octree_info.has_bbox = has_bbox;
+	octree_info.bbox = bbox;
+
+	bool ok;
+	{
+		PROFILE_SCOPE("writing output");
+		ok = writeOctreeHeader(base_filename + string(".octree"), octree_info);
+	}
+
+	// flush and close files
+	ok = data_out->close() && ok;
+	ok = node_out->close() && ok;
+	return ok;
+}
+
+// Finalize a subtree: add rest of empty nodes and close the segment files.
+// The root node is not written, but returned in the segment, so it can be grouped with its siblings later on.
+OctreeSegment OctreeBuilder::finalizeSubtree(){
+	if (b_current_morton <= b_max_morton){
+		fastAddEmpty((b_max_morton - b_current_morton) + 1);
+	}
+	bool data_ok = data_out->close();
+	bool nodes_ok = node_out->close();
+	if (!data_ok || !nodes_ok){
+		exit(1); // the subtree is incomplete, and so would be any octree we add it to
+	}
+
+	OctreeSegment segment;
+	segment.base_filename = base_filename;
+	segment.root = b_buffers[0][0];
+	segment.first_node = 0;
+	segment.n_nodes = b_node_pos;
+	segment.first_data = dataHeaderRecords(); // the NULL (and shared white) payload, which the octree we're added to already has
+	segment.n_data = b_data_pos - segment.first_data;
+	segment.temporary = true;
+	segment.morton_start = b_max_morton + 1 - static_cast<::uint64_t>(gridlength) * gridlength * gridlength;
+	segment.gridlength = gridlength;
+	return segment;
+}
+
+// Add a subtree which was built by another (subtree) builder with the same settings, or which comes from an existing octree.
+// The segment's node and payload ranges are appended to our output files, with node and payload addresses moved to their new position,
+// and the subtree's root node goes into the buffers like any other node. Temporary segment files are removed afterwards.
+void OctreeBuilder::addSubtree(const OctreeSegment &segment){
+	// Padding for missed morton numbers
+	if (segment.morton_start != b_current_morton){
+		fastAddEmpty(segment.morton_start - b_current_morton);
+	}
+	size_t node_base = b_node_pos;
+	size_t data_header = dataHeaderRecords(); // the NULL (and shared white) payload, which we already have
+	size_t data_base = b_data_pos;
+
+	// append payloads
+	vector<char> record(std::max(dataRecordSize(data_format), NODE_SIZE));
+	string data_name = segment.base_filename + string(".octreedata");
+	FILE* data_in = fopen(data_name.c_str(), "rb");
+	if (data_in == NULL || seekFile(data_in, static_cast<::uint64_t>(segment.first_data) * dataRecordSize(data_format)) != 0){
+		cout << "Error: could not read subtree payloads from " << data_name << endl;
+		exit(1);
+	}
+	setvbuf(data_in, NULL, _IOFBF, OCTREE_OUTPUT_BUFFERSIZE);
+	for (size_t i = 0; i < segment.n_data; i++){
+		if (fread(&record[0], dataRecordSize(data_format), 1, data_in) != 1){
+			cout << "Error: " << data_name << " ends before the payloads of the subtree do." << endl;
+			exit(1);
+		}
+		data_out->write(&record[0]);
+		b_data_pos++;
+	}
+	fclose(data_in);
+
+	// append nodes (compact nodes only have relative addresses, so they don't change)
+	string nodes_name = segment.base_filename + string(".octreenodes");
+	FILE* nodes_in = fopen(nodes_name.c_str(), "rb");
+	size_t node_size = compact_nodes ? COMPACTNODE_SIZE : NODE_SIZE;
+	if (nodes_in == NULL || seekFile(nodes_in, static_cast<::uint64_t>(segment.first_node) * node_size) != 0){
+		cout << "Error: could not read subtree nodes from " << nodes_name << endl;
+		exit(1);
+	}
+	setvbuf(nodes_in, NULL, _IOFBF, OCTREE_OUTPUT_BUFFERSIZE);
+	Node n;
+	for (size_t i = 0; i < segment.n_nodes; i++){
+		if (fread(&record[0], node_size, 1, nodes_in) != 1){
+			cout << "Error: " << nodes_name << " ends before the nodes of the subtree do." << endl;
+			exit(1);
+		}
+		if (compact_nodes){
+			node_out->write(&record[0]);
+			b_node_pos++;
+			continue;
+		}
+		memcpy(&n.data, &record[0], NODE_SIZE);
+		if (n.data >= data_header){
+			n.data = n.data - segment.first_data + data_base;
+		}
+		if (!n.isLeaf()){
+			n.children_base = n.children_base - segment.first_node + node_base;
+		}
+		writeNode(*node_out, n, b_node_pos);
+	}
+	fclose(nodes_in);
+	if (segment.temporary){
+		remove(data_name.c_str());
+		remove(nodes_name.c_str());
+	}
 
-	svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-	writeOctreeHeader(base_filename + string(".octree"), octree_info);
-	svo_io_out_timer.stop(); svo_algo_timer.start(); // TIMING
+	// add root to the buffers, at the level which covers the subtree
+	Node root = segment.root;
+	if (!compact_nodes && root.data >= data_header){
+		root.data = root.data - segment.first_data + data_base;
+	}
+	if (!root.isLeaf()){
+		root.children_base = root.children_base - segment.first_node + node_base;
+	}
+	int level = b_maxdepth - log2(static_cast<unsigned int>(segment.gridlength));
+	b_buffers.at(level).push_back(root);
+	refineBuffers(level);
+	b_current_morton += static_cast<::uint64_t>(segment.gridlength) * segment.gridlength * segment.gridlength;
+}
 
-	// close files
-	fclose(data_out);
-	fclose(node_out);
+// Number of payloads every output file starts with: the NULL payload, and the shared white payload in binary mode
+size_t OctreeBuilder::dataHeaderRecords() const{
+#ifdef BINARY_VOXELIZATION
+	return 2;
+#else
+	return 1;
+#endif
+}
+
+// Number of node and payload bytes handed to the output files so far
+::uint64_t OctreeBuilder::bytesWritten() const{
+	return static_cast<::uint64_t>(node_out->n_records) * node_out->record_size + static_cast<::uint64_t>(data_out->n_records) * data_out->record_size;
+}
+
+// How the nodes we write refer to their data payload
+OctreeDataLayout OctreeBuilder::dataLayout() const{
+	return builderDataLayout(compact_nodes, generate_levels);
+}
+
+// Write a node to disk in the configured node format, return its index
+size_t OctreeBuilder::writeOutNode(const Node &n){
+	if (!compact_nodes){
+		return writeNode(*node_out, n, b_node_pos);
+	}
+	::uint64_t child_pointer = 0;
+	unsigned char child_mask = 0;
+	for (int k = 0; k < 8; k++){
+		if (n.hasChild(k)){
+			child_mask |= (1 << k);
+		}
+	}
+	if (child_mask != 0){
+		child_pointer = b_node_pos - n.children_base; // children are always written before their parent
+		if (child_pointer > COMPACTNODE_MAX_POINTER){
+			cout << "Error: child pointer " << child_pointer << " does not fit in a compact node. Use the regular node format." << endl;
+			exit(1);
+		}
+	}
+	// In compact mode, payloads are implicit: they're written in the same order as the nodes
+	if (dataLayout() == DATA_PER_NODE){
+		writeOutData(n.hasData() ? n.data_cache : VoxelData());
+	}
+	return writeCompactNode(*node_out, CompactNode(child_mask, n.leaf_mask, n.hasData(), child_pointer), b_node_pos);
+}
+
+// Write a data payload to disk in the configured data format, return its index
+// When deduplicating, payloads we've already written are not written again: we return the existing index.
+size_t OctreeBuilder::writeOutData(const VoxelData &d){
+	if (payload_table == NULL){
+		return writeVoxelData(*data_out, d, data_format, b_data_pos);
+	}
+	PayloadKey key = makePayloadKey(d, data_format);
+	size_t data_pos;
+	if (payload_table->find(key, data_pos)){
+		return data_pos;
+	}
+	data_pos = writeVoxelData(*data_out, d, data_format, b_data_pos);
+	payload_table->insert(key, data_pos);
+	return data_pos;
+}
+
+// Describe a group of siblings for subtree deduplication: one word per child slot, 0 for empty children.
+// Children of shared subtrees already point to the single written copy, so equal words mean equal subtrees.
+NodeGroupKey OctreeBuilder::makeGroupKey(const vector<Node> &buffer) const{
+	NodeGroupKey key;
+	for (int k = 0; k < 8; k++){
+		const Node &n = buffer[k];
+		if (n.isNull()){
+			key.words[k] = 0;
+			continue;
+		}
+		::uint64_t child_mask = 0;
+		for (int c = 0; c < 8; c++){
+			if (n.hasChild(c)){
+				child_mask |= (1 << c);
+			}
+		}
+		key.words[k] = (static_cast<::uint64_t>(n.children_base) << 17) | (static_cast<::uint64_t>(n.hasData()) << 16) | (child_mask << 8) | n.leaf_mask;
+	}
+	return key;
 }
 
 // Group 8 nodes, write non-empty nodes to disk and create parent node
+// When building a DAG, siblings which were written before are not written again: the parent points to the earlier copy.
 Node OctreeBuilder::groupNodes(const vector<Node> &buffer){
 	Node parent = Node();
+	NodeGroupKey group_key;
+	size_t shared_pos = 0;
+	bool shared = false;
+	if (group_table != NULL){
+		group_key = makeGroupKey(buffer);
+		shared = group_table->find(group_key, shared_pos);
+	}
 	bool first_stored_child = true;
+	char n_stored = 0;
 	for (int k = 0; k < 8; k++){
 		if (!buffer[k].isNull()){
-			if (first_stored_child){
-				svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-				parent.children_base = writeNode(node_out, buffer[k], b_node_pos);
-				svo_io_out_timer.stop(); svo_algo_timer.start(); // TIMING
+			if (shared){
+				parent.children_base = shared_pos - 1;
+				parent.children_offset[k] = n_stored;
+			}
+			else if (first_stored_child){
+				parent.children_base = writeOutNode(buffer[k]);
 				parent.children_offset[k] = 0;
 				first_stored_child = false;
 			}
 			else {
-				svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-				parent.children_offset[k] = (char)(writeNode(node_out, buffer[k], b_node_pos) - parent.children_base);
-				svo_io_out_timer.stop(); svo_algo_timer.start(); // TIMING
+				parent.children_offset[k] = (char)(writeOutNode(buffer[k]) - parent.children_base);
+			}
+			n_stored++;
+			if (buffer[k].isLeaf()){
+				parent.leaf_mask |= (1 << k);
 			}
 		}
 		else {
 			parent.children_offset[k] = NOCHILD;
 		}
 	}
+	if (group_table != NULL && !shared){
+		group_table->insert(group_key, parent.children_base + 1); // position 0 is a valid group, table needs it to be > 0
+	}
 
 	// SIMPLE LEVEL CONSTRUCTION
 	if (generate_levels){
@@ -92,9 +321,12 @@ Node OctreeBuilder::groupNodes(const vector<Node> &buffer){
 		vec3 tonormalize = (vec3)(d.normal / notnull);
 		d.normal = normalize(tonormalize);
 		// set it in the parent node
-		svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-		parent.data = writeVoxelData(data_out, d, b_data_pos);
-		svo_io_out_timer.stop(); svo_algo_timer.start(); // TIMING
+		if (compact_nodes){
+			parent.data = 1; // payload gets written together with the node
+		}
+		else {
+			parent.data = writeOutData(d);
+		}
 		parent.data_cache = d;
 	}
 
@@ -127,6 +359,27 @@ void OctreeBuilder::refineBuffers(const int start_depth){
 	}
 }
 
+// Create the leaf node for a voxel
+Node OctreeBuilder::makeLeaf(const ::uint64_t morton_number){
+	Node node = Node(); // create empty node
+	node.data = 1; // all nodes in binary voxelization refer to this
+	return node;
+}
+
+// Create the leaf node for a voxel, writing its data point
+Node OctreeBuilder::makeLeaf(const VoxelData& data){
+	Node node = Node(); // create empty node
+	// Write data point
+	if (compact_nodes){
+		node.data = 1; // payload gets written together with the node
+	}
+	else {
+		node.data = writeOutData(data); // store data
+	}
+	node.data_cache = data; // store data as cache
+	return node;
+}
+
 // Add a datapoint to the octree: this is the main method used to push datapoints
 void OctreeBuilder::addVoxel(const ::uint64_t morton_number){
 	// Padding for missed morton numbers
@@ -134,11 +387,8 @@ void OctreeBuilder::addVoxel(const ::uint64_t morton_number){
 		fastAddEmpty(morton_number - b_current_morton);
 	}
 
-	// Create node
-	Node node = Node(); // create empty node
-	node.data = 1; // all nodes in binary voxelization refer to this
 	// Add to buffer
-	b_buffers.at(b_maxdepth).push_back(node);
+	b_buffers.at(b_maxdepth).push_back(makeLeaf(morton_number));
 	// Refine buffers
 	refineBuffers(b_maxdepth);
 
@@ -152,17 +402,129 @@ void OctreeBuilder::addVoxel(const VoxelData& data){
 		fastAddEmpty(data.morton - b_current_morton);
 	}
 
-	// Create node
-	Node node = Node(); // create empty node
-	// Write data point
-	svo_algo_timer.stop(); svo_io_out_timer.start(); // TIMING
-	node.data = writeVoxelData(data_out, data, b_data_pos); // store data
-	svo_io_out_timer.stop(); svo_algo_timer.start(); // TIMING
-	node.data_cache = data; // store data as cache
 	// Add to buffers
-	b_buffers.at(b_maxdepth).push_back(node);
+	b_buffers.at(b_maxdepth).push_back(makeLeaf(data));
 	// Refine buffers
 	refineBuffers(b_maxdepth);
 
 	b_current_morton++;
+}
+
+// Add a sorted array of voxels (no duplicates), which all lie in one aligned cube of 8^k morton codes (a partition, or a part of one).
+// The result is the same as calling addVoxel for each of them, followed by empty voxels up to at most the end of the cube:
+// subtrees are built level by level from the morton codes instead of going through the buffers voxel by voxel.
+// Because of that padding, the voxels of the next call must lie beyond the cube.
+void OctreeBuilder::addVoxels(const ::uint64_t* morton_numbers, size_t n){
+	addVoxelsBulk(morton_numbers, n);
+}
+
+// Add a sorted array of voxels (no duplicates), see above
+void OctreeBuilder::addVoxels(const VoxelData* points, size_t n){
+	addVoxelsBulk(points, n);
+}
+
+static inline ::uint64_t mortonOf(const ::uint64_t morton_number){ return morton_number; }
+static inline ::uint64_t mortonOf(const VoxelData &point){ return point.morton; }
+
+// Bulk construction: the voxels are split in aligned blocks of 8^h voxels, and the subtree of each block is built in two passes.
+// The first pass computes the child masks of every level: parent keys are the child keys >> 3, run-length grouped.
+// The second pass walks the masks depth-first and groups nodes in exactly the order refineBuffers would.
+// The block's root then goes into the buffers like a single node at level b_maxdepth - h.
+template <typename T>
+void OctreeBuilder::addVoxelsBulk(const T* points, size_t n){
+	if (n == 0){
+		return;
+	}
+	// Largest block size which holds all voxels, but doesn't reach back before the current morton position
+	::uint64_t first = mortonOf(points[0]);
+	::uint64_t last = mortonOf(points[n - 1]);
+	assert(first >= b_current_morton); // voxels (or the cube) of an earlier call overlap these
+	int h = 0;
+	while (h < b_maxdepth && (first >> (3 * h)) != (last >> (3 * h))){
+		h++;
+	}
+	while (h > 0 && ((first >> (3 * h)) << (3 * h)) < b_current_morton){
+		h--;
+	}
+
+	vector< vector<unsigned char> > masks(h + 1); // child masks of the nodes on every level of a block, in morton order
+	vector<size_t> cursors(h + 1); // next node to visit on every level (level 0: next voxel)
+	vector< vector<Node> > scratch(h + 1, vector<Node>(8)); // one group buffer per level
+	vector<::uint64_t> keys;
+	keys.reserve(std::min(n, static_cast<size_t>(1) << 20));
+
+	size_t block_begin = 0;
+	while (block_begin < n){
+		// find voxels in this block
+		::uint64_t block_key = mortonOf(points[block_begin]) >> (3 * h);
+		size_t block_end = block_begin + 1;
+		while (block_end < n && (mortonOf(points[block_end]) >> (3 * h)) == block_key){
+			block_end++;
+		}
+		// padding up to the start of the block
+		::uint64_t block_start = block_key << (3 * h);
+		if (block_start != b_current_morton){
+			fastAddEmpty(block_start - b_current_morton);
+		}
+
+		Node root;
+		if (h == 0){
+			root = makeLeaf(points[block_begin]);
+		}
+		else {
+			// pass 1: child masks, level by level (keys are compacted in place)
+			keys.clear();
+			masks[1].clear();
+			for (size_t i = block_begin; i < block_end; i++){
+				::uint64_t m = mortonOf(points[i]);
+				if (keys.empty() || keys.back() != (m >> 3)){
+					keys.push_back(m >> 3);
+					masks[1].push_back(0);
+				}
+				masks[1].back() |= static_cast<unsigned char>(1 << (m & 7));
+			}
+			for (int l = 2; l <= h; l++){
+				masks[l].clear();
+				size_t n_parents = 0;
+				for (size_t i = 0; i < keys.size(); i++){
+					::uint64_t key = keys[i];
+					if (n_parents == 0 || keys[n_parents - 1] != (key >> 3)){
+						keys[n_parents++] = key >> 3;
+						masks[l].push_back(0);
+					}
+					masks[l].back() |= static_cast<unsigned char>(1 << (key & 7));
+				}
+				keys.resize(n_parents);
+			}
+			// pass 2: depth-first grouping
+			std::fill(cursors.begin(), cursors.end(), 0);
+			cursors[0] = block_begin;
+			root = groupBulkNodes(h, points, masks, cursors, scratch);
+		}
+
+		// add block root to the buffers
+		b_buffers.at(b_maxdepth - h).push_back(root);
+		refineBuffers(b_maxdepth - h);
+		b_current_morton = block_start + (static_cast<::uint64_t>(1) << (3 * h));
+		block_begin = block_end;
+	}
+}
+
+// Build the next node on a level of a bulk block: build its children (in morton order), then group them
+template <typename T>
+Node OctreeBuilder::groupBulkNodes(int level, const T* points, vector< vector<unsigned char> > &masks, vector<size_t> &cursors, vector< vector<Node> > &scratch){
+	unsigned char mask = masks[level][cursors[level]++];
+	vector<Node> &buffer = scratch[level];
+	for (int k = 0; k < 8; k++){
+		if (!(mask & (1 << k))){
+			buffer[k] = Node();
+		}
+		else if (level == 1){
+			buffer[k] = makeLeaf(points[cursors[0]++]);
+		}
+		else {
+			buffer[k] = groupBulkNodes(level - 1, points, masks, cursors, scratch);
+		}
+	}
+	return groupNodes(buffer);
 }
\ No newline at end of file
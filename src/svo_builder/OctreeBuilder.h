@@ -8,10 +8,46 @@
 #include "globals.h"
 #include "svo_builder_util.h"
 #include "octree_io.h"
+#include "PayloadTable.h"
+
+// Size of the output buffers for nodes and data, in bytes (and the smallest size we go down to for a tight memory limit)
+#define OCTREE_OUTPUT_BUFFERSIZE (8 * 1024 * 1024)
+#define OCTREE_MIN_OUTPUT_BUFFERSIZE (64 * 1024)
+
+// Number of entries in the payload deduplication table (32 bytes per entry)
+#define OCTREE_DEDUP_CAPACITY (1024 * 1024)
+
+// Number of entries in the subtree deduplication table (72 bytes per entry)
+#define OCTREE_DAG_CAPACITY (1024 * 1024)
 
 using namespace std;
 using namespace glm;
 
+// A subtree which was built on its own (see OctreeBuilder::finalizeSubtree) or which is taken from an existing octree, waiting to be added to an octree
+struct OctreeSegment {
+	string base_filename; // the subtree's nodes and payloads are in base_filename(.octreenodes/.octreedata)
+	Node root; // root node of the subtree, which is not in the node range
+	size_t first_node; // first node of the subtree in the node file (all nodes below the root are stored in one range)
+	size_t n_nodes; // number of nodes in the range
+	size_t first_data; // first payload of the subtree in the data file
+	size_t n_data; // number of payloads in the range
+	bool temporary; // remove the files once the subtree has been added
+	::uint64_t morton_start; // first morton code covered by the subtree
+	size_t gridlength; // length of one side of the subtree's grid
+};
+
+// How the nodes of a builder with these options refer to their data payload
+inline OctreeDataLayout builderDataLayout(bool compact_nodes, bool generate_levels){
+	if (!compact_nodes){
+		return DATA_EXPLICIT;
+	}
+#ifdef BINARY_VOXELIZATION
+	return generate_levels ? DATA_SHARED_ALL : DATA_SHARED_LEAVES;
+#else
+	return DATA_PER_NODE;
+#endif
+}
+
 // Octreebuilder class. You pass this class DataPoints, it builds an octree from them.
 class OctreeBuilder {
 public:
@@ -25,23 +61,48 @@ public:
 
 	// configuration
 	bool generate_levels; // switch to enable basic generation of higher octree levels
+	bool compact_nodes; // write nodes in the compact (version 2) format
+	OctreeDataFormat data_format; // format of the payloads in the data file
+	PayloadTable* payload_table; // table of already written payloads (NULL if we don't deduplicate)
+	NodeGroupTable* group_table; // table of already written sibling groups (NULL if we don't build a DAG)
+	bool has_bbox; // write bbox to the header (so -update can check that the grid didn't move)
+	AABox<vec3> bbox; // bounding cube of the grid in model coordinates
 
-	FILE* node_out;
-	FILE* data_out;
+	BufferedWriter* node_out;
+	BufferedWriter* data_out;
 	string base_filename;
 
-	OctreeBuilder(std::string base_filename, size_t gridlength, bool generate_levels);
-	void finalizeTree();
+	OctreeBuilder(std::string base_filename, size_t gridlength, bool generate_levels, bool async_io = false, bool compact_nodes = false, OctreeDataFormat data_format = DATA_FULL, bool dedup_data = false,
+		bool build_dag = false, ::uint64_t morton_start = 0, size_t output_buffer_bytes = OCTREE_OUTPUT_BUFFERSIZE);
+	~OctreeBuilder();
+	bool finalizeTree();
+	OctreeSegment finalizeSubtree();
+	void addSubtree(const OctreeSegment &segment);
 	void addVoxel(const uint_fast64_t morton_number);
 	void addVoxel(const VoxelData& point);
+	void addVoxels(const ::uint64_t* morton_numbers, size_t n); // one call per aligned cube of voxels, see OctreeBuilder.cpp
+	void addVoxels(const VoxelData* points, size_t n);
+	OctreeDataLayout dataLayout() const;
+	size_t dataHeaderRecords() const;
+	::uint64_t bytesWritten() const;
 
 private:
+	OctreeBuilder(const OctreeBuilder&);
+	OctreeBuilder& operator=(const OctreeBuilder&);
+
 	// helper methods for octree building
+	Node makeLeaf(const ::uint64_t morton_number);
+	Node makeLeaf(const VoxelData& point);
+	template <typename T> void addVoxelsBulk(const T* points, size_t n);
+	template <typename T> Node groupBulkNodes(int level, const T* points, vector< vector<unsigned char> > &masks, vector<size_t> &cursors, vector< vector<Node> > &scratch);
 	void fastAddEmpty(const size_t budget);
 	void addEmptyVoxel(const int buffer);
 	bool isBufferEmpty(const vector<Node> &buffer);
 	void refineBuffers(const int start_depth);
 	Node groupNodes(const vector<Node> &buffer);
+	NodeGroupKey makeGroupKey(const vector<Node> &buffer) const;
+	size_t writeOutNode(const Node &n);
+	size_t writeOutData(const VoxelData &d);
 	int highestNonEmptyBuffer();
 	int computeBestFillBuffer(const size_t budget);
 };
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "octree_io.h"
+#include "../libs/libmorton/include/morton.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Node index used for "no node here"
+const size_t OCTREE_NO_NODE = static_cast<size_t>(-1);
+
+// A read-only memory mapped file
+class MappedFile{
+public:
+	const char* data;
+	size_t size;
+
+	MappedFile() : data(NULL), size(0){
+#if defined(_WIN32) || defined(_WIN64)
+		file = INVALID_HANDLE_VALUE; mapping = NULL;
+#else
+		fd = -1;
+#endif
+	}
+	~MappedFile() { close(); }
+
+	bool open(const std::string &filename);
+	void close();
+
+private:
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+inline bool MappedFile::open(const std::string &filename){
+	close();
+#if defined(_WIN32) || defined(_WIN64)
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE){ return false; }
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	size = static_cast<size_t>(file_size.QuadPart);
+	if (size == 0){ return true; }
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL){ return false; }
+	data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	return data != NULL;
+#else
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0){ return false; }
+	struct stat st;
+	fstat(fd, &st);
+	size = static_cast<size_t>(st.st_size);
+	if (size == 0){ return true; }
+	void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED){ return false; }
+	data = static_cast<const char*>(p);
+	return true;
+#endif
+}
+
+inline void MappedFile::close(){
+#if defined(_WIN32) || defined(_WIN64)
+	if (data != NULL){ UnmapViewOfFile(data); }
+	if (mapping != NULL){ CloseHandle(mapping); }
+	if (file != INVALID_HANDLE_VALUE){ CloseHandle(file); }
+	file = INVALID_HANDLE_VALUE; mapping = NULL;
+#else
+	if (data != NULL){ munmap(const_cast<char*>(data), size); }
+	if (fd >= 0){ ::close(fd); }
+	fd = -1;
+#endif
+	data = NULL;
+	size = 0;
+}
+
+// Grid-aligned cell an octree node covers: origin in voxel coordinates and length of one side
+struct OctreeCell{
+	uint_fast32_t x, y, z;
+	uint_fast32_t size;
+};
+
+// Random-access reader for .octree/.octreenodes/.octreedata files, which works directly on the memory mapped files.
+// Supports both the regular (version 1) and the compact (version 2) node format, all payload formats and all node orders.
+// Child i of a node covers the octant with x offset (i & 1), y offset (i >> 1) & 1 and z offset (i >> 2) & 1,
+// which matches the morton code order the builder uses.
+class OctreeReader{
+public:
+	OctreeInfo info;
+	int maxdepth; // depth of the leaf level
+
+	OctreeReader() : maxdepth(0), node_size(NODE_SIZE), data_size(VOXELDATA_SIZE){}
+
+	bool open(const std::string &header_filename);
+	void close();
+
+	// tree structure
+	size_t root() const { return info.root(); }
+	OctreeCell rootCell() const;
+	bool hasChild(size_t node, unsigned int i) const;
+	size_t getChild(size_t node, unsigned int i) const;
+	bool isLeaf(size_t node) const;
+	template <typename F> void forEachChild(size_t node, F f) const;
+
+	// data
+	size_t getDataPos(size_t node) const;
+	bool getData(size_t node, VoxelData &v) const;
+
+	// raw records, as stored in the files
+	size_t nodeSize() const { return node_size; }
+	size_t dataSize() const { return data_size; }
+	const char* nodeAddress(size_t node) const { return nodes.data + node * node_size; }
+	const char* dataAddress(size_t data_pos) const { return data.data + data_pos * data_size; }
+
+	// pages (paged octrees only: in other octrees, all nodes are in page 0)
+	size_t pageOf(size_t node) const;
+	PageInfo getPage(size_t page) const;
+
+	// queries
+	size_t findVoxel(uint_fast32_t x, uint_fast32_t y, uint_fast32_t z) const;
+	size_t findVoxel(uint_fast64_t morton) const;
+	template <typename F> void forEachVoxelInBox(const OctreeCell &min, const OctreeCell &max, F f) const;
+
+private:
+	MappedFile nodes;
+	MappedFile data;
+	MappedFile page_table; // (paged octrees only) first node of the target of each link between pages
+	MappedFile page_index; // (paged octrees only) a PageInfo for every page
+	size_t node_size;
+	size_t data_size;
+
+	static OctreeCell childCell(const OctreeCell &c, unsigned int i);
+	template <typename F> void boxRecurse(size_t node, const OctreeCell &cell, const OctreeCell &min, const OctreeCell &max, F &f) const;
+};
+
+// Parse the header and map the node and data files. Returns false if something's missing.
+inline bool OctreeReader::open(const std::string &header_filename){
+	if (parseOctreeHeader(header_filename, info) != 1 || !info.filesExist() || info.n_nodes == 0){
+		return false;
+	}
+	node_size = (info.version >= OCTREE_VERSION_COMPACT) ? COMPACTNODE_SIZE : NODE_SIZE;
+	data_size = dataRecordSize(info.data_format);
+	maxdepth = log2(static_cast<unsigned int>(info.gridlength));
+	if (!nodes.open(info.base_filename + string(".octreenodes")) || !data.open(info.base_filename + string(".octreedata"))){
+		return false;
+	}
+	if (info.node_order == ORDER_PAGED){
+		if (!page_table.open(info.base_filename + string(".octreepagetable")) || !page_index.open(info.base_filename + string(".octreepages"))){
+			return false;
+		}
+		if (page_table.size < info.n_page_links * sizeof(::uint64_t) || page_index.size < info.n_pages * PAGEINFO_SIZE){
+			return false;
+		}
+	}
+	return nodes.size >= info.n_nodes * node_size && data.size >= info.n_data * data_size;
+}
+
+inline void OctreeReader::close(){
+	nodes.close();
+	data.close();
+	page_table.close();
+	page_index.close();
+}
+
+inline OctreeCell OctreeReader::rootCell() const{
+	OctreeCell c;
+	c.x = 0; c.y = 0; c.z = 0;
+	c.size = static_cast<uint_fast32_t>(info.gridlength);
+	return c;
+}
+
+inline OctreeCell OctreeReader::childCell(const OctreeCell &c, unsigned int i){
+	OctreeCell child;
+	child.size = c.size / 2;
+	child.x = c.x + (i & 1) * child.size;
+	child.y = c.y + ((i >> 1) & 1) * child.size;
+	child.z = c.z + ((i >> 2) & 1) * child.size;
+	return child;
+}
+
+inline bool OctreeReader::hasChild(size_t node, unsigned int i) const{
+	const char* n = nodeAddress(node);
+	if (node_size == COMPACTNODE_SIZE){
+		return (static_cast<unsigned char>(n[0]) & (1 << i)) != 0;
+	}
+	return n[2 * sizeof(size_t) + i] != NOCHILD;
+}
+
+// Get the index of child i of a node, or OCTREE_NO_NODE if it doesn't exist
+inline size_t OctreeReader::getChild(size_t node, unsigned int i) const{
+	const char* n = nodeAddress(node);
+	if (node_size == COMPACTNODE_SIZE){
+		CompactNode c;
+		memcpy(&c.bits, n, COMPACTNODE_SIZE);
+		if (!c.hasChild(i)){
+			return OCTREE_NO_NODE;
+		}
+		if (c.isFar()){ // children live in another page
+			::uint64_t first_child;
+			memcpy(&first_child, page_table.data + c.childPointer() * sizeof(::uint64_t), sizeof(::uint64_t));
+			return static_cast<size_t>(first_child) + popcount8(c.childMask() & ((1 << i) - 1));
+		}
+		return c.getChildPos(i, node, info.node_order);
+	}
+	char offset = n[2 * sizeof(size_t) + i];
+	if (offset == NOCHILD){
+		return OCTREE_NO_NODE;
+	}
+	size_t children_base;
+	memcpy(&children_base, n + sizeof(size_t), sizeof(size_t));
+	return children_base + offset;
+}
+
+inline bool OctreeReader::isLeaf(size_t node) const{
+	const char* n = nodeAddress(node);
+	if (node_size == COMPACTNODE_SIZE){
+		return n[0] == 0;
+	}
+	return memcmp(n + 2 * sizeof(size_t), LEAF, 8) == 0;
+}
+
+// Call f(i, child_index) for every existing child of a node
+template <typename F>
+inline void OctreeReader::forEachChild(size_t node, F f) const{
+	for (unsigned int i = 0; i < 8; i++){
+		size_t child = getChild(node, i);
+		if (child != OCTREE_NO_NODE){
+			f(i, child);
+		}
+	}
+}
+
+// Get the page a node is stored in
+inline size_t OctreeReader::pageOf(size_t node) const{
+	size_t page_nodes = info.page_size / node_size; // 0 if the octree isn't paged
+	if (page_nodes == 0){
+		return 0;
+	}
+	return node / page_nodes;
+}
+
+// Get the page index entry of a page
+inline PageInfo OctreeReader::getPage(size_t page) const{
+	PageInfo p;
+	const char* e = page_index.data + page * PAGEINFO_SIZE;
+	memcpy(&p.first_node, e, sizeof(::uint64_t));
+	memcpy(&p.n_nodes, e + 8, sizeof(::uint32_t));
+	memcpy(&p.n_subtrees, e + 12, sizeof(::uint32_t));
+	memcpy(&p.parent_page, e + 16, sizeof(::uint64_t));
+	return p;
+}
+
+// Index of the data payload of a node (0 means no data)
+inline size_t OctreeReader::getDataPos(size_t node) const{
+	const char* n = nodeAddress(node);
+	if (node_size == COMPACTNODE_SIZE){
+		CompactNode c;
+		memcpy(&c.bits, n, COMPACTNODE_SIZE);
+		return c.getDataPos(node, info.data_layout);
+	}
+	size_t data_pos;
+	memcpy(&data_pos, n, sizeof(size_t));
+	return data_pos;
+}
+
+// Decode the payload of a node, return false if the node has no payload
+inline bool OctreeReader::getData(size_t node, VoxelData &v) const{
+	size_t data_pos = getDataPos(node);
+	if (data_pos == NODATA || data_pos >= info.n_data){
+		return false;
+	}
+	const char* d = dataAddress(data_pos);
+	if (info.data_format == DATA_FULL){
+		memcpy(&v.morton, d, VOXELDATA_SIZE);
+		return true;
+	}
+	::uint64_t morton = 0;
+	if (info.data_format == DATA_QUANTIZED_MORTON){
+		memcpy(&morton, d, sizeof(::uint64_t));
+		d += sizeof(::uint64_t);
+	}
+	QuantizedVoxelData q;
+	memcpy(&q.color, d, QUANTIZEDVOXELDATA_SIZE);
+	v = q.toVoxelData(morton);
+	return true;
+}
+
+// Find the leaf node for a voxel, return OCTREE_NO_NODE if the voxel is empty
+inline size_t OctreeReader::findVoxel(uint_fast64_t morton) const{
+	size_t node = root();
+	for (int level = maxdepth - 1; level >= 0; level--){
+		node = getChild(node, static_cast<unsigned int>((morton >> (3 * level)) & 7));
+		if (node == OCTREE_NO_NODE){
+			return OCTREE_NO_NODE;
+		}
+	}
+	return node;
+}
+
+inline size_t OctreeReader::findVoxel(uint_fast32_t x, uint_fast32_t y, uint_fast32_t z) const{
+	if (x >= info.gridlength || y >= info.gridlength || z >= info.gridlength){
+		return OCTREE_NO_NODE;
+	}
+	return findVoxel(libmorton::morton3D_64_encode(x, y, z));
+}
+
+// Call f(x, y, z, leaf_index) for every filled voxel with min <= (x,y,z) <= max (size of min and max is ignored).
+// Only subtrees which overlap the box are visited, and voxels are reported in morton order.
+template <typename F>
+inline void OctreeReader::forEachVoxelInBox(const OctreeCell &min, const OctreeCell &max, F f) const{
+	boxRecurse(root(), rootCell(), min, max, f);
+}
+
+template <typename F>
+inline void OctreeReader::boxRecurse(size_t node, const OctreeCell &cell, const OctreeCell &min, const OctreeCell &max, F &f) const{
+	if (cell.x > max.x || cell.y > max.y || cell.z > max.z ||
+		cell.x + cell.size - 1 < min.x || cell.y + cell.size - 1 < min.y || cell.z + cell.size - 1 < min.z){
+		return; // no overlap
+	}
+	if (cell.size == 1){
+		f(cell.x, cell.y, cell.z, node);
+		return;
+	}
+	for (unsigned int i = 0; i < 8; i++){
+		size_t child = getChild(node, i);
+		if (child != OCTREE_NO_NODE){
+			boxRecurse(child, childCell(cell, i), min, max, f);
+		}
+	}
+}
@@ -0,0 +1,535 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "octree_io.h"
+#include "OctreeReader.h"
+
+// Default number of sibling group levels stored together in the subtree node order
+#define RELAYOUT_SUBTREE_LEVELS 3
+
+// Default size of a page in the paged node order, in bytes
+#define OCTREE_PAGE_SIZE (64 * 1024)
+
+// Size of the output buffers, in bytes
+#define RELAYOUT_BUFFERSIZE (8 * 1024 * 1024)
+
+using namespace std;
+
+// A group of siblings: all existing children of one node, which are always stored next to eachother in child order
+struct NodeGroup{
+	size_t first; // index of the first node in the group
+	size_t count; // number of nodes in the group (0 if there is no group)
+};
+
+// Find the sibling group which holds the children of a node
+inline NodeGroup findChildGroup(const OctreeReader &in, size_t node){
+	NodeGroup g;
+	g.first = 0; g.count = 0;
+	for (unsigned int i = 0; i < 8; i++){
+		size_t child = in.getChild(node, i);
+		if (child != OCTREE_NO_NODE){
+			if (g.count == 0){
+				g.first = child;
+			}
+			g.count++;
+		}
+	}
+	return g;
+}
+
+// Rewrites an octree in a top-down node order, out-of-core.
+// The tree is cut in subtrees of a few sibling group levels. Each subtree is stored contiguously (breadth-first inside),
+// and the subtrees themselves are stored breadth-first. With one level per subtree this is plain breadth-first order.
+// The input files are memory mapped, and the queue of subtrees still to write goes to a temporary file,
+// so memory use only depends on the buffer sizes and the subtree size, not on the size of the octree.
+class OctreeRelayout{
+public:
+	OctreeRelayout(const OctreeReader &in, OctreeNodeOrder order, int subtree_levels = RELAYOUT_SUBTREE_LEVELS, bool async_io = false);
+	bool run(const std::string &out_base_filename);
+
+private:
+	const OctreeReader &in;
+	OctreeNodeOrder order;
+	int levels; // sibling group levels per subtree
+	bool async_io;
+	BufferedWriter* node_out;
+	BufferedWriter* data_out; // only used when payloads are implicit (per_node layout), NULL otherwise
+
+	// the subtree we're writing: its sibling groups in breadth-first order, their depth, and the children of each node
+	vector<NodeGroup> groups;
+	vector<int> depths;
+	vector<NodeGroup> children;
+	// scratch space to measure the size of a subtree
+	vector<NodeGroup> scratch_groups;
+	vector<int> scratch_depths;
+	vector<NodeGroup> scratch_children;
+
+	OctreeRelayout(const OctreeRelayout&);
+	OctreeRelayout& operator=(const OctreeRelayout&);
+	void collectSubtree(const NodeGroup &root, vector<NodeGroup> &g, vector<int> &d, vector<NodeGroup> &c) const;
+	size_t subtreeSize(const NodeGroup &root);
+	void writeRelocatedNode(size_t old_pos, size_t new_pos, const NodeGroup &old_children, size_t new_first_child);
+};
+
+inline OctreeRelayout::OctreeRelayout(const OctreeReader &in, OctreeNodeOrder order, int subtree_levels, bool async_io) :
+in(in), order(order), levels(subtree_levels), async_io(async_io), node_out(NULL), data_out(NULL){
+	if (order == ORDER_BREADTH_FIRST || levels < 1){
+		levels = 1;
+	}
+}
+
+// Collect the sibling groups of the subtree starting at a group, in breadth-first order
+inline void OctreeRelayout::collectSubtree(const NodeGroup &root, vector<NodeGroup> &g, vector<int> &d, vector<NodeGroup> &c) const{
+	g.clear(); d.clear(); c.clear();
+	g.push_back(root);
+	d.push_back(0);
+	for (size_t j = 0; j < g.size(); j++){
+		for (size_t t = 0; t < g[j].count; t++){
+			NodeGroup cg = findChildGroup(in, g[j].first + t);
+			c.push_back(cg);
+			if (cg.count > 0 && d[j] < levels - 1){
+				g.push_back(cg);
+				d.push_back(d[j] + 1);
+			}
+		}
+	}
+}
+
+// Number of nodes in the subtree starting at a group
+inline size_t OctreeRelayout::subtreeSize(const NodeGroup &root){
+	if (levels == 1){
+		return root.count;
+	}
+	collectSubtree(root, scratch_groups, scratch_depths, scratch_children);
+	size_t size = 0;
+	for (size_t j = 0; j < scratch_groups.size(); j++){
+		size += scratch_groups[j].count;
+	}
+	return size;
+}
+
+// Write a copy of a node with its child pointer moved to the new layout
+inline void OctreeRelayout::writeRelocatedNode(size_t old_pos, size_t new_pos, const NodeGroup &old_children, size_t new_first_child){
+	if (in.nodeSize() == COMPACTNODE_SIZE){
+		CompactNode n;
+		memcpy(&n.bits, in.nodeAddress(old_pos), COMPACTNODE_SIZE);
+		::uint64_t child_pointer = 0;
+		if (old_children.count > 0){
+			child_pointer = new_first_child - new_pos; // children are always written after their parent
+			if (child_pointer > COMPACTNODE_MAX_POINTER){
+				cout << "Error: child pointer " << child_pointer << " does not fit in a compact node. Use the regular node format." << endl;
+				exit(1);
+			}
+		}
+		n.bits = (n.bits & 0x1FFFF) | (child_pointer << 24); // keep masks and data flag
+		node_out->write(&n.bits);
+		if (data_out != NULL){ // payloads follow the nodes
+			data_out->write(in.dataAddress(old_pos + 1));
+		}
+	}
+	else {
+		Node n;
+		memcpy(&n.data, in.nodeAddress(old_pos), NODE_SIZE);
+		if (old_children.count > 0){
+			for (int k = 0; k < 8; k++){
+				if (n.hasChild(k)){
+					n.children_offset[k] = (char)(n.getChildPos(k) - old_children.first);
+				}
+			}
+			n.children_base = new_first_child;
+		}
+		node_out->write(&n.data);
+	}
+}
+
+// Write the relaid out octree to out_base_filename(.octree/.octreenodes/.octreedata)
+// Returns false if the output files could not be written completely.
+inline bool OctreeRelayout::run(const std::string &out_base_filename){
+	node_out = new BufferedWriter(out_base_filename + string(".octreenodes"), in.nodeSize(), RELAYOUT_BUFFERSIZE, async_io);
+	bool ok = true;
+	bool implicit_data = (in.info.data_layout == DATA_PER_NODE);
+	if (implicit_data){
+		data_out = new BufferedWriter(out_base_filename + string(".octreedata"), in.dataSize(), RELAYOUT_BUFFERSIZE, async_io);
+		data_out->write(in.dataAddress(0)); // NULL payload
+	}
+	else { // nodes keep pointing at the same payloads
+		ok = copy_file(in.info.base_filename + string(".octreedata"), out_base_filename + string(".octreedata"));
+	}
+
+	// the queue of subtrees to write, for the current and the next level of subtrees
+	string queue_filenames[2] = { out_base_filename + string("_relayout0.tmp"), out_base_filename + string("_relayout1.tmp") };
+	NodeGroup root;
+	root.first = in.root(); root.count = 1;
+	BufferedWriter* queue_out = new BufferedWriter(queue_filenames[0], sizeof(NodeGroup), sizeof(NodeGroup), false);
+	queue_out->write(&root);
+	delete queue_out;
+	size_t n_queued = 1;
+	size_t next_subtree_pos = subtreeSize(root); // where the next subtree we discover will go
+
+	vector<size_t> group_pos;
+	vector<char> queue_buffer(RELAYOUT_BUFFERSIZE);
+	int current = 0;
+	while (n_queued > 0){
+		FILE* queue_in = fopen(queue_filenames[current].c_str(), "rb");
+		if (queue_in == NULL){
+			cout << "Error: could not read the subtree queue " << queue_filenames[current] << endl;
+			exit(1);
+		}
+		setvbuf(queue_in, &queue_buffer[0], _IOFBF, queue_buffer.size());
+		queue_out = new BufferedWriter(queue_filenames[1 - current], sizeof(NodeGroup), RELAYOUT_BUFFERSIZE, async_io);
+		size_t n_next = 0;
+		for (size_t q = 0; q < n_queued; q++){
+			NodeGroup subtree_root;
+			if (fread(&subtree_root, sizeof(NodeGroup), 1, queue_in) != 1){
+				cout << "Error: the subtree queue " << queue_filenames[current] << " ends early (disk full?)" << endl;
+				exit(1);
+			}
+			collectSubtree(subtree_root, groups, depths, children);
+			// position of every group of this subtree in the new file
+			group_pos.resize(groups.size());
+			size_t pos = node_out->n_records;
+			for (size_t j = 0; j < groups.size(); j++){
+				group_pos[j] = pos;
+				pos += groups[j].count;
+			}
+			// write nodes: children are either in this subtree, or the root of a subtree in the next level
+			size_t next_group = 1;
+			size_t c = 0;
+			for (size_t j = 0; j < groups.size(); j++){
+				for (size_t t = 0; t < groups[j].count; t++, c++){
+					size_t new_first_child = 0;
+					if (children[c].count > 0){
+						if (depths[j] < levels - 1){
+							new_first_child = group_pos[next_group++];
+						}
+						else {
+							new_first_child = next_subtree_pos;
+							next_subtree_pos += subtreeSize(children[c]);
+							queue_out->write(&children[c]);
+							n_next++;
+						}
+					}
+					writeRelocatedNode(groups[j].first + t, group_pos[j] + t, children[c], new_first_child);
+				}
+			}
+		}
+		fclose(queue_in);
+		delete queue_out;
+		n_queued = n_next;
+		current = 1 - current;
+	}
+	remove(queue_filenames[0].c_str());
+	remove(queue_filenames[1].c_str());
+
+	OctreeInfo out_info = in.info;
+	out_info.base_filename = out_base_filename;
+	out_info.node_order = order;
+	if (implicit_data){
+		out_info.n_data = data_out->n_records;
+		ok = data_out->close() && ok;
+	}
+	out_info.n_nodes = node_out->n_records;
+	ok = node_out->close() && ok;
+	ok = writeOctreeHeader(out_base_filename + string(".octree"), out_info) && ok;
+	delete node_out; node_out = NULL;
+	delete data_out; data_out = NULL;
+	return ok;
+}
+
+// Rewrites an octree (with compact nodes) in the paged node order, out-of-core.
+// Nodes are grouped in fixed-size pages. Each page is filled breadth-first with a connected subtree, and when a
+// sibling group doesn't fit anymore, it becomes the root of a subtree in a later page. Links to other pages go through
+// the page table (.octreepagetable): the far child pointer of a node is an index in that table, which holds the
+// index of the first node of the linked sibling group. A page index (.octreepages) lists the pages.
+// For postorder input, subtree sizes are known, so whole subtrees which fit in the remaining space of a page are
+// packed into it as well, instead of getting a mostly empty page of their own.
+class OctreePager{
+public:
+	OctreePager(const OctreeReader &in, size_t page_size = OCTREE_PAGE_SIZE, bool async_io = false);
+	bool run(const std::string &out_base_filename);
+
+private:
+	// A subtree which still has to be placed in a page
+	struct QueueEntry{
+		NodeGroup group; // root sibling group of the subtree
+		::uint64_t parent_page; // page of the node which links to it
+	};
+
+	const OctreeReader &in;
+	size_t page_nodes; // number of nodes in a page
+	bool async_io;
+	bool known_sizes; // can we compute subtree sizes? (only for postorder input)
+	BufferedWriter* node_out;
+	BufferedWriter* data_out; // only used when payloads are implicit (per_node layout), NULL otherwise
+	BufferedWriter* table_out;
+	size_t n_links;
+
+	// queue of subtrees still to place: we read one file while the next generation of subtrees goes to the other
+	string queue_filenames[2];
+	int queue_current;
+	FILE* queue_in;
+	BufferedWriter* queue_out;
+	size_t queue_remaining; // entries left in queue_in
+	size_t queue_written; // entries written to queue_out
+	vector<char> queue_buffer;
+
+	// the subtree we're placing: its sibling groups in breadth-first order, and whether their whole subtree fits in this page
+	vector<NodeGroup> groups;
+	vector<bool> whole;
+
+	OctreePager(const OctreePager&);
+	OctreePager& operator=(const OctreePager&);
+	bool nextQueueEntry(QueueEntry &e);
+	size_t subtreeSize(const NodeGroup &g) const;
+	void placeSubtree(const NodeGroup &root, size_t page, size_t page_start, size_t &reserved, size_t &allocated);
+	void writePagedNode(size_t old_pos, ::uint64_t child_pointer, bool far);
+};
+
+inline OctreePager::OctreePager(const OctreeReader &in, size_t page_size, bool async_io) :
+in(in), async_io(async_io), node_out(NULL), data_out(NULL), table_out(NULL), n_links(0),
+queue_current(0), queue_in(NULL), queue_out(NULL), queue_remaining(0), queue_written(0){
+	page_nodes = std::max(page_size / in.nodeSize(), (size_t) 8); // a page must hold at least one sibling group
+	known_sizes = (in.info.node_order == ORDER_POSTORDER);
+}
+
+// Number of nodes in the subtree below (and including) a sibling group, or SIZE_MAX if we can't know.
+// In postorder files, the subtree of a group is stored contiguously, ending with the group itself,
+// and starting with the first group we find by following the first child which has children.
+inline size_t OctreePager::subtreeSize(const NodeGroup &g) const{
+	if (!known_sizes){
+		return static_cast<size_t>(-1);
+	}
+	NodeGroup current = g;
+	bool descended = true;
+	while (descended){
+		descended = false;
+		for (size_t t = 0; t < current.count && !descended; t++){
+			NodeGroup c = findChildGroup(in, current.first + t);
+			if (c.count > 0){
+				current = c;
+				descended = true;
+			}
+		}
+	}
+	return g.first + g.count - current.first;
+}
+
+// Get the next subtree to place, return false if there are none left
+inline bool OctreePager::nextQueueEntry(QueueEntry &e){
+	if (queue_remaining == 0){
+		if (queue_written == 0){
+			return false;
+		}
+		// switch to the next generation of subtrees
+		if (queue_in != NULL){
+			fclose(queue_in);
+		}
+		delete queue_out;
+		queue_current = 1 - queue_current;
+		queue_in = fopen(queue_filenames[queue_current].c_str(), "rb");
+		if (queue_in == NULL){
+			cout << "Error: could not read the subtree queue " << queue_filenames[queue_current] << endl;
+			exit(1);
+		}
+		setvbuf(queue_in, &queue_buffer[0], _IOFBF, queue_buffer.size());
+		queue_out = new BufferedWriter(queue_filenames[1 - queue_current], sizeof(QueueEntry), RELAYOUT_BUFFERSIZE, async_io);
+		queue_remaining = queue_written;
+		queue_written = 0;
+	}
+	if (fread(&e, sizeof(QueueEntry), 1, queue_in) != 1){
+		cout << "Error: the subtree queue " << queue_filenames[queue_current] << " ends early (disk full?)" << endl;
+		exit(1);
+	}
+	queue_remaining--;
+	return true;
+}
+
+// Write a copy of a node with a new child pointer
+inline void OctreePager::writePagedNode(size_t old_pos, ::uint64_t child_pointer, bool far){
+	CompactNode n;
+	memcpy(&n.bits, in.nodeAddress(old_pos), COMPACTNODE_SIZE);
+	if (child_pointer > COMPACTNODE_MAX_POINTER){
+		cout << "Error: child pointer " << child_pointer << " does not fit in a compact node." << endl;
+		exit(1);
+	}
+	n.bits = (n.bits & 0x1FFFF) | (far ? COMPACTNODE_FAR_FLAG : 0) | (child_pointer << 24); // keep masks and data flag
+	node_out->write(&n.bits);
+	if (data_out != NULL){ // payloads follow the nodes
+		data_out->write(in.dataAddress(old_pos + 1));
+	}
+}
+
+// Place the subtree below a sibling group in the current page, breadth-first, as far as it fits
+inline void OctreePager::placeSubtree(const NodeGroup &root, size_t page, size_t page_start, size_t &reserved, size_t &allocated){
+	groups.clear(); whole.clear();
+	size_t size = subtreeSize(root);
+	bool root_whole = (size <= page_nodes - reserved);
+	reserved += root_whole ? size : root.count;
+	groups.push_back(root);
+	whole.push_back(root_whole);
+	allocated += root.count;
+	for (size_t j = 0; j < groups.size(); j++){
+		for (size_t t = 0; t < groups[j].count; t++){
+			size_t own_pos = node_out->n_records;
+			NodeGroup c = findChildGroup(in, groups[j].first + t);
+			if (c.count == 0){ // leaf
+				writePagedNode(groups[j].first + t, 0, false);
+				continue;
+			}
+			bool child_whole = whole[j]; // space for the whole subtree was already reserved
+			bool fits = child_whole;
+			if (!fits){
+				size_t child_size = subtreeSize(c);
+				if (child_size <= page_nodes - reserved){
+					reserved += child_size;
+					child_whole = true;
+					fits = true;
+				}
+				else if (c.count <= page_nodes - reserved){
+					reserved += c.count;
+					fits = true;
+				}
+			}
+			if (fits){ // children go in this page
+				writePagedNode(groups[j].first + t, (page_start + allocated) - own_pos, false);
+				groups.push_back(c);
+				whole.push_back(child_whole);
+				allocated += c.count;
+			}
+			else { // children become the root of a subtree in another page
+				QueueEntry e;
+				e.group = c;
+				e.parent_page = page;
+				queue_out->write(&e);
+				queue_written++;
+				writePagedNode(groups[j].first + t, n_links, true);
+				n_links++;
+			}
+		}
+	}
+}
+
+// Write the paged octree to out_base_filename(.octree/.octreenodes/.octreedata/.octreepagetable/.octreepages)
+// Returns false if the output files could not be written completely.
+inline bool OctreePager::run(const std::string &out_base_filename){
+	if (in.nodeSize() != COMPACTNODE_SIZE){
+		cout << "Error: paged octrees need compact nodes." << endl;
+		exit(1);
+	}
+	node_out = new BufferedWriter(out_base_filename + string(".octreenodes"), COMPACTNODE_SIZE, RELAYOUT_BUFFERSIZE, async_io);
+	table_out = new BufferedWriter(out_base_filename + string(".octreepagetable"), sizeof(::uint64_t), RELAYOUT_BUFFERSIZE, async_io);
+	BufferedWriter index_out(out_base_filename + string(".octreepages"), PAGEINFO_SIZE, RELAYOUT_BUFFERSIZE, false);
+	bool ok = true;
+	bool implicit_data = (in.info.data_layout == DATA_PER_NODE);
+	if (implicit_data){
+		data_out = new BufferedWriter(out_base_filename + string(".octreedata"), in.dataSize(), RELAYOUT_BUFFERSIZE, async_io);
+		data_out->write(in.dataAddress(0)); // NULL payload
+	}
+	else { // nodes keep pointing at the same payloads
+		ok = copy_file(in.info.base_filename + string(".octreedata"), out_base_filename + string(".octreedata"));
+	}
+	queue_filenames[0] = out_base_filename + string("_pages0.tmp");
+	queue_filenames[1] = out_base_filename + string("_pages1.tmp");
+	queue_buffer.resize(RELAYOUT_BUFFERSIZE);
+	queue_current = 0;
+	queue_out = new BufferedWriter(queue_filenames[1], sizeof(QueueEntry), RELAYOUT_BUFFERSIZE, async_io);
+
+	QueueEntry entry;
+	entry.group.first = in.root(); entry.group.count = 1;
+	entry.parent_page = PAGE_NO_PARENT;
+	bool have_entry = true;
+	bool linked = false; // the root isn't linked from the page table
+	size_t page = 0;
+	::uint64_t empty_node = 0;
+	while (have_entry){
+		size_t page_start = page * page_nodes;
+		size_t reserved = 0; // nodes of this page which are spoken for
+		size_t allocated = 0; // nodes of this page which have a position
+		PageInfo page_info;
+		page_info.first_node = page_start;
+		page_info.n_subtrees = 0;
+		page_info.parent_page = entry.parent_page;
+		// first subtree goes in as far as it fits, then we add following subtrees as long as they fit completely
+		// (if we don't know subtree sizes, as long as their root group fits: otherwise small subtrees would waste whole pages)
+		do {
+			if (linked){
+				::uint64_t first_node = page_start + allocated;
+				table_out->write(&first_node);
+			}
+			placeSubtree(entry.group, page, page_start, reserved, allocated);
+			page_info.n_subtrees++;
+			have_entry = nextQueueEntry(entry);
+			linked = true;
+		} while (have_entry && (known_sizes ? subtreeSize(entry.group) : entry.group.count) <= page_nodes - reserved);
+		page_info.n_nodes = static_cast<::uint32_t>(node_out->n_records - page_start);
+		// pad page
+		while (node_out->n_records < page_start + page_nodes){
+			node_out->write(&empty_node);
+			if (data_out != NULL){
+				data_out->write(in.dataAddress(0));
+			}
+		}
+		index_out.write(&page_info);
+		page++;
+	}
+	if (queue_in != NULL){
+		fclose(queue_in);
+	}
+	delete queue_out; queue_out = NULL;
+	remove(queue_filenames[0].c_str());
+	remove(queue_filenames[1].c_str());
+
+	OctreeInfo out_info = in.info;
+	out_info.base_filename = out_base_filename;
+	out_info.node_order = ORDER_PAGED;
+	out_info.page_size = page_nodes * COMPACTNODE_SIZE;
+	out_info.n_pages = page;
+	out_info.n_page_links = n_links;
+	if (implicit_data){
+		out_info.n_data = data_out->n_records;
+		ok = data_out->close() && ok;
+	}
+	out_info.n_nodes = node_out->n_records;
+	ok = node_out->close() && ok;
+	ok = table_out->close() && ok;
+	ok = index_out.close() && ok;
+	ok = writeOctreeHeader(out_base_filename + string(".octree"), out_info) && ok;
+	delete node_out; node_out = NULL;
+	delete data_out; data_out = NULL;
+	delete table_out; table_out = NULL;
+	return ok;
+}
+
+// Relayout the octree base_filename(.octree/.octreenodes/.octreedata) in place:
+// the reordered files are written next to the old ones, and only replace them once they were written completely.
+// Returns false if the octree could not be reordered (the old octree is kept, if possible).
+inline bool relayoutOctreeFiles(const std::string &base_filename, OctreeNodeOrder order, bool async_io){
+	string tmp_base_filename = base_filename + string("_relayout");
+	bool written;
+	{
+		OctreeReader reader;
+		if (!reader.open(base_filename + string(".octree"))){
+			cout << "Could not open octree " << base_filename << ".octree for reordering." << endl;
+			exit(1);
+		}
+		if (order == ORDER_PAGED){
+			OctreePager pager(reader, OCTREE_PAGE_SIZE, async_io);
+			written = pager.run(tmp_base_filename);
+		}
+		else {
+			OctreeRelayout relayout(reader, order, RELAYOUT_SUBTREE_LEVELS, async_io);
+			written = relayout.run(tmp_base_filename);
+		}
+	} // input files are unmapped here, so we can replace them
+	if (!written){
+		cout << "Could not write the reordered octree, keeping " << base_filename << ".octree in postorder." << endl;
+		const char* extensions[5] = { ".octree", ".octreenodes", ".octreedata", ".octreepagetable", ".octreepages" };
+		for (int e = 0; e < 5; e++){
+			remove((tmp_base_filename + string(extensions[e])).c_str());
+		}
+		return false;
+	}
+	return replaceOctreeFiles(tmp_base_filename, base_filename);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "../libs/libtri/include/tri_tools.h"
+#include "../libs/libtri/include/trip_tools.h"
+#include "../libs/libtri/include/TriReader.h"
+#include "../libs/libmorton/include/morton.h"
+#include "../libs/libmorton/include/morton_box.h"
+#include "intersection.h"
+#include "OctreeRelayout.h"
+#include "OctreeBuilder.h"
+
+using namespace std;
+
+// Incremental updates: only the partitions which overlap a changed region of the model are voxelized again,
+// the subtrees of all other partitions are copied from the previous octree.
+// All boxes are in model coordinates (the coordinates of the original mesh, before tri_convert moved it).
+
+// Read dirty regions from a text file, one box per line: min_x min_y min_z max_x max_y max_z (blank lines are skipped).
+// A line which isn't a box fails the whole file: the regions after it would silently be taken as unchanged.
+inline bool readDirtyBoxes(const string &filename, vector< AABox<vec3> > &boxes){
+	ifstream file(filename.c_str());
+	if (!file){
+		return false;
+	}
+	string line;
+	size_t line_number = 0;
+	while (getline(file, line)){
+		line_number++;
+		if (line.find_first_not_of(" \t\r") == string::npos){
+			continue;
+		}
+		stringstream s(line);
+		AABox<vec3> box;
+		string rest;
+		if (!(s >> box.min[0] >> box.min[1] >> box.min[2] >> box.max[0] >> box.max[1] >> box.max[2]) || (s >> rest)){
+			cout << "Line " << line_number << " of " << filename << " is not a box (min_x min_y min_z max_x max_y max_z): " << line << endl;
+			return false;
+		}
+		boxes.push_back(box);
+	}
+	return file.eof();
+}
+
+// Add the bounding box of every triangle of a (converted) delta mesh: the triangles which were removed, added or changed
+inline void readDeltaBoxes(const TriInfo &delta_info, size_t buffersize, vector< AABox<vec3> > &boxes){
+	TriReader reader(delta_info.base_filename + string(".tridata"), delta_info.n_triangles, std::min(delta_info.n_triangles, buffersize));
+	while (reader.hasNext()){
+		Triangle t;
+		reader.getTriangle(t);
+		AABox<vec3> box = computeBoundingBox(t.v0, t.v1, t.v2);
+		box.min += delta_info.mesh_bbox.min; // tri_convert moved the delta mesh to the origin
+		box.max += delta_info.mesh_bbox.min;
+		boxes.push_back(box);
+	}
+}
+
+// Find the partitions which overlap one of the boxes (grown by one voxel, because voxelization is conservative)
+inline vector<bool> findDirtyPartitions(const vector< AABox<vec3> > &boxes, const TripInfo &trip_info){
+	vector<bool> dirty(trip_info.n_partitions, false);
+	size_t part_side = trip_info.gridsize;
+	for (size_t p = 1; p < trip_info.n_partitions; p *= 8){
+		part_side = part_side / 2;
+	}
+	float unitlength = (trip_info.mesh_bbox.max[0] - trip_info.mesh_bbox.min[0]) / (float)trip_info.gridsize;
+	for (size_t b = 0; b < boxes.size(); b++){
+		uint_fast32_t part_min[3], part_max[3];
+		bool outside = false;
+		for (int k = 0; k < 3; k++){
+			float grid_min = floor((boxes[b].min[k] - trip_info.mesh_bbox.min[k]) / unitlength) - 1.0f;
+			float grid_max = floor((boxes[b].max[k] - trip_info.mesh_bbox.min[k]) / unitlength) + 1.0f;
+			if (grid_max < 0.0f || grid_min >= (float)trip_info.gridsize){
+				outside = true;
+				break;
+			}
+			part_min[k] = static_cast<uint_fast32_t>(clampval<float>(grid_min, 0.0f, (float)(trip_info.gridsize - 1))) / part_side;
+			part_max[k] = static_cast<uint_fast32_t>(clampval<float>(grid_max, 0.0f, (float)(trip_info.gridsize - 1))) / part_side;
+		}
+		if (outside){
+			continue;
+		}
+		// partitions are numbered in morton order of their position in the grid of partitions,
+		// so the box of partitions is a list of runs of partition numbers
+		vector<libmorton::MortonRange> ranges;
+		libmorton::morton3D_64_box_ranges(part_min, part_max, ranges);
+		for (size_t r = 0; r < ranges.size(); r++){
+			std::fill(dirty.begin() + static_cast<size_t>(ranges[r].first), dirty.begin() + static_cast<size_t>(ranges[r].last) + 1, true);
+		}
+	}
+	return dirty;
+}
+
+// Describe the subtree of an existing (postorder) octree which covers an aligned cube, so it can be added to a new octree.
+// Returns false if that part of the old octree is empty.
+inline bool findOldSubtree(const OctreeReader &old, ::uint64_t morton_start, size_t side, size_t data_header, OctreeSegment &segment){
+	// walk down to the root of the cube
+	size_t node = old.root();
+	int side_level = log2(static_cast<unsigned int>(side));
+	for (int level = old.maxdepth - 1; level >= side_level; level--){
+		node = old.getChild(node, static_cast<unsigned int>((morton_start >> (3 * level)) & 7));
+		if (node == OCTREE_NO_NODE){
+			return false;
+		}
+	}
+
+	// root node, with its children at their position in the old octree
+	Node root;
+	NodeGroup children = findChildGroup(old, node);
+	root.children_base = children.first;
+	for (unsigned int i = 0; i < 8; i++){
+		size_t child = old.getChild(node, i);
+		if (child != OCTREE_NO_NODE){
+			root.children_offset[i] = static_cast<char>(child - children.first);
+			if (old.isLeaf(child)){
+				root.leaf_mask |= (1 << i);
+			}
+		}
+	}
+	size_t root_data = old.getDataPos(node);
+	root.data = (old.info.version >= OCTREE_VERSION_COMPACT) ? (root_data != NODATA) : root_data;
+	old.getData(node, root.data_cache);
+
+	// all nodes below the root form one range in postorder, which ends with the root's children and starts with
+	// the children of the node we find by always going to the first child which has children of its own
+	size_t first = node;
+	while (true){
+		size_t next = OCTREE_NO_NODE;
+		for (unsigned int i = 0; i < 8 && next == OCTREE_NO_NODE; i++){
+			size_t child = old.getChild(first, i);
+			if (child != OCTREE_NO_NODE && !old.isLeaf(child)){
+				next = child;
+			}
+		}
+		if (next == OCTREE_NO_NODE){
+			break;
+		}
+		first = next;
+	}
+	segment.base_filename = old.info.base_filename;
+	segment.root = root;
+	segment.first_node = findChildGroup(old, first).first;
+	segment.n_nodes = children.first + children.count - segment.first_node;
+	segment.morton_start = morton_start;
+	segment.gridlength = side;
+	segment.temporary = false;
+
+	// payloads used by the subtree
+	segment.first_data = data_header;
+	segment.n_data = 0;
+	if (old.info.data_layout == DATA_PER_NODE){
+		segment.first_data = segment.first_node + 1;
+		segment.n_data = segment.n_nodes;
+	}
+	else if (old.info.data_layout == DATA_EXPLICIT){
+		size_t data_min = (root_data >= data_header) ? root_data : old.info.n_data;
+		size_t data_max = (root_data >= data_header) ? root_data : 0;
+		for (size_t n = segment.first_node; n < segment.first_node + segment.n_nodes; n++){
+			size_t d = old.getDataPos(n);
+			if (d >= data_header){
+				data_min = std::min(data_min, d);
+				data_max = std::max(data_max, d);
+			}
+		}
+		if (data_min <= data_max){
+			segment.first_data = data_min;
+			segment.n_data = data_max - data_min + 1;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include "voxelizer.h"
+#include "OctreeBuilder.h"
+
+using namespace std;
+
+// Feeding the voxels of a voxelized partition to a builder. svo_builder and svo_bench both do it this way,
+// so the benchmark measures the same work as the builder.
+
+// Put the voxels of a partition in morton order, which is the order the builder takes them in
+inline void sortPartitionVoxels(VoxelList &data){
+	sort(data.begin(), data.end());
+}
+
+// Add the (sorted) voxel list of a partition
+inline void addPartitionVoxels(OctreeBuilder &builder, const VoxelList &data){
+	if (!data.empty()){ // a partition is an aligned cube, so all of it goes in one call
+		builder.addVoxels(&data[0], data.size());
+	}
+}
+
+#ifdef BINARY_VOXELIZATION
+// Add the voxels set in the voxel array of the partition of n voxels starting at morton code start
+// (when its voxel list overflowed)
+inline void addPartitionGrid(OctreeBuilder &builder, const char* voxels, ::uint64_t start, ::uint64_t n){
+	for (::uint64_t j = 0; j < n; j++){
+		if (voxels[j] != EMPTY_VOXEL){
+			builder.addVoxel(start + j);
+		}
+	}
+}
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include "VoxelData.h"
+#include "octree_io.h"
+#include "MemoryTracker.h"
+
+using namespace std;
+
+// Number of slots we look at before giving up on finding a key / a free slot
+#define PAYLOADTABLE_PROBES 8
+
+// A lookup key of N 64-bit words
+template <int N>
+struct TableKey{
+	::uint64_t words[N];
+
+	bool operator==(const TableKey &k) const{
+		for (int i = 0; i < N; i++){
+			if (words[i] != k.words[i]) { return false; }
+		}
+		return true;
+	}
+};
+
+// The part of a payload that gets compared for deduplication (everything except the morton code)
+typedef TableKey<3> PayloadKey;
+
+// A group of sibling nodes, as compared for subtree deduplication (one word per child slot, see OctreeBuilder::makeGroupKey)
+typedef TableKey<8> NodeGroupKey;
+
+// Build the deduplication key for a payload: quantized formats compare the quantized bits, the full format compares the floats bitwise
+inline PayloadKey makePayloadKey(const VoxelData &v, OctreeDataFormat format){
+	PayloadKey key;
+	memset(key.words, 0, sizeof(key.words));
+	if (format == DATA_FULL){
+		memcpy(&key.words[0], &v.color[0], 3 * sizeof(float));
+		memcpy(reinterpret_cast<char*>(key.words) + 3 * sizeof(float), &v.normal[0], 3 * sizeof(float));
+	}
+	else {
+		QuantizedVoxelData q(v);
+		memcpy(&key.words[0], &q.color, QUANTIZEDVOXELDATA_SIZE);
+	}
+	return key;
+}
+
+// A bounded hash table which maps keys to the index they were written at in an output file.
+// The table never grows: when all probed slots are taken, the oldest candidate is overwritten.
+// That way a full table just finds fewer duplicates, instead of using more memory.
+template <typename Key>
+class DedupTable{
+public:
+	size_t n_lookups; // number of keys we were asked to find
+	size_t n_hits; // number of keys we found
+	size_t n_evictions; // number of entries we had to overwrite
+
+	DedupTable(size_t capacity);
+	bool find(const Key &key, size_t &pos);
+	void insert(const Key &key, size_t pos);
+
+private:
+	struct Entry{
+		Key key;
+		size_t pos; // 0 means empty slot (callers never store position 0)
+	};
+	vector<Entry, TrackingAllocator<Entry, MEM_DEDUP_TABLES> > entries;
+	size_t mask;
+
+	size_t hash(const Key &key) const;
+};
+
+// Table of written payloads (the NULL payload at position 0 is never deduplicated)
+typedef DedupTable<PayloadKey> PayloadTable;
+
+// Table of written sibling groups, by position of their first node + 1
+typedef DedupTable<NodeGroupKey> NodeGroupTable;
+
+// Create a table, capacity is rounded up to a power of 2
+template <typename Key>
+inline DedupTable<Key>::DedupTable(size_t capacity) : n_lookups(0), n_hits(0), n_evictions(0){
+	size_t size = 1;
+	while (size < capacity){
+		size <<= 1;
+	}
+	Entry empty;
+	memset(&empty, 0, sizeof(Entry));
+	entries.resize(size, empty);
+	mask = size - 1;
+}
+
+// 64-bit mixing hash over the key words
+template <typename Key>
+inline size_t DedupTable<Key>::hash(const Key &key) const{
+	::uint64_t h = 0x9E3779B97F4A7C15ULL;
+	for (size_t i = 0; i < sizeof(key.words) / sizeof(key.words[0]); i++){
+		h ^= key.words[i];
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+	}
+	return static_cast<size_t>(h);
+}
+
+// Look up a key, return true and its position if we've already written it
+template <typename Key>
+inline bool DedupTable<Key>::find(const Key &key, size_t &pos){
+	n_lookups++;
+	size_t home = hash(key);
+	for (size_t i = 0; i < PAYLOADTABLE_PROBES; i++){
+		const Entry &e = entries[(home + i) & mask];
+		if (e.pos == 0){
+			return false; // empty slot: key can't be further down
+		}
+		if (e.key == key){
+			pos = e.pos;
+			n_hits++;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Remember a key we've just written
+template <typename Key>
+inline void DedupTable<Key>::insert(const Key &key, size_t pos){
+	size_t home = hash(key);
+	size_t oldest = home & mask;
+	for (size_t i = 0; i < PAYLOADTABLE_PROBES; i++){
+		Entry &e = entries[(home + i) & mask];
+		if (e.pos == 0){
+			e.key = key;
+			e.pos = pos;
+			return;
+		}
+		if (e.pos < entries[oldest].pos){
+			oldest = (home + i) & mask;
+		}
+	}
+	// no free slot: overwrite the oldest entry in our probe window
+	entries[oldest].key = key;
+	entries[oldest].pos = pos;
+	n_evictions++;
+}
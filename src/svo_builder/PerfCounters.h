@@ -0,0 +1,235 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Hardware performance counters (Linux perf_event_open) per stage: instructions, cycles, cache misses and branch misses.
+// Switched on with -perf. Every thread opens its own counters (user space only) the first time it enters a stage,
+// and adds what it counted in the stage to the stage's totals. When the counters can't be opened (no permission, no PMU
+// in a virtual machine, not Linux), stages do nothing, and we print why.
+// Stages nest like the profiler scopes they sit next to: the counts of "sorting" are part of "SVO building".
+
+enum PerfEvent { PERF_INSTRUCTIONS, PERF_CYCLES, PERF_CACHE_MISSES, PERF_BRANCH_MISSES };
+#define PERF_EVENT_COUNT 4
+static const char* const PERF_EVENT_NAMES[PERF_EVENT_COUNT] = { "instructions", "cycles", "cache misses", "branch misses" };
+
+// A reading of the counters of a thread: the count of every event, and how long it was enabled and actually counting
+// (shorter, when the kernel had to multiplex the counters)
+struct PerfReading{
+	bool valid[PERF_EVENT_COUNT]; // false for events we don't have
+	::uint64_t value[PERF_EVENT_COUNT];
+	::uint64_t time_enabled[PERF_EVENT_COUNT];
+	::uint64_t time_running[PERF_EVENT_COUNT];
+};
+
+// Counters of one thread
+class PerfThreadCounters{
+public:
+	PerfThreadCounters() : tried(false), leader(-1){
+		for (int e = 0; e < PERF_EVENT_COUNT; e++){ fds[e] = -1; }
+	}
+	~PerfThreadCounters(){
+		for (int e = 0; e < PERF_EVENT_COUNT; e++){
+#ifdef __linux__
+			if (fds[e] >= 0){ close(fds[e]); }
+#endif
+		}
+	}
+
+	// Open the counters of the calling thread (only tries once). Returns false and sets error if we can't count.
+	bool open(string &error){
+		if (tried){ return leader >= 0; }
+		tried = true;
+#ifdef __linux__
+		static const ::uint64_t configs[PERF_EVENT_COUNT] = { PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+		for (int e = 0; e < PERF_EVENT_COUNT; e++){
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[e];
+			attr.exclude_kernel = 1; // user space only: allowed with perf_event_paranoid up to 2
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			fds[e] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0)); // this thread, any cpu
+			if (fds[e] < 0 && e == 0){
+				error = string("perf_event_open: ") + strerror(errno);
+				if (errno == EACCES || errno == EPERM){ error += " (see /proc/sys/kernel/perf_event_paranoid)"; }
+				else if (errno == ENOENT || errno == EOPNOTSUPP){ error += " (no hardware counters, in a virtual machine?)"; }
+				return false;
+			}
+			if (e == 0){ leader = fds[0]; }
+			// the other events are optional: some PMUs (or virtual machines) don't have them
+		}
+		return true;
+#else
+		error = "hardware counters are only supported on Linux";
+		return false;
+#endif
+	}
+
+	void read(PerfReading &reading) const{
+		for (int e = 0; e < PERF_EVENT_COUNT; e++){
+			reading.valid[e] = false;
+#ifdef __linux__
+			::uint64_t data[3]; // value, time enabled, time running
+			if (fds[e] >= 0 && ::read(fds[e], data, sizeof(data)) == sizeof(data)){
+				reading.valid[e] = true;
+				reading.value[e] = data[0];
+				reading.time_enabled[e] = data[1];
+				reading.time_running[e] = data[2];
+			}
+#endif
+		}
+	}
+
+private:
+	bool tried;
+	int leader;
+	int fds[PERF_EVENT_COUNT];
+
+	PerfThreadCounters(const PerfThreadCounters&);
+	PerfThreadCounters& operator=(const PerfThreadCounters&);
+};
+
+// Counts of a stage, added up over all threads
+struct PerfStageCounts{
+	string name;
+	double values[PERF_EVENT_COUNT]; // -1 if we don't have the event
+	::uint64_t count; // how many times a thread went through the stage
+};
+
+class PerfCounters{
+public:
+	bool enabled; // -perf
+	bool available; // could the first thread open its counters?
+	string error;
+	vector<PerfStageCounts> stages; // in the order we first saw them
+	std::mutex mutex;
+
+	static PerfCounters& instance(){
+		static PerfCounters counters;
+		return counters;
+	}
+
+	static PerfThreadCounters& thread(){
+		static thread_local PerfThreadCounters counters; // closed when the thread ends
+		return counters;
+	}
+
+	// Switch counting on, if the counters work on this machine (otherwise say why, and all stages do nothing)
+	void enable(){
+		enabled = true;
+		available = thread().open(error);
+		if (!available){
+			cout << "Hardware counters unavailable, continuing without them: " << error << endl;
+		}
+	}
+
+	// Add what a thread counted between two readings to a stage (scaled up if the counters were multiplexed in between)
+	void add(const char* name, const PerfReading &start, const PerfReading &end){
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t s = 0;
+		while (s < stages.size() && stages[s].name != name){ s++; }
+		if (s == stages.size()){
+			PerfStageCounts c;
+			c.name = name;
+			for (int e = 0; e < PERF_EVENT_COUNT; e++){ c.values[e] = start.valid[e] ? 0.0 : -1.0; }
+			c.count = 0;
+			stages.push_back(c);
+		}
+		for (int e = 0; e < PERF_EVENT_COUNT; e++){
+			if (stages[s].values[e] < 0 || !start.valid[e] || !end.valid[e]){
+				continue;
+			}
+			::uint64_t running = end.time_running[e] - start.time_running[e];
+			if (running > 0){
+				double enabled = static_cast<double>(end.time_enabled[e] - start.time_enabled[e]);
+				stages[s].values[e] += static_cast<double>(end.value[e] - start.value[e]) * enabled / running;
+			}
+		}
+		stages[s].count++;
+	}
+
+	// Print a line per stage, with instructions per cycle and misses per 1000 instructions
+	void print(){
+		if (!enabled || !available){
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		char line[256];
+		sprintf(line, "%-24s %16s %16s %6s %14s %8s %14s %8s", "COUNTERS (all threads)", PERF_EVENT_NAMES[0], PERF_EVENT_NAMES[1], "IPC",
+			PERF_EVENT_NAMES[2], "MPKI", PERF_EVENT_NAMES[3], "MPKI");
+		cout << line << endl;
+		for (size_t s = 0; s < stages.size(); s++){
+			const double* v = stages[s].values;
+			string column[7];
+			column[0] = format(v[PERF_INSTRUCTIONS], "%.0f", 1.0);
+			column[1] = format(v[PERF_CYCLES], "%.0f", 1.0);
+			column[2] = (v[PERF_CYCLES] > 0 && v[PERF_INSTRUCTIONS] >= 0) ? format(v[PERF_INSTRUCTIONS] / v[PERF_CYCLES], "%.2f", 1.0) : "-";
+			column[3] = format(v[PERF_CACHE_MISSES], "%.0f", 1.0);
+			column[4] = (v[PERF_INSTRUCTIONS] > 0 && v[PERF_CACHE_MISSES] >= 0) ? format(v[PERF_CACHE_MISSES] / v[PERF_INSTRUCTIONS], "%.2f", 1000.0) : "-";
+			column[5] = format(v[PERF_BRANCH_MISSES], "%.0f", 1.0);
+			column[6] = (v[PERF_INSTRUCTIONS] > 0 && v[PERF_BRANCH_MISSES] >= 0) ? format(v[PERF_BRANCH_MISSES] / v[PERF_INSTRUCTIONS], "%.2f", 1000.0) : "-";
+			sprintf(line, "%-24s %16s %16s %6s %14s %8s %14s %8s", stages[s].name.c_str(), column[0].c_str(), column[1].c_str(), column[2].c_str(),
+				column[3].c_str(), column[4].c_str(), column[5].c_str(), column[6].c_str());
+			cout << line << endl;
+		}
+	}
+
+private:
+	PerfCounters() : enabled(false), available(false){}
+	PerfCounters(const PerfCounters&);
+	PerfCounters& operator=(const PerfCounters&);
+
+	static string format(double value, const char* fmt, double scale){
+		if (value < 0){ return "-"; }
+		char s[64];
+		sprintf(s, fmt, value * scale);
+		return s;
+	}
+};
+
+// Counts the lifetime of the object as (a part of) a stage, on the calling thread. Does nothing unless counting is on.
+class PerfStage{
+public:
+	inline PerfStage(const char* name) : name(name), counting(false){
+		PerfCounters &counters = PerfCounters::instance();
+		if (counters.enabled && counters.available){
+			string error;
+			counting = PerfCounters::thread().open(error);
+			if (counting){ PerfCounters::thread().read(start); }
+		}
+	}
+	inline ~PerfStage(){
+		if (counting){
+			PerfReading end;
+			PerfCounters::thread().read(end);
+			PerfCounters::instance().add(name, start, end);
+		}
+	}
+private:
+	const char* name;
+	bool counting;
+	PerfReading start;
+
+	PerfStage(const PerfStage&);
+	PerfStage& operator=(const PerfStage&);
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+#define PERF_STAGE(name) PerfStage PERF_CONCAT(perf_stage_, __LINE__)(name)
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Hierarchical profiler: code marks its stages and phases with PROFILE_SCOPE, which adds the time spent in that scope
+// (in nanoseconds, measured with steady_clock) to a tree of scopes. Every thread has its own tree, so scopes never
+// need a lock; the trees are merged when we print them. The time of a scope which isn't spent in one of its child
+// scopes is shown as its "self" time.
+//
+// Profiling is compiled out in release builds (NDEBUG), unless SVO_PROFILING is defined.
+
+#if !defined(SVO_PROFILING) && !defined(NDEBUG)
+#define SVO_PROFILING
+#endif
+
+// Profile the rest of the enclosing block as name (and index, for scopes like "partition 3")
+#ifdef SVO_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_SCOPE_INDEX(name, index) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name, static_cast<long long>(index))
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_SCOPE_INDEX(name, index)
+#endif
+
+#define PROFILE_NO_INDEX -1
+
+// A scope in the merged profile of all threads
+struct ProfileEntry{
+	string name;
+	long long index; // PROFILE_NO_INDEX if the scope has no index
+	::uint64_t total_ns; // time spent in this scope, added up over all threads
+	::uint64_t count; // how many times we entered this scope
+	vector<ProfileEntry> children;
+
+	ProfileEntry() : index(PROFILE_NO_INDEX), total_ns(0), count(0){}
+	ProfileEntry(const string &name, long long index) : name(name), index(index), total_ns(0), count(0){}
+
+	::uint64_t childrenNs() const;
+	ProfileEntry& child(const string &name, long long index);
+	const ProfileEntry* find(const string &name, long long index = PROFILE_NO_INDEX) const;
+	double milliseconds() const { return total_ns / 1000000.0; }
+};
+
+#ifdef SVO_PROFILING
+
+// The scope tree of one thread
+class ProfileThread{
+public:
+	struct Node{
+		const char* name;
+		long long index;
+		size_t parent;
+		::uint64_t total_ns;
+		::uint64_t count;
+		vector<size_t> children;
+	};
+	vector<Node> nodes; // node 0 is the root of the thread
+	size_t current; // the scope we're in
+
+	ProfileThread() : current(0){
+		Node root = { "", PROFILE_NO_INDEX, 0, 0, 0, vector<size_t>() };
+		nodes.push_back(root);
+	}
+
+	// Enter a child scope of the current scope, return its node
+	inline size_t enter(const char* name, long long index){
+		const vector<size_t> &children = nodes[current].children;
+		for (size_t i = 0; i < children.size(); i++){
+			const Node &n = nodes[children[i]];
+			if (n.index == index && (n.name == name || strcmp(n.name, name) == 0)){
+				current = children[i];
+				return current;
+			}
+		}
+		Node n = { name, index, current, 0, 0, vector<size_t>() };
+		nodes.push_back(n);
+		nodes[current].children.push_back(nodes.size() - 1);
+		current = nodes.size() - 1;
+		return current;
+	}
+
+	// Leave a scope we entered, after spending ns in it
+	inline void leave(size_t node, ::uint64_t ns){
+		nodes[node].total_ns += ns;
+		nodes[node].count++;
+		current = nodes[node].parent;
+	}
+
+	// The tree of the calling thread (created on first use, and kept until the program ends)
+	static ProfileThread& get();
+};
+
+// All thread trees, so we can merge them
+class ProfileRegistry{
+public:
+	static ProfileRegistry& instance(){
+		static ProfileRegistry registry;
+		return registry;
+	}
+	ProfileThread* add(){
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.push_back(new ProfileThread());
+		return threads.back();
+	}
+	vector<ProfileThread*> threads;
+	std::mutex mutex;
+};
+
+inline ProfileThread& ProfileThread::get(){
+	static thread_local ProfileThread* thread = NULL;
+	if (thread == NULL){
+		thread = ProfileRegistry::instance().add();
+	}
+	return *thread;
+}
+
+// Times the lifetime of the object as a scope
+class ProfileScope{
+public:
+	inline ProfileScope(const char* name, long long index = PROFILE_NO_INDEX) : thread(ProfileThread::get()){
+		node = thread.enter(name, index);
+		start = std::chrono::steady_clock::now();
+	}
+	inline ~ProfileScope(){
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		thread.leave(node, static_cast< ::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+	}
+private:
+	ProfileThread &thread;
+	size_t node;
+	std::chrono::steady_clock::time_point start;
+
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+};
+
+#endif
+
+inline ::uint64_t ProfileEntry::childrenNs() const{
+	::uint64_t ns = 0;
+	for (size_t i = 0; i < children.size(); i++){
+		ns += children[i].total_ns;
+	}
+	return ns;
+}
+
+// Find or add a child scope
+inline ProfileEntry& ProfileEntry::child(const string &name, long long index){
+	for (size_t i = 0; i < children.size(); i++){
+		if (children[i].name == name && children[i].index == index){
+			return children[i];
+		}
+	}
+	children.push_back(ProfileEntry(name, index));
+	return children.back();
+}
+
+// Find a child scope, NULL if we never entered it
+inline const ProfileEntry* ProfileEntry::find(const string &name, long long index) const{
+	for (size_t i = 0; i < children.size(); i++){
+		if (children[i].name == name && children[i].index == index){
+			return &children[i];
+		}
+	}
+	return NULL;
+}
+
+#ifdef SVO_PROFILING
+inline void mergeProfileNode(const ProfileThread &thread, size_t node, ProfileEntry &entry, bool merge_indices){
+	const ProfileThread::Node &n = thread.nodes[node];
+	for (size_t i = 0; i < n.children.size(); i++){
+		const ProfileThread::Node &c = thread.nodes[n.children[i]];
+		ProfileEntry &e = entry.child(c.name, merge_indices ? PROFILE_NO_INDEX : c.index);
+		e.total_ns += c.total_ns;
+		e.count += c.count;
+		mergeProfileNode(thread, n.children[i], e, merge_indices);
+	}
+}
+#endif
+
+// Merge the trees of all threads (which should have left their scopes by now).
+// With merge_indices, scopes which only differ in their index (all partitions of a stage) are added up.
+inline ProfileEntry collectProfile(bool merge_indices){
+	ProfileEntry root;
+#ifdef SVO_PROFILING
+	ProfileRegistry &registry = ProfileRegistry::instance();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for (size_t t = 0; t < registry.threads.size(); t++){
+		mergeProfileNode(*registry.threads[t], 0, root, merge_indices);
+	}
+	root.total_ns = root.childrenNs();
+#endif
+	return root;
+}
+
+inline void printProfileEntry(const ProfileEntry &e, int depth){
+	string label = string(2 * depth, ' ') + e.name;
+	if (e.index != PROFILE_NO_INDEX){
+		char number[32];
+		sprintf(number, " %lld", e.index);
+		label += number;
+	}
+	char line[256];
+	double self_ms = (e.total_ns - std::min(e.total_ns, e.childrenNs())) / 1000000.0;
+	sprintf(line, "%-40s %12.3f ms %12.3f ms %10llu", label.c_str(), e.milliseconds(), e.children.empty() ? e.milliseconds() : self_ms, static_cast<unsigned long long>(e.count));
+	cout << line << endl;
+	for (size_t i = 0; i < e.children.size(); i++){
+		printProfileEntry(e.children[i], depth + 1);
+	}
+}
+
+// Print the profile: a line per scope, with the time of its child scopes and without (self).
+// Scopes of worker threads are added to the same scopes of the main thread, so they can add up to more than the wall time.
+inline void printProfile(bool per_index){
+#ifdef SVO_PROFILING
+	ProfileEntry root = collectProfile(!per_index);
+	char header[256];
+	sprintf(header, "%-40s %15s %15s %10s", "PROFILE (all threads)", "total", "self", "count");
+	cout << header << endl;
+	for (size_t i = 0; i < root.children.size(); i++){
+		printProfileEntry(root.children[i], 0);
+	}
+#else
+	cout << "Profiling was compiled out (release build). Define SVO_PROFILING to get a timing breakdown." << endl;
+#endif
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Progress of a long build (-progress, -status): triangles processed in the current stage against the number it has to
+// process, voxels found, bytes written and partitions done. A background thread prints the throughput and an ETA for the
+// stage every few seconds, and/or rewrites a JSON status file that job schedulers can poll.
+//
+// The hot loops (partitioner, voxelizer) only count in a local variable, and publish their counts every
+// PROGRESS_SAMPLE triangles with relaxed atomic adds, so progress costs them next to nothing and never takes a lock.
+
+#define PROGRESS_SAMPLE 4096
+
+class Progress{
+public:
+	std::atomic< ::uint64_t> triangles; // triangles processed in the current stage
+	std::atomic< ::uint64_t> voxels; // voxels found so far
+	std::atomic< ::uint64_t> bytes_written; // octree bytes written so far
+	std::atomic<size_t> partitions_done;
+
+	Progress() : triangles(0), voxels(0), bytes_written(0), partitions_done(0), stage("starting"), stage_triangles(0), n_partitions(0),
+		interval_ms(0), print(false), running(false), finished(false), succeeded(false){
+		start_time = std::chrono::steady_clock::now();
+		stage_start = start_time;
+	}
+	~Progress(){ stop(); } // without finish(), as on every error path (they exit), the last report says the build failed
+
+	// Start reporting every interval seconds: print a line (print_lines) and/or rewrite status_filename (if not empty)
+	void start(double interval, bool print_lines, const string &status_filename){
+		interval_ms = static_cast<long long>(interval * 1000.0);
+		print = print_lines;
+		status_file = status_filename;
+		running = true;
+		reporter = std::thread(&Progress::run, this);
+	}
+
+	// The build succeeded: stop reporting, and report a last time (the status file then says the build is done)
+	void finish(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			succeeded = true;
+		}
+		stop();
+	}
+
+	// Stop reporting, and report a last time (the status file then says the build is done if finish() was called, or failed)
+	void stop(){
+		if (!running){
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished = true;
+		}
+		wake.notify_all();
+		reporter.join();
+		running = false;
+	}
+
+	// A new stage, which will process total_triangles triangles (the ETA is for the current stage)
+	void beginStage(const char* name, ::uint64_t total_triangles){
+		std::lock_guard<std::mutex> lock(mutex);
+		stage = name;
+		stage_triangles = total_triangles;
+		stage_start = std::chrono::steady_clock::now();
+		triangles.store(0, std::memory_order_relaxed);
+	}
+
+	void setPartitions(size_t n){
+		std::lock_guard<std::mutex> lock(mutex);
+		n_partitions = n;
+	}
+
+	// Publish what a hot loop counted
+	inline void sample(::uint64_t n_triangles, ::uint64_t n_voxels){
+		triangles.fetch_add(n_triangles, std::memory_order_relaxed);
+		voxels.store(n_voxels, std::memory_order_relaxed);
+	}
+
+	inline void partitionDone(::uint64_t partition_bytes){
+		bytes_written.fetch_add(partition_bytes, std::memory_order_relaxed);
+		partitions_done.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	std::mutex mutex; // guards the stage and the reporter's wake-up, never taken by the hot loops
+	std::condition_variable wake;
+	const char* stage;
+	::uint64_t stage_triangles;
+	std::chrono::steady_clock::time_point stage_start;
+	std::chrono::steady_clock::time_point start_time;
+	size_t n_partitions;
+	long long interval_ms;
+	bool print;
+	string status_file;
+	std::thread reporter;
+	bool running;
+	bool finished;
+	bool succeeded;
+
+	void run(){
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!finished){
+			wake.wait_for(lock, std::chrono::milliseconds(interval_ms));
+			report(finished);
+		}
+	}
+
+	static string formatDuration(double seconds){
+		long long s = static_cast<long long>(seconds + 0.5);
+		char d[32];
+		sprintf(d, "%lld:%02lld:%02lld", s / 3600, (s / 60) % 60, s % 60);
+		return d;
+	}
+
+	// Called by the reporter thread, with the mutex held
+	void report(bool done){
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - start_time).count();
+		double stage_elapsed = std::chrono::duration<double>(now - stage_start).count();
+		::uint64_t t = triangles.load(std::memory_order_relaxed);
+		::uint64_t v = voxels.load(std::memory_order_relaxed);
+		::uint64_t b = bytes_written.load(std::memory_order_relaxed);
+		size_t p = partitions_done.load(std::memory_order_relaxed);
+		double triangle_rate = (stage_elapsed > 0) ? t / stage_elapsed : 0.0;
+		double voxel_rate = (elapsed > 0) ? v / elapsed : 0.0;
+		double percent = (stage_triangles > 0) ? 100.0 * std::min(t, stage_triangles) / stage_triangles : 0.0;
+		double eta = (triangle_rate > 0 && stage_triangles > t) ? (stage_triangles - t) / triangle_rate : (t > 0 ? 0.0 : -1.0); // -1: unknown
+		const char* stage_name = stage;
+		bool failed = done && !succeeded;
+		if (done){
+			eta = 0.0;
+			if (succeeded){
+				stage_name = "done";
+				percent = 100.0;
+			}
+		}
+
+		if (print){
+			// stages which don't go through triangles (finalizing, ...) only get the totals
+			char line[512], triangle_progress[256] = "";
+			if (stage_triangles > 0 && !done){
+				sprintf(triangle_progress, "%llu / %llu triangles (%.1f%%), %.0f triangles/s, ETA %s, ", static_cast<unsigned long long>(t), static_cast<unsigned long long>(stage_triangles),
+					percent, triangle_rate, (eta < 0) ? "unknown" : formatDuration(eta).c_str());
+			}
+			sprintf(line, "[%s] %s: %s%llu voxels (%.0f voxels/s), %.1f MB written, %u / %u partitions", formatDuration(elapsed).c_str(), stage_name, triangle_progress,
+				static_cast<unsigned long long>(v), voxel_rate, b / 1048576.0, (unsigned int) p, (unsigned int) n_partitions);
+			cout << line << (failed ? " - failed" : "") << endl;
+		}
+		if (status_file != ""){
+			// write a new file and rename it over the old one, so readers never see half a status
+			string tmp_filename = status_file + string(".tmp");
+			FILE* f = fopen(tmp_filename.c_str(), "w");
+			if (f == NULL){
+				return;
+			}
+			fprintf(f, "{\"stage\": \"%s\", \"done\": %s, \"failed\": %s, \"elapsed_s\": %.1f, \"triangles\": %llu, \"stage_triangles\": %llu, \"percent\": %.1f, "
+				"\"triangles_per_s\": %.0f, \"voxels\": %llu, \"voxels_per_s\": %.0f, \"bytes_written\": %llu, \"partitions_done\": %u, \"partitions\": %u, \"eta_s\": %.1f}\n",
+				stage_name, (done && succeeded) ? "true" : "false", failed ? "true" : "false", elapsed, static_cast<unsigned long long>(t), static_cast<unsigned long long>(stage_triangles), percent,
+				triangle_rate, static_cast<unsigned long long>(v), voxel_rate, static_cast<unsigned long long>(b), (unsigned int) p, (unsigned int) n_partitions, eta);
+			fclose(f);
+#if defined(_WIN32) || defined(_WIN64)
+			remove(status_file.c_str()); // rename doesn't replace files on Windows
+#endif
+			rename(tmp_filename.c_str(), status_file.c_str());
+		}
+	}
+
+	Progress(const Progress&);
+	Progress& operator=(const Progress&);
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// Machine-readable report of a run (-report): the configuration, one record per partition and the totals.
+// Written as JSON, or as CSV (one line per partition, configuration in # comment lines) when the filename ends in .csv
+
+// What happened to a partition
+enum PartitionStatus { PARTITION_EMPTY, PARTITION_BUILT, PARTITION_COPIED };
+static const char* const PARTITION_STATUS_NAMES[3] = { "empty", "built", "copied" };
+
+// Peak memory use of the process so far, in bytes (0 if we can't tell)
+inline ::uint64_t peakMemoryBytes(){
+#if defined(_WIN32) || defined(_WIN64)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+		return static_cast< ::uint64_t>(counters.PeakWorkingSetSize);
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0){
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast< ::uint64_t>(usage.ru_maxrss); // bytes
+#else
+	return static_cast< ::uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+struct PartitionReport{
+	PartitionStatus status;
+	size_t triangles; // triangles read
+	size_t duplicated_triangles; // triangles which were also written to another partition
+	size_t voxels; // voxels found
+	bool sparse; // voxels were kept in a list of morton codes (true) or in the dense voxel array, because the list overflowed (false)
+	double voxelize_ms;
+	double sort_ms;
+	double build_ms; // time spent in the octree builder
+	::uint64_t bytes_written; // node and payload bytes written by the builder for this partition
+	::uint64_t peak_memory; // peak memory use of the process when this partition was done, in bytes
+
+	PartitionReport() : status(PARTITION_EMPTY), triangles(0), duplicated_triangles(0), voxels(0), sparse(true), voxelize_ms(0), sort_ms(0), build_ms(0), bytes_written(0), peak_memory(0){}
+
+	// Which path the voxels took (only built partitions have one)
+	const char* pathName() const { return (status != PARTITION_BUILT) ? "none" : (sparse ? "sparse" : "dense"); }
+};
+
+class RunReport{
+public:
+	vector< pair<string, string> > config; // name and (JSON) value of every program option
+	vector<PartitionReport> partitions;
+	// totals
+	size_t input_triangles;
+	double partitioning_ms;
+	double total_ms;
+	::uint64_t output_bytes; // size of the finished octree files
+
+	RunReport() : input_triangles(0), partitioning_ms(0), total_ms(0), output_bytes(0){}
+
+	template <typename T> void addConfig(const string &name, const T &value){
+		stringstream s;
+		s << value;
+		config.push_back(make_pair(name, s.str()));
+	}
+	void addConfig(const string &name, const string &value){
+		config.push_back(make_pair(name, jsonString(value)));
+	}
+	void addConfig(const string &name, const char* value){
+		addConfig(name, string(value));
+	}
+	void addConfig(const string &name, bool value){
+		config.push_back(make_pair(name, string(value ? "true" : "false")));
+	}
+
+	bool write(const string &filename) const;
+
+private:
+	static string jsonString(const string &s);
+	PartitionReport totals() const;
+	void writeJSON(ostream &out) const;
+	void writeCSV(ostream &out) const;
+};
+
+// Quote and escape a string for JSON (filenames can contain backslashes)
+inline string RunReport::jsonString(const string &s){
+	string out = "\"";
+	for (size_t i = 0; i < s.size(); i++){
+		char c = s[i];
+		if (c == '"' || c == '\\'){
+			out += '\\';
+			out += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20){
+			char code[8];
+			sprintf(code, "\\u%04x", c);
+			out += code;
+		}
+		else {
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+// Add up all partitions (peak memory is the maximum)
+inline PartitionReport RunReport::totals() const{
+	PartitionReport t;
+	t.status = PARTITION_BUILT;
+	for (size_t i = 0; i < partitions.size(); i++){
+		const PartitionReport &p = partitions[i];
+		t.triangles += p.triangles;
+		t.duplicated_triangles += p.duplicated_triangles;
+		t.voxels += p.voxels;
+		t.sparse = t.sparse && (p.sparse || p.status != PARTITION_BUILT);
+		t.voxelize_ms += p.voxelize_ms;
+		t.sort_ms += p.sort_ms;
+		t.build_ms += p.build_ms;
+		t.bytes_written += p.bytes_written;
+		t.peak_memory = std::max(t.peak_memory, p.peak_memory);
+	}
+	t.peak_memory = std::max(t.peak_memory, peakMemoryBytes());
+	return t;
+}
+
+inline bool RunReport::write(const string &filename) const{
+	ofstream out(filename.c_str());
+	if (!out){
+		return false;
+	}
+	out << fixed << setprecision(3);
+	if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0){
+		writeCSV(out);
+	}
+	else {
+		writeJSON(out);
+	}
+	return out.good();
+}
+
+inline void RunReport::writeJSON(ostream &out) const{
+	PartitionReport t = totals();
+	out << "{" << endl << "  \"config\": {";
+	for (size_t i = 0; i < config.size(); i++){
+		out << (i ? "," : "") << endl << "    " << jsonString(config[i].first) << ": " << config[i].second;
+	}
+	out << endl << "  }," << endl << "  \"partitions\": [";
+	for (size_t i = 0; i < partitions.size(); i++){
+		const PartitionReport &p = partitions[i];
+		out << (i ? "," : "") << endl << "    {\"partition\": " << i << ", \"status\": \"" << PARTITION_STATUS_NAMES[p.status] << "\""
+			<< ", \"triangles\": " << p.triangles << ", \"duplicated_triangles\": " << p.duplicated_triangles << ", \"voxels\": " << p.voxels
+			<< ", \"path\": \"" << p.pathName() << "\", \"voxelize_ms\": " << p.voxelize_ms << ", \"sort_ms\": " << p.sort_ms
+			<< ", \"build_ms\": " << p.build_ms << ", \"bytes_written\": " << p.bytes_written << ", \"peak_memory\": " << p.peak_memory << "}";
+	}
+	out << endl << "  ]," << endl << "  \"totals\": {" << endl
+		<< "    \"input_triangles\": " << input_triangles << "," << endl
+		<< "    \"triangles\": " << t.triangles << "," << endl
+		<< "    \"duplicated_triangles\": " << t.duplicated_triangles << "," << endl
+		<< "    \"voxels\": " << t.voxels << "," << endl
+		<< "    \"partitioning_ms\": " << partitioning_ms << "," << endl
+		<< "    \"voxelize_ms\": " << t.voxelize_ms << "," << endl
+		<< "    \"sort_ms\": " << t.sort_ms << "," << endl
+		<< "    \"build_ms\": " << t.build_ms << "," << endl
+		<< "    \"total_ms\": " << total_ms << "," << endl
+		<< "    \"bytes_written\": " << t.bytes_written << "," << endl
+		<< "    \"output_bytes\": " << output_bytes << "," << endl
+		<< "    \"peak_memory\": " << t.peak_memory << endl
+		<< "  }" << endl << "}" << endl;
+}
+
+inline void RunReport::writeCSV(ostream &out) const{
+	for (size_t i = 0; i < config.size(); i++){
+		out << "# " << config[i].first << " = " << config[i].second << endl;
+	}
+	PartitionReport t = totals();
+	out << "# input_triangles = " << input_triangles << endl
+		<< "# partitioning_ms = " << partitioning_ms << endl
+		<< "# total_ms = " << total_ms << endl
+		<< "# output_bytes = " << output_bytes << endl;
+	out << "partition,status,triangles,duplicated_triangles,voxels,path,voxelize_ms,sort_ms,build_ms,bytes_written,peak_memory" << endl;
+	for (size_t i = 0; i <= partitions.size(); i++){
+		const PartitionReport &p = (i < partitions.size()) ? partitions[i] : t;
+		if (i < partitions.size()){
+			out << i << "," << PARTITION_STATUS_NAMES[p.status];
+		}
+		else {
+			out << "total,";
+		}
+		out << "," << p.triangles << "," << p.duplicated_triangles << "," << p.voxels << "," << p.pathName()
+			<< "," << p.voxelize_ms << "," << p.sort_ms << "," << p.build_ms << "," << p.bytes_written << "," << p.peak_memory << endl;
+	}
+}
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <stdint.h>
+#include <cmath>
 
 //using namespace glm;
 using namespace std;
@@ -27,3 +28,75 @@ struct VoxelData{
 		return morton < a.morton;
 	}
 };
+
+
+// Quantized voxel payload: RGBA8 color and an octahedral normal with 8 bits per component.
+// VoxelData is only quantized when it's written to disk, all computations (like -levels averaging) stay in float.
+struct QuantizedVoxelData{
+	::uint32_t color; // R in the lowest byte, A in the highest
+	::uint16_t normal; // octahedral x in the lowest byte, y in the highest
+	::uint16_t reserved;
+
+	QuantizedVoxelData() : color(0), normal(0), reserved(0){}
+	QuantizedVoxelData(const VoxelData &v);
+	VoxelData toVoxelData(::uint_fast64_t morton) const;
+};
+
+const size_t QUANTIZEDVOXELDATA_SIZE = sizeof(::uint32_t) + 2 * sizeof(::uint16_t);
+
+// Map a float in [0,1] to 0..255 (NaN maps to 0)
+inline ::uint32_t unorm8(float f){
+	if (!(f > 0.0f)) { return 0; }
+	if (f >= 1.0f) { return 255; }
+	return static_cast<::uint32_t>(f * 255.0f + 0.5f);
+}
+
+// Map a float in [-1,1] to 0..255
+inline ::uint16_t snorm8(float f){
+	return static_cast<::uint16_t>(unorm8(f * 0.5f + 0.5f));
+}
+
+inline float signNotZero(float f){
+	return (f >= 0.0f) ? 1.0f : -1.0f;
+}
+
+// Octahedral normal encoding: project on the octahedron, fold the lower hemisphere over the upper one.
+// 0 means "no normal" (a zero or NaN normal, like the average of opposing normals): a normal which would round to 0 (right
+// next to -z) gets the code next to it instead.
+#define OCTAHEDRAL_NO_NORMAL 0
+inline ::uint16_t encodeOctahedral(const glm::vec3 &n){
+	float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	if (!(l1 > 0.0f)) { return OCTAHEDRAL_NO_NORMAL; }
+	float x = n[0] / l1;
+	float y = n[1] / l1;
+	if (n[2] < 0.0f){
+		float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+		float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+		x = fx; y = fy;
+	}
+	::uint16_t e = static_cast<::uint16_t>(snorm8(x) | (snorm8(y) << 8));
+	return (e == OCTAHEDRAL_NO_NORMAL) ? 1 : e;
+}
+
+inline glm::vec3 decodeOctahedral(::uint16_t e){
+	if (e == OCTAHEDRAL_NO_NORMAL) { return glm::vec3(0.0f); }
+	float x = ((e & 0xFF) / 255.0f) * 2.0f - 1.0f;
+	float y = ((e >> 8) / 255.0f) * 2.0f - 1.0f;
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	if (z < 0.0f){
+		float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+		float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+		x = fx; y = fy;
+	}
+	return glm::normalize(glm::vec3(x, y, z));
+}
+
+inline QuantizedVoxelData::QuantizedVoxelData(const VoxelData &v) : reserved(0){
+	color = unorm8(v.color[0]) | (unorm8(v.color[1]) << 8) | (unorm8(v.color[2]) << 16) | (255u << 24);
+	normal = encodeOctahedral(v.normal);
+}
+
+inline VoxelData QuantizedVoxelData::toVoxelData(::uint_fast64_t morton) const{
+	glm::vec3 c = glm::vec3((color & 0xFF) / 255.0f, ((color >> 8) & 0xFF) / 255.0f, ((color >> 16) & 0xFF) / 255.0f);
+	return VoxelData(morton, decodeOctahedral(normal), c);
+}
\ No newline at end of file
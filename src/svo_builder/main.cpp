@@ -3,24 +3,38 @@
 #endif
 
 // If you have a CPU which supports BMI2 / AVX2, compile using this flag to speed up Morton encoding/decoding
+// (the batched morton functions in morton_batch.h detect BMI2 / AVX2 / AVX-512 at runtime, without this flag)
 // #define __BMI2__
 
 #include <glm/glm.hpp>
 #include <vector>
 #include <string>
 #include <sstream>
+#include <thread>
 #include "globals.h"
 #include "../libs/libtri/include/trip_tools.h"
 #include "../libs/libtri/include/TriReader.h"
 
 #include "voxelizer.h"
 #include "OctreeBuilder.h"
+#include "CoarseGridBuilder.h"
+#include "PartitionVoxels.h"
+#include "OctreeRelayout.h"
+#include "OctreeUpdate.h"
 #include "partitioner.h"
+#include "RunReport.h"
+#include "PerfCounters.h"
+#include "Progress.h"
 
 using namespace std;
 using namespace glm;
 
 enum ColorType { COLOR_FROM_MODEL, COLOR_FIXED, COLOR_LINEAR, COLOR_NORMAL };
+static const char* const COLOR_TYPE_NAMES[4] = { "model", "fixed", "linear", "normal" };
+
+#ifndef BINARY_VOXELIZATION
+#define COLOR_BATCH 1024 // Number of morton codes we decode at once for the linear color scale
+#endif
 
 // Program version
 string version = "1.6.4";
@@ -28,11 +42,26 @@ string version = "1.6.4";
 // Program parameters
 string filename = "";
 size_t gridsize = 1024;
+vector<size_t> coarse_gridsizes; // (-s with several sizes) the other gridsizes, coarsest last: derived from the voxels of gridsize
 size_t voxel_memory_limit = 2048;
 float sparseness_limit = 0.10f;
 ColorType color = COLOR_FROM_MODEL;
 vec3 fixed_color = vec3(1.0f, 1.0f, 1.0f); // fixed color is white
 bool generate_levels = false;
+bool async_io = false;
+bool compact_nodes = false;
+OctreeDataFormat data_format = DATA_FULL;
+bool dedup_data = false;
+bool build_dag = false;
+OctreeNodeOrder node_order = ORDER_POSTORDER;
+size_t n_threads = 1;
+string update_filename = ""; // previous octree, for incremental updates
+string dirty_filename = "";
+string delta_filename = "";
+string report_filename = ""; // machine-readable report of the run (JSON, or CSV)
+bool perf_counters = false; // count instructions, cache misses and branch misses per stage
+double progress_interval = 0; // seconds between progress lines (0: no progress lines)
+string status_filename = ""; // status file for job schedulers, rewritten as often as we'd print progress
 bool verbose = false;
 
 // trip header info
@@ -41,19 +70,13 @@ TripInfo trip_info;
 
 // buffer_size
 size_t input_buffersize = 8192;
+size_t output_buffer_bytes = OCTREE_OUTPUT_BUFFERSIZE; // of every output buffer of the SVO builders, lowered for tight memory limits
 
-// timers
+// overall timer (the breakdown is done by the profiler)
 Timer main_timer;
-Timer part_total_timer;
-Timer part_io_in_timer;
-Timer part_io_out_timer;
-Timer part_algo_timer;
-Timer vox_total_timer;
-Timer vox_io_in_timer;
-Timer vox_algo_timer;
-Timer svo_total_timer;
-Timer svo_io_out_timer;
-Timer svo_algo_timer;
+
+// progress of the build, for -progress and -status
+Progress progress;
 
 void printInfo() {
 	cout << "--------------------------------------------------------------------" << endl;
@@ -80,19 +103,35 @@ void printHelp() {
 	std::cout << "" << endl;
 	std::cout << "All available program options:" << endl;
 	std::cout << "" << endl;
-	std::cout << "-f <filename.tri>     Path to a .tri input file." << endl;
+	std::cout << "-f <filename.tri>     Path to a .tri input file, or to a .ply, .obj or .stl mesh (read directly, without tri_convert)." << endl;
 	std::cout << "-s <gridsize>         Voxel gridsize, should be a power of 2. Default 512." << endl;
+	std::cout << "                      Several gridsizes (like 512,1024,2048) give an octree for each, from one voxelization." << endl;
 	std::cout << "-l <memory_limit>     Memory limit for process, in Mb. Default 1024." << endl;
 	std::cout << "-levels               Generate intermediary voxel levels by averaging voxel data" << endl;
 	std::cout << "-c <option>           Coloring of voxels (Options: model (default), fixed, linear, normal)" << endl;
 	std::cout << "-d <percentage>       Percentage of memory limit to be used additionaly for sparseness optimization" << endl;
+	std::cout << "-async                Write SVO output files from a background thread" << endl;
+	std::cout << "-compact              Write SVO nodes in the compact 8-byte format (octree version 2)" << endl;
+	std::cout << "-payload <option>     Format of voxel payloads (Options: full (default), quantized, quantized_morton)" << endl;
+	std::cout << "-dedup                Store identical voxel payloads only once" << endl;
+	std::cout << "-dag                  Store identical subtrees only once (sparse voxel DAG, geometry only)" << endl;
+	std::cout << "-order <option>       Order of SVO nodes (Options: postorder (default), breadth_first, subtree, paged)" << endl;
+	std::cout << "-threads <n>          Build the SVOs of up to n partitions in parallel. Default 1." << endl;
+	std::cout << "-update <file.octree> Update an existing octree: only rebuild partitions in the regions given by -dirty or -delta" << endl;
+	std::cout << "-dirty <file.txt>     Text file with changed regions, one box per line: min_x min_y min_z max_x max_y max_z" << endl;
+	std::cout << "-delta <file.tri>     Mesh with the changed (added and removed) triangles, converted with tri_convert" << endl;
+	std::cout << "-report <file>        Write a report of the run, with a record per partition (JSON, or CSV if the name ends in .csv)" << endl;
+	std::cout << "-perf                 Count instructions, cycles, cache misses and branch misses per stage (Linux perf events)" << endl;
+	std::cout << "-progress <seconds>   Print progress, throughput and an ETA every n seconds" << endl;
+	std::cout << "-status <file>        Keep a JSON status file with the progress up to date (every 10 seconds, or as set by -progress)" << endl;
+	std::cout << "-morton <method>      Force the batched morton code method (avx512, avx2, bmi2, magicbits, slut), for testing" << endl;
 	std::cout << "-v                    Be very verbose." << endl;
 	std::cout << "-h                    Print help and exit." << endl;
 }
 
 void printInvalid() {
 	std::cout << "Not enough or invalid arguments, please try again." << endl;
-	std::cout << "At the bare minimum, I need a path to a .TRI file" << endl << "" << endl;
+	std::cout << "At the bare minimum, I need a path to a .TRI file (or a .PLY, .OBJ or .STL mesh)" << endl << "" << endl;
 	printHelp();
 }
 
@@ -110,20 +149,34 @@ void parseProgramParameters(int argc, char* argv[]) {
 		if (string(argv[i]) == "-f") {
 			filename = argv[i + 1];
 			size_t check_tri = filename.find(".tri");
-			if (check_tri == string::npos) {
-				cout << "Data filename does not end in .tri - I only support that file format" << endl;
+			if (check_tri == string::npos && MeshReader::formatOf(filename) == MESH_UNKNOWN) {
+				cout << "Data filename does not end in .tri, .ply, .obj or .stl - I only support those file formats" << endl;
 				printInvalid();
 				exit(0);
 			}
 			i++;
 		}
 		else if (string(argv[i]) == "-s") {
-			gridsize = atoi(argv[i + 1]);
-			if (!isPowerOf2((unsigned int) gridsize)) {
-				cout << "Requested gridsize is not a power of 2" << endl;
+			// one gridsize, or several separated by commas: we voxelize the finest, the others are derived from it
+			vector<size_t> sizes;
+			stringstream sizes_input(argv[i + 1]);
+			string size_input;
+			while (getline(sizes_input, size_input, ',')) {
+				sizes.push_back(atoi(size_input.c_str()));
+				if (!isPowerOf2((unsigned int) sizes.back())) {
+					cout << "Requested gridsize is not a power of 2" << endl;
+					printInvalid();
+					exit(0);
+				}
+			}
+			if (sizes.empty()) {
 				printInvalid();
 				exit(0);
 			}
+			sort(sizes.rbegin(), sizes.rend());
+			sizes.erase(unique(sizes.begin(), sizes.end()), sizes.end());
+			gridsize = sizes[0];
+			coarse_gridsizes.assign(sizes.begin() + 1, sizes.end());
 			i++;
 		}
 		else if (string(argv[i]) == "-l") {
@@ -148,9 +201,110 @@ void parseProgramParameters(int argc, char* argv[]) {
 		else if (string(argv[i]) == "-v") {
 			verbose = true;
 		}
+		else if (string(argv[i]) == "-perf") {
+			perf_counters = true;
+		}
 		else if (string(argv[i]) == "-levels") {
 			generate_levels = true;
 		}
+		else if (string(argv[i]) == "-async") {
+			async_io = true;
+		}
+		else if (string(argv[i]) == "-compact") {
+			compact_nodes = true;
+		}
+		else if (string(argv[i]) == "-payload") {
+			string payload_input = string(argv[i + 1]);
+			if (payload_input == "full") {
+				data_format = DATA_FULL;
+			}
+			else if (payload_input == "quantized") {
+				data_format = DATA_QUANTIZED;
+			}
+			else if (payload_input == "quantized_morton") {
+				data_format = DATA_QUANTIZED_MORTON;
+			}
+			else {
+				cout << "Unrecognized payload format: " << payload_input << ", so reverting to full payloads." << endl;
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-dedup") {
+			dedup_data = true;
+		}
+		else if (string(argv[i]) == "-dag") {
+#ifdef BINARY_VOXELIZATION
+			build_dag = true;
+#else
+			cout << "You asked to build a DAG, but subtrees can only be shared in binary voxelisation. Ignoring -dag." << endl;
+#endif
+		}
+		else if (string(argv[i]) == "-order") {
+			string order_input = string(argv[i + 1]);
+			if (order_input == "postorder") {
+				node_order = ORDER_POSTORDER;
+			}
+			else if (order_input == "breadth_first") {
+				node_order = ORDER_BREADTH_FIRST;
+			}
+			else if (order_input == "subtree") {
+				node_order = ORDER_SUBTREE;
+			}
+			else if (order_input == "paged") {
+				node_order = ORDER_PAGED;
+			}
+			else {
+				cout << "Unrecognized node order: " << order_input << ", so reverting to postorder." << endl;
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-threads") {
+			int threads_input = atoi(argv[i + 1]);
+			if (threads_input < 1) {
+				cout << "Requested number of threads is nonsensical. Use a value >= 1" << endl;
+				printInvalid();
+				exit(0);
+			}
+			n_threads = static_cast<size_t>(threads_input);
+			i++;
+		}
+		else if (string(argv[i]) == "-progress") {
+			progress_interval = atof(argv[i + 1]);
+			if (progress_interval <= 0) {
+				cout << "Requested progress interval is nonsensical. Use a value > 0" << endl;
+				printInvalid();
+				exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-status") {
+			status_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-morton") {
+			if (!morton3D_64_batch_select(argv[i + 1])) {
+				cout << "Morton batch method " << argv[i + 1] << " is unknown or not supported by this CPU." << endl;
+				printInvalid();
+				exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-update") {
+			update_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-dirty") {
+			dirty_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-delta") {
+			delta_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-report" || string(argv[i]) == "--report") {
+			report_filename = argv[i + 1];
+			i++;
+		}
 		else if (string(argv[i]) == "-c") {
 			string color_input = string(argv[i + 1]);
 #ifdef BINARY_VOXELIZATION
@@ -184,60 +338,116 @@ void parseProgramParameters(int argc, char* argv[]) {
 			printInvalid(); exit(0);
 		}
 	}
+	if (dedup_data && compact_nodes) {
+		cout << "Payload deduplication needs explicit data addresses, which compact nodes don't have. Ignoring -dedup." << endl;
+		dedup_data = false;
+	}
+	if (build_dag && generate_levels) {
+		cout << "Generated levels give every subtree its own payloads, so there is nothing to share. Ignoring -dag." << endl;
+		build_dag = false;
+	}
+	if (build_dag && node_order != ORDER_POSTORDER) {
+		cout << "Node reordering needs a tree, so a DAG is always stored in postorder." << endl;
+		node_order = ORDER_POSTORDER;
+	}
+	if (update_filename != "" && dirty_filename == "" && delta_filename == "") {
+		cout << "An update needs the changed regions of the model, use -dirty and/or -delta." << endl;
+		printInvalid();
+		exit(0);
+	}
+	if (update_filename != "" && !coarse_gridsizes.empty()) {
+		cout << "An update rebuilds one octree, use one gridsize." << endl;
+		printInvalid();
+		exit(0);
+	}
+	if (n_threads > 1 && !coarse_gridsizes.empty()) {
+		cout << "With several gridsizes, the octree of every gridsize is built in its own thread, but partitions are not built in parallel. Ignoring -threads." << endl;
+		n_threads = 1;
+	}
+	if (update_filename == "" && (dirty_filename != "" || delta_filename != "")) {
+		cout << "Changed regions are only used when updating an octree (-update). Ignoring them." << endl;
+	}
+	if (node_order == ORDER_PAGED && !compact_nodes) {
+		cout << "Paged node order needs compact nodes, using subtree order instead." << endl;
+		node_order = ORDER_SUBTREE;
+	}
 	if (verbose) {
 		cout << "  filename: " << filename << endl;
 		cout << "  gridsize: " << gridsize << endl;
+		cout << "  coarser gridsizes:";
+		for (size_t k = 0; k < coarse_gridsizes.size(); k++) { cout << " " << coarse_gridsizes[k]; }
+		cout << endl;
 		cout << "  memory limit: " << voxel_memory_limit << endl;
 		cout << "  sparseness optimization limit: " << sparseness_limit << " resulting in " << (sparseness_limit*voxel_memory_limit) << " memory limit." << endl;
 		cout << "  color type: " << color_s << endl;
 		cout << "  generate levels: " << generate_levels << endl;
+		cout << "  async output: " << async_io << endl;
+		cout << "  compact nodes: " << compact_nodes << endl;
+		cout << "  payload format: " << DATA_FORMAT_NAMES[data_format] << endl;
+		cout << "  deduplicate payloads: " << dedup_data << endl;
+		cout << "  build DAG: " << build_dag << endl;
+		cout << "  SVO building threads: " << n_threads << endl;
+		cout << "  update octree: " << update_filename << endl;
+		cout << "  node order: " << NODE_ORDER_NAMES[node_order] << endl;
+		cout << "  report: " << report_filename << endl;
+		cout << "  hardware counters: " << perf_counters << endl;
+		cout << "  progress interval: " << progress_interval << endl;
+		cout << "  status file: " << status_filename << endl;
+		cout << "  morton batch method: " << MORTON_BATCH_METHOD_NAMES[morton3D_64_batch_method()] << endl;
 		cout << "  verbosity: " << verbose << endl;
 	}
 }
 
-// Initialize all performance timers
-void setupTimers() {
-	main_timer = Timer();
-
-	// Partitioning timers
-	part_total_timer = Timer();
-	part_io_in_timer = Timer();
-	part_io_out_timer = Timer();
-	part_algo_timer = Timer();
-
-	// Voxelization timers
-	vox_total_timer = Timer();
-	vox_io_in_timer = Timer();
-	vox_algo_timer = Timer();
-
-	svo_total_timer = Timer();
-	svo_io_out_timer = Timer();
-	svo_algo_timer = Timer();
+// Store the program parameters in the report
+void addReportConfig(RunReport &report, const TripInfo &trip_info) {
+	report.addConfig("version", version);
+#ifdef BINARY_VOXELIZATION
+	report.addConfig("geometry_only", true);
+#else
+	report.addConfig("geometry_only", false);
+#endif
+	report.addConfig("filename", filename);
+	report.addConfig("gridsize", gridsize);
+	if (!coarse_gridsizes.empty()) {
+		stringstream sizes;
+		for (size_t k = 0; k < coarse_gridsizes.size(); k++) { sizes << (k > 0 ? "," : "") << coarse_gridsizes[k]; }
+		report.addConfig("coarse_gridsizes", sizes.str());
+	}
+	report.addConfig("memory_limit", voxel_memory_limit);
+	report.addConfig("sparseness_limit", sparseness_limit);
+	report.addConfig("partitions", trip_info.n_partitions);
+	report.addConfig("color", COLOR_TYPE_NAMES[color]);
+	report.addConfig("generate_levels", generate_levels);
+	report.addConfig("async", async_io);
+	report.addConfig("compact", compact_nodes);
+	report.addConfig("payload", DATA_FORMAT_NAMES[data_format]);
+	report.addConfig("dedup", dedup_data);
+	report.addConfig("dag", build_dag);
+	report.addConfig("order", NODE_ORDER_NAMES[node_order]);
+	report.addConfig("threads", n_threads);
+	report.addConfig("update", update_filename);
+	report.addConfig("morton_batch_method", MORTON_BATCH_METHOD_NAMES[morton3D_64_batch_method()]);
 }
 
-// Printout total time of running Timers (for debugging purposes)
+// Print the overall time, the timing breakdown of all stages (per partition if we're verbose), their hardware counters (-perf)
+// and what we used our memory for
 void printTimerInfo() {
-	//double diff = main_timer.elapsed_time_milliseconds - (algo_timer.elapsed_time_milliseconds + io_timer_in.elapsed_time_milliseconds + io_timer_out.elapsed_time_milliseconds);
 	cout << "Total MAIN time      : " << main_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "PARTITIONING" << endl;
-	cout << "  Total time		: " << part_total_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  IO IN time		: " << part_io_in_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  algorithm time	: " << part_algo_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  IO OUT time		: " << part_io_out_timer.elapsed_time_milliseconds << " ms." << endl;
-	double part_diff = part_total_timer.elapsed_time_milliseconds - part_io_in_timer.elapsed_time_milliseconds - part_algo_timer.elapsed_time_milliseconds - part_io_out_timer.elapsed_time_milliseconds;
-	cout << "  misc time		: " << part_diff << " s." << endl;
-	cout << "VOXELIZING" << endl;
-	cout << "  Total time		: " << vox_total_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  IO IN time		: " << vox_io_in_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  algorithm time	: " << vox_algo_timer.elapsed_time_milliseconds << " ms." << endl;
-	double vox_diff = vox_total_timer.elapsed_time_milliseconds - vox_io_in_timer.elapsed_time_milliseconds - vox_algo_timer.elapsed_time_milliseconds;
-	cout << "  misc time		: " << vox_diff << " s." << endl;
-	cout << "SVO BUILDING" << endl;
-	cout << "  Total time		: " << svo_total_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  IO OUT time		: " << svo_io_out_timer.elapsed_time_milliseconds << " ms." << endl;
-	cout << "  algorithm time	: " << svo_algo_timer.elapsed_time_milliseconds << " ms." << endl;
-	double svo_misc = svo_total_timer.elapsed_time_milliseconds - svo_io_out_timer.elapsed_time_milliseconds - svo_algo_timer.elapsed_time_milliseconds;
-	cout << "  misc time		: " << svo_misc << " s." << endl;
+	printProfile(verbose);
+	PerfCounters::instance().print();
+	MemoryTracker::instance().print();
+}
+
+// Number of output buffers of all SVO builders: node and payload buffers (doubled with -async) of the main builder and of
+// the builders of the coarser gridsizes, and those of the builders of the workers
+size_t countOutputBuffers() {
+	return 2 * (async_io ? 2 : 1) * (1 + coarse_gridsizes.size()) + ((n_threads > 1) ? 2 * n_threads : 0);
+}
+
+// Size of every output buffer: together, they get at most an eighth of the memory limit
+size_t estimateOutputBufferSize() {
+	::uint64_t share = (::uint64_t)voxel_memory_limit * 1024 * 1024 / 8 / countOutputBuffers();
+	return static_cast<size_t>(std::max< ::uint64_t>(OCTREE_MIN_OUTPUT_BUFFERSIZE, std::min< ::uint64_t>(OCTREE_OUTPUT_BUFFERSIZE, share)));
 }
 
 // Tri header handling and error checking
@@ -266,21 +476,263 @@ void readTriHeader(string& filename, TriInfo& tri_info){
 #endif
 }
 
-// Trip header handling and error checking
-void readTripHeader(string& filename, TripInfo& trip_info){
+// The bounding box as a .tri header stores it, so a mesh we read directly gets the same voxel size as its .tri file would
+AABox<vec3> headerBBox(const AABox<vec3> &bbox){
+	stringstream s;
+	s << bbox.min[0] << " " << bbox.min[1] << " " << bbox.min[2] << " " << bbox.max[0] << " " << bbox.max[1] << " " << bbox.max[2];
+	AABox<vec3> header_bbox;
+	s >> header_bbox.min[0] >> header_bbox.min[1] >> header_bbox.min[2] >> header_bbox.max[0] >> header_bbox.max[1] >> header_bbox.max[2];
+	return header_bbox;
+}
+
+// Open a mesh we read directly (instead of a .tri file), which reads its vertices and bounding box, and fill in tri_info like
+// tri_convert would. The vertices can take half of the memory limit: beyond that, they go to a temporary file.
+// Returns the corner of the bounding cube, which the triangles get moved by.
+vec3 openMesh(MeshReader& mesh, TriInfo& tri_info){
+	cout << "Reading vertices and bounding box of " << filename << " ..." << endl;
+	if (!mesh.open(filename, (::uint64_t)voxel_memory_limit * 1024 * 1024 / 2, false)) {
+		exit(0);
+	}
+	cout << "  " << mesh.n_faces << " faces";
+	if (mesh.vertexCount() > 0) { // (STL facets have their own vertices)
+		cout << ", " << mesh.vertexCount() << " vertices" << (mesh.verticesOnDisk() ? ", more than fit in half the memory limit: the faces will read them back from disk" : "");
+	}
+	cout << endl;
+	AABox<vec3> mesh_bbox = createMeshBBCube(mesh.bbox);
+	tri_info.base_filename = filename.substr(0, filename.find_last_of("."));
+	tri_info.version = 1;
+#ifdef BINARY_VOXELIZATION
+	tri_info.geometry_only = 1;
+#else
+	tri_info.geometry_only = 0;
+#endif
+	tri_info.n_triangles = mesh.n_faces; // until we know how many triangles the faces give
+	tri_info.mesh_bbox = headerBBox(mesh_bbox);
+	if (verbose) { tri_info.print(); }
+	return mesh_bbox.min;
+}
+
+// Close a mesh we read directly when we have all its triangles, and give back the memory it took
+void closeMesh(MeshReader& mesh, MemoryCharge* mesh_memory){
+	if (mesh.n_skipped > 0) {
+		cout << "  skipped " << mesh.n_skipped << " triangles which use vertices the mesh doesn't have" << endl;
+	}
+	if (verbose && mesh.verticesOnDisk()) {
+		cout << "  read " << mesh.vertexPageReads() << " pages of vertices back from disk" << endl;
+	}
+	mesh.close();
+	delete mesh_memory;
+}
+
+// Trip header handling and error checking (a partition we voxelize straight from the mesh has no .tripdata file)
+void readTripHeader(string& filename, TripInfo& trip_info, bool need_data = true){
 	if (parseTripHeader(filename, trip_info) != 1) {
 		exit(0);
 	}
-	if (!trip_info.filesExist()) {
+	if (need_data && !trip_info.filesExist()) {
 		cout << "Not all required .trip or .tripdata files exist. Please regenerate using svo_builder." << endl; 
 		exit(0); // not all required files exist - exiting.
 	}
 	if (verbose) { trip_info.print(); }
 }
 
+// Open the octree we're updating, check that it matches the octree we're building, and find the partitions which changed
+void prepareUpdate(OctreeReader &old_octree, const TripInfo &trip_info, vector<bool> &dirty) {
+	if (!old_octree.open(update_filename)) {
+		cout << "Could not open octree " << update_filename << " - check that the .octree, .octreenodes and .octreedata files exist." << endl;
+		exit(1);
+	}
+	const OctreeInfo &old_info = old_octree.info;
+	int version = compact_nodes ? OCTREE_VERSION_COMPACT : OCTREE_VERSION_LEGACY;
+	if (old_info.gridlength != trip_info.gridsize || old_info.version != version || old_info.data_format != data_format || old_info.levels != generate_levels) {
+		cout << "The octree to update was built with another gridsize, node format, payload format or -levels setting. Use the same options." << endl;
+		exit(1);
+	}
+	if (old_info.data_layout != builderDataLayout(compact_nodes, generate_levels)) {
+		cout << "The octree to update was built with another -levels setting, or by the other svo_builder (binary or color). Use the same options." << endl;
+		exit(1);
+	}
+	if (old_info.node_order != ORDER_POSTORDER || old_info.dag) {
+		cout << "Only octrees in postorder (the default -order) can be updated, and no DAGs." << endl;
+		exit(1);
+	}
+	if (!old_info.has_bbox) {
+		cout << "The octree to update doesn't store its bounding box (it was built by an older svo_builder), so the update can't be checked. Rebuild it." << endl;
+		exit(1);
+	}
+	if (old_info.bbox.min != trip_info.mesh_bbox.min || old_info.bbox.max != trip_info.mesh_bbox.max) {
+		cout << "The bounding box of the model changed since the octree to update was built, which moves every voxel. Rebuild the octree." << endl;
+		exit(1);
+	}
+	vector< AABox<vec3> > boxes;
+	if (dirty_filename != "" && !readDirtyBoxes(dirty_filename, boxes)) {
+		cout << "Could not read changed regions from " << dirty_filename << endl;
+		exit(1);
+	}
+	if (delta_filename != "") {
+		TriInfo delta_info;
+		readTriHeader(delta_filename, delta_info);
+		readDeltaBoxes(delta_info, input_buffersize, boxes);
+	}
+	dirty = findDirtyPartitions(boxes, trip_info);
+	size_t n_dirty = std::count(dirty.begin(), dirty.end(), true);
+	cout << "Updating " << update_filename << ": " << boxes.size() << " changed regions, rebuilding " << n_dirty << " of " << trip_info.n_partitions << " partitions." << endl;
+}
+
+#ifndef BINARY_VOXELIZATION
+// Color voxels by their position in the grid (linear color scale), decoding their morton codes in batches
+void colorByPosition(VoxelList &data) {
+	::uint64_t codes[COLOR_BATCH];
+	::uint32_t x[COLOR_BATCH], y[COLOR_BATCH], z[COLOR_BATCH];
+	for (size_t i = 0; i < data.size(); i += COLOR_BATCH) {
+		size_t n = std::min<size_t>(COLOR_BATCH, data.size() - i);
+		for (size_t j = 0; j < n; j++) { codes[j] = data[i + j].morton; }
+		morton3D_64_decode_n(codes, x, y, z, n);
+		for (size_t j = 0; j < n; j++) {
+			data[i + j].color = vec3((float)z[j] / gridsize, (float)y[j] / gridsize, (float)x[j] / gridsize); // same as mortonToRGB
+		}
+	}
+}
+#endif
+
+// Derive the voxels of a coarser grid from the (sorted) voxels of a partition, in a thread next to the builder of the finest grid
+void addCoarseVoxels(CoarseGridBuilder* coarse, const VoxelList* data, const char* voxels, bool use_data, ::uint64_t start, ::uint64_t morton_part) {
+	PROFILE_SCOPE("coarser gridsizes");
+#ifdef BINARY_VOXELIZATION
+	if (!use_data) {
+		coarse->addGrid(voxels, start, morton_part);
+		return;
+	}
+#endif
+	coarse->addVoxels(*data);
+}
+
+// Start a thread per coarser grid, for the voxels of a partition
+void startCoarseGrids(const vector<CoarseGridBuilder*> &coarse, vector<std::thread> &threads, const VoxelList &data, const char* voxels, bool use_data, ::uint64_t start, ::uint64_t morton_part) {
+	for (size_t k = 0; k < coarse.size(); k++) {
+		threads.push_back(std::thread(addCoarseVoxels, coarse[k], &data, voxels, use_data, start, morton_part));
+	}
+}
+
+void joinCoarseGrids(vector<std::thread> &threads) {
+	for (size_t k = 0; k < threads.size(); k++) {
+		threads[k].join();
+	}
+	threads.clear();
+}
+
+// Feed the voxels of one partition to a builder, in morton order, and to the builders of the coarser grids, at the same time
+// (the time this takes is added to the partition's report)
+void buildPartition(OctreeBuilder &builder, const vector<CoarseGridBuilder*> &coarse, VoxelList &data, const char* voxels, bool use_data, ::uint64_t start, ::uint64_t morton_part, PartitionReport &report) {
+	Timer sort_timer;
+	Timer build_timer;
+	vector<std::thread> coarse_threads;
+	::uint64_t bytes_before = builder.bytesWritten();
+#ifdef BINARY_VOXELIZATION
+	if (use_data){ // use array of morton codes to build the SVO (else the morton array overflowed, and we use the voxel array)
+		PROFILE_SCOPE("sorting");
+		PERF_STAGE("sorting");
+		sort_timer.start();
+		sortPartitionVoxels(data); // sort morton codes
+		sort_timer.stop();
+	}
+	build_timer.start();
+#else
+	{
+		PROFILE_SCOPE("sorting");
+		PERF_STAGE("sorting");
+		sort_timer.start();
+		sortPartitionVoxels(data); // sort
+		sort_timer.stop();
+	}
+	build_timer.start();
+	if (color == COLOR_LINEAR){ // linear color scale
+		colorByPosition(data);
+	}
+	for (VoxelList::iterator it = data.begin(); it != data.end(); ++it){
+		if (color == COLOR_FIXED){
+			it->color = fixed_color;
+		}
+		else if (color == COLOR_NORMAL){ // color models using their normals
+			vec3 normal = normalize(it->normal);
+			it->color = vec3((normal[0] + 1.0f) / 2.0f, (normal[1] + 1.0f) / 2.0f, (normal[2] + 1.0f) / 2.0f);
+		}
+	}
+#endif
+	startCoarseGrids(coarse, coarse_threads, data, voxels, use_data, start, morton_part);
+#ifdef BINARY_VOXELIZATION
+	if (!use_data){ // morton array overflowed : using slower way to build SVO
+		addPartitionGrid(builder, voxels, start, morton_part);
+	}
+	else {
+		addPartitionVoxels(builder, data);
+	}
+#else
+	addPartitionVoxels(builder, data);
+#endif
+	joinCoarseGrids(coarse_threads);
+	build_timer.stop();
+	report.sort_ms += sort_timer.elapsed_time_milliseconds;
+	report.build_ms += build_timer.elapsed_time_milliseconds;
+	report.bytes_written += builder.bytesWritten() - bytes_before;
+}
+
+// Build the subtree of one partition in its own segment files (runs in a worker thread).
+// The worker owns the partition's voxel data (and voxel array, if the data array overflowed) and frees it when done.
+void buildSegment(size_t i, string segment_base, size_t part_side, VoxelList* data, char* voxels, bool use_data, ::uint64_t start, ::uint64_t morton_part, OctreeSegment* segment, PartitionReport* report) {
+	PROFILE_SCOPE("SVO building");
+	PROFILE_SCOPE_INDEX("partition", i);
+	PERF_STAGE("SVO building");
+	OctreeBuilder segment_builder(segment_base, part_side, generate_levels, false, compact_nodes, data_format, dedup_data, build_dag, start, output_buffer_bytes);
+	buildPartition(segment_builder, vector<CoarseGridBuilder*>(), *data, voxels, use_data, start, morton_part, *report);
+	Timer finalize_timer;
+	finalize_timer.start();
+	::uint64_t bytes_before = segment_builder.bytesWritten();
+	*segment = segment_builder.finalizeSubtree();
+	finalize_timer.stop();
+	report->build_ms += finalize_timer.elapsed_time_milliseconds;
+	report->bytes_written += segment_builder.bytesWritten() - bytes_before;
+	delete data;
+	if (voxels != NULL) {
+		delete[] voxels;
+		MemoryTracker::instance().remove(MEM_VOXEL_GRID, morton_part);
+	}
+	report->peak_memory = peakMemoryBytes();
+	progress.partitionDone(report->bytes_written);
+}
+
+#ifndef BINARY_VOXELIZATION
+// Voxelize and build a partition (or a part of one) whose voxel data doesn't fit in data_limit bytes: split it in 8 parts,
+// which are voxelized (reading all triangles of the partition again) and built one after the other, in morton order.
+// Parts which still don't fit are split again.
+void buildSplitPartition(OctreeBuilder &builder, const vector<CoarseGridBuilder*> &coarse, const string &part_data_filename, size_t n_triangles, ::uint64_t start, ::uint64_t end, float unitlength, char* voxels, VoxelList &data, ::uint64_t data_limit, size_t &nfilled, PartitionReport &report) {
+	::uint64_t part = (end - start) / 8;
+	for (::uint64_t k = 0; k < 8; k++) {
+		::uint64_t part_start = start + k * part;
+		bool use_data = true;
+		size_t nfilled_before = nfilled;
+		{
+			PROFILE_SCOPE("voxelizing parts");
+			Timer voxelize_timer;
+			voxelize_timer.start();
+			MemoryCharge reader_memory(MEM_TRIANGLE_READERS, std::min(n_triangles, input_buffersize) * sizeof(Triangle));
+			TriReader reader(part_data_filename, n_triangles, std::min(n_triangles, input_buffersize));
+			voxelize_schwarz_method(reader, part_start, part_start + part, unitlength, voxels, data, sparseness_limit, use_data, nfilled, &progress, (part >= 8) ? data_limit : 0, gridsize);
+			voxelize_timer.stop();
+			report.voxelize_ms += voxelize_timer.elapsed_time_milliseconds;
+		}
+		if (!use_data) {
+			nfilled = nfilled_before;
+			VoxelList().swap(data); // free the list before we go on with smaller parts
+			buildSplitPartition(builder, coarse, part_data_filename, n_triangles, part_start, part_start + part, unitlength, voxels, data, data_limit, nfilled, report);
+			continue;
+		}
+		buildPartition(builder, coarse, data, voxels, true, part_start, part, report);
+	}
+}
+#endif
+
 int main(int argc, char *argv[]) {
-	// Setup timers
-	setupTimers();
 	main_timer.start();
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -290,110 +742,374 @@ int main(int argc, char *argv[]) {
 	// Parse program parameters
 	printInfo();
 	parseProgramParameters(argc, argv);
+	if (perf_counters) {
+		PerfCounters::instance().enable();
+	}
+	if (progress_interval > 0 || status_filename != "") {
+		progress.start((progress_interval > 0) ? progress_interval : 10.0, progress_interval > 0, status_filename);
+	}
 
 	// PARTITIONING
-	part_total_timer.start(); part_io_in_timer.start(); // TIMING
-	readTriHeader(filename, tri_info);
-	part_io_in_timer.stop();
-	size_t n_partitions = estimate_partitions(gridsize, voxel_memory_limit);
-	cout << "Partitioning data into " << n_partitions << " partitions ... "; cout.flush();
-	TripInfo trip_info = partition(tri_info, n_partitions, gridsize);
-	cout << "done." << endl;
-	part_total_timer.stop(); // TIMING
-
-	vox_total_timer.start(); vox_io_in_timer.start(); // TIMING
+	TripInfo trip_info;
+	RunReport report;
+	vector<size_t> part_duplicates;
+	// a mesh (.ply, .obj, .stl) is read directly. If it fits in one partition (and we make binary voxels), it's voxelized straight
+	// from the mesh file. Otherwise, it's partitioned like a .tri file.
+	bool mesh_input = (MeshReader::formatOf(filename) != MESH_UNKNOWN);
+	bool mesh_voxelize = false;
+	MeshReader mesh;
+	vec3 mesh_origin;
+	MemoryCharge* mesh_memory = NULL;
+	{
+		PROFILE_SCOPE("partitioning");
+		PERF_STAGE("partitioning");
+		Timer partitioning_timer;
+		partitioning_timer.start();
+		::uint64_t mesh_bytes = 0;
+		if (mesh_input) {
+			PROFILE_SCOPE("reading vertices");
+			mesh_origin = openMesh(mesh, tri_info);
+			mesh_bytes = mesh.memoryUsed() + MESH_INPUT_BUFFERSIZE;
+			mesh_memory = new MemoryCharge(MEM_MESH_INPUT, mesh_bytes);
+		}
+		else {
+			readTriHeader(filename, tri_info);
+		}
+		progress.beginStage("partitioning", tri_info.n_triangles);
+		output_buffer_bytes = estimateOutputBufferSize();
+		::uint64_t output_memory = (::uint64_t)output_buffer_bytes * countOutputBuffers();
+		size_t n_partitions = estimate_partitions(gridsize, voxel_memory_limit, sparseness_limit, n_threads, output_memory);
+#ifdef BINARY_VOXELIZATION
+		// the mesh stays open while we voxelize it, so it has to fit next to the partition
+		// (colored partitions whose voxel data doesn't fit get read again, which needs a .tripdata file)
+		mesh_voxelize = mesh_input && n_partitions == 1 &&
+			estimate_partition_memory(gridsize, 1, sparseness_limit, n_threads, output_memory + mesh_bytes) <= (::uint64_t)voxel_memory_limit * 1024 * 1024;
+#endif
+		if (mesh_voxelize) {
+			cout << "Voxelizing straight from the mesh, without partitioning it." << endl;
+			trip_info = partition_none(tri_info, gridsize, mesh.n_faces);
+			part_duplicates.assign(1, 0);
+		}
+		else if (mesh_input) {
+			size_t mesh_mb = static_cast<size_t>(mesh_bytes / 1024 / 1024);
+			size_t buffer_size = estimate_buffer_size(n_partitions, voxel_memory_limit - std::min(voxel_memory_limit - 1, mesh_mb));
+			cout << "Partitioning mesh into " << n_partitions << " partitions ... "; cout.flush();
+			{
+				MeshTriangleReader reader(mesh, mesh_origin);
+				trip_info = partitionMesh(reader, tri_info, n_partitions, gridsize, &part_duplicates, &progress, buffer_size);
+				tri_info.n_triangles = reader.n_served;
+			}
+			cout << "done." << endl;
+			closeMesh(mesh, mesh_memory);
+			mesh_memory = NULL;
+		}
+		else {
+			size_t buffer_size = estimate_buffer_size(n_partitions, voxel_memory_limit);
+			cout << "Partitioning data into " << n_partitions << " partitions ... "; cout.flush();
+			trip_info = partition(tri_info, n_partitions, gridsize, &part_duplicates, &progress, buffer_size);
+			cout << "done." << endl;
+		}
+		partitioning_timer.stop();
+		report.partitioning_ms = partitioning_timer.elapsed_time_milliseconds;
+	}
+	MemoryTracker::instance().endStage("partitioning");
+
 	// Parse TRIP header
 	string tripheader = trip_info.base_filename + string(".trip");
-	readTripHeader(tripheader, trip_info);
-	vox_io_in_timer.stop(); // TIMING
+	readTripHeader(tripheader, trip_info, !mesh_voxelize);
+
+	addReportConfig(report, trip_info);
+	report.input_triangles = tri_info.n_triangles;
+	report.partitions.resize(trip_info.n_partitions);
 
 	// General voxelization calculations (stuff we need throughout voxelization process)
 	float unitlength = (trip_info.mesh_bbox.max[0] - trip_info.mesh_bbox.min[0]) / (float)trip_info.gridsize;
 	::uint64_t morton_part = (trip_info.gridsize * trip_info.gridsize * trip_info.gridsize) / trip_info.n_partitions;
 
 	char* voxels = new char[(size_t)morton_part]; // Storage for voxel on/off
-#ifdef BINARY_VOXELIZATION
-	vector<::uint64_t> data; // Dynamic storage for morton codes
-#else
-	vector<VoxelData> data; // Dynamic storage for voxel data
-#endif 
+	MemoryCharge voxels_memory(MEM_VOXEL_GRID, morton_part);
+	VoxelList data;
 	size_t nfilled = 0;
-	vox_total_timer.stop(); // TIMING
 
-	svo_total_timer.start();
-	// create Octreebuilder which will output our SVO
-	OctreeBuilder builder = OctreeBuilder(trip_info.base_filename, trip_info.gridsize, generate_levels);
-	svo_total_timer.stop();
+	// Parallel SVO building: every partition becomes a subtree, built in a worker thread while we voxelize the next ones.
+	// Each running worker holds on to the voxel data of its partition, so memory use grows with the number of threads.
+	bool parallel = (n_threads > 1 && trip_info.n_partitions > 1);
+	size_t part_side = trip_info.gridsize;
+	for (size_t p = 1; p < trip_info.n_partitions; p *= 8) {
+		part_side = part_side / 2;
+	}
+	vector<std::thread> workers(parallel ? n_threads : 0);
+	vector<OctreeSegment> segments(parallel ? trip_info.n_partitions : 0);
+	vector<bool> has_segment(segments.size(), false);
+	size_t n_started = 0;
+
+	// Colored voxel lists have no sparseness limit: they can grow into what's left of the memory limit (shared with the workers).
+	// A partition whose list doesn't fit is voxelized and built in parts.
+	::uint64_t data_limit = 0;
+#ifndef BINARY_VOXELIZATION
+	::uint64_t memory_left = (::uint64_t)voxel_memory_limit * 1024 * 1024;
+	memory_left -= std::min(memory_left, morton_part + input_buffersize * sizeof(Triangle) + (::uint64_t)output_buffer_bytes * countOutputBuffers());
+	data_limit = std::max< ::uint64_t>(1, memory_left / (parallel ? n_threads + 1 : 1));
+#endif
+
+	// Incremental update: only partitions in changed regions get voxelized, the others are copied from the old octree
+	OctreeReader old_octree;
+	vector<bool> dirty(trip_info.n_partitions, true);
+	if (update_filename != "") {
+		prepareUpdate(old_octree, trip_info, dirty);
+	}
+	::uint64_t voxelize_triangles = 0; // the triangles we'll voxelize, for the progress of this stage
+	for (size_t i = 0; i < trip_info.n_partitions; i++) {
+		if (dirty[i]) { voxelize_triangles += trip_info.part_tricounts[i]; }
+	}
+	progress.setPartitions(trip_info.n_partitions);
+	progress.beginStage("voxelizing", voxelize_triangles);
+
+	// create Octreebuilder which will output our SVO (when updating, next to the old octree, which may have the same name)
+	string output_base = (update_filename != "") ? trip_info.base_filename + string("_update") : trip_info.base_filename;
+	OctreeBuilder builder(output_base, trip_info.gridsize, generate_levels, async_io, compact_nodes, data_format, dedup_data, build_dag, 0, output_buffer_bytes);
+	builder.has_bbox = true;
+	builder.bbox = trip_info.mesh_bbox;
+	// builders of the coarser gridsizes, which get their voxels from the voxels of the finest grid
+	vector<CoarseGridBuilder*> coarse_grids;
+	for (size_t k = 0; k < coarse_gridsizes.size(); k++) {
+		size_t size = coarse_gridsizes[k];
+		int levels = 0;
+		for (size_t s = size; s < trip_info.gridsize; s *= 2) { levels++; }
+		string coarse_base = tri_info.base_filename + val_to_string(size) + string("_") + val_to_string(trip_info.n_partitions);
+		OctreeBuilder* coarse_builder = new OctreeBuilder(coarse_base, size, generate_levels, async_io, compact_nodes, data_format, dedup_data, build_dag, 0, output_buffer_bytes);
+		coarse_builder->has_bbox = true;
+		coarse_builder->bbox = trip_info.mesh_bbox;
+		coarse_grids.push_back(new CoarseGridBuilder(coarse_builder, size, levels));
+	}
 
 	// Start voxelisation and SVO building per partition
 	for (size_t i = 0; i < trip_info.n_partitions; i++) {
-		if (trip_info.part_tricounts[i] == 0) { continue; } // skip partition if it contains no triangles
+		PartitionReport &part_report = report.partitions[i];
+		if (!dirty[i]) {
+			OctreeSegment old_segment;
+			if (findOldSubtree(old_octree, i * morton_part, part_side, builder.dataHeaderRecords(), old_segment)) {
+				if (verbose) { cout << "Copying SVO for partition " << i << " from " << update_filename << endl; }
+				part_report.status = PARTITION_COPIED;
+				if (parallel) { // keep partition order: added when the built subtrees are stitched together
+					segments[i] = old_segment;
+					has_segment[i] = true;
+				}
+				else {
+					PROFILE_SCOPE("SVO building");
+					PROFILE_SCOPE_INDEX("partition", i);
+					PROFILE_SCOPE("copying old subtree");
+					PERF_STAGE("SVO building");
+					Timer copy_timer;
+					copy_timer.start();
+					::uint64_t bytes_before = builder.bytesWritten();
+					builder.addSubtree(old_segment);
+					copy_timer.stop();
+					part_report.build_ms = copy_timer.elapsed_time_milliseconds;
+					part_report.bytes_written = builder.bytesWritten() - bytes_before;
+					part_report.peak_memory = peakMemoryBytes();
+				}
+			}
+			progress.partitionDone(part_report.bytes_written);
+			continue;
+		}
+		if (trip_info.part_tricounts[i] == 0) { // skip partition if it contains no triangles
+			progress.partitionDone(0);
+			continue;
+		}
 
 		// VOXELIZATION
-		vox_total_timer.start(); // TIMING
 		cout << "Voxelizing partition " << i << " ..." << endl;
 		// morton codes for this partition
 		::uint64_t start = i * morton_part;
 		::uint64_t end = (i + 1) * morton_part;
-		// open file to read triangles
-		vox_io_in_timer.start(); // TIMING
-		std::string part_data_filename = trip_info.base_filename + string("_") + val_to_string(i) + string(".tripdata");
-		TriReader reader = TriReader(part_data_filename, trip_info.part_tricounts[i], std::min(trip_info.part_tricounts[i], input_buffersize));
-		if (verbose) { cout << "  reading " << trip_info.part_tricounts[i] << " triangles from " << part_data_filename << endl; }
-		vox_io_in_timer.stop(); // TIMING
-		// voxelize partition
-		size_t nfilled_before = nfilled;
 		bool use_data = true;
-		voxelize_schwarz_method(reader, start, end, unitlength, voxels, data, sparseness_limit, use_data, nfilled);
-		if (verbose) { cout << "  found " << nfilled - nfilled_before << " new voxels." << endl; }
-		vox_total_timer.stop(); // TIMING
+		part_report.status = PARTITION_BUILT;
+		part_report.triangles = trip_info.part_tricounts[i];
+		part_report.duplicated_triangles = part_duplicates[i];
+		{
+			PROFILE_SCOPE("voxelizing");
+			PROFILE_SCOPE_INDEX("partition", i);
+			PERF_STAGE("voxelizing");
+			Timer voxelize_timer;
+			voxelize_timer.start();
+			size_t nfilled_before = nfilled;
+			if (mesh_voxelize) { // read the triangles straight from the mesh
+				if (verbose) { cout << "  reading the triangles of " << mesh.n_faces << " faces from " << filename << endl; }
+				MeshTriangleReader reader(mesh, mesh_origin);
+				voxelize_schwarz_method(reader, start, end, unitlength, voxels, data, sparseness_limit, use_data, nfilled, &progress, data_limit, trip_info.gridsize);
+				part_report.triangles = reader.n_served;
+				tri_info.n_triangles = reader.n_served;
+			}
+			else {
+				// open file to read triangles (this reads the first triangles)
+				std::string part_data_filename = trip_info.base_filename + string("_") + val_to_string(i) + string(".tripdata");
+				MemoryCharge reader_memory(MEM_TRIANGLE_READERS, std::min(trip_info.part_tricounts[i], input_buffersize) * sizeof(Triangle));
+				TriReader* reader;
+				{
+					PROFILE_SCOPE("reading triangles");
+					reader = new TriReader(part_data_filename, trip_info.part_tricounts[i], std::min(trip_info.part_tricounts[i], input_buffersize));
+				}
+				if (verbose) { cout << "  reading " << trip_info.part_tricounts[i] << " triangles from " << part_data_filename << endl; }
+				// voxelize partition
+				voxelize_schwarz_method(*reader, start, end, unitlength, voxels, data, sparseness_limit, use_data, nfilled, &progress, data_limit, trip_info.gridsize);
+				delete reader;
+			}
+#ifndef BINARY_VOXELIZATION
+			if (!use_data) { // the partition gets voxelized again, in parts
+				nfilled = nfilled_before;
+				VoxelList().swap(data);
+			}
+#endif
+			voxelize_timer.stop();
+			part_report.voxelize_ms = voxelize_timer.elapsed_time_milliseconds;
+			part_report.voxels = nfilled - nfilled_before;
+			part_report.sparse = use_data;
+			if (verbose) { cout << "  found " << nfilled - nfilled_before << " new voxels." << endl; }
+		}
 
 		// build SVO
-		cout << "Building SVO for partition " << i << " ..." << endl;
-		svo_total_timer.start(); svo_algo_timer.start(); // TIMING
-#ifdef BINARY_VOXELIZATION
-		if (use_data){ // use array of morton codes to build the SVO
-			sort(data.begin(), data.end()); // sort morton codes
-			for (std::vector<::uint64_t>::iterator it = data.begin(); it != data.end(); ++it){
-				builder.addVoxel(*it);
-			}
-		}
-		else { // morton array overflowed : using slower way to build SVO
-			::uint64_t morton_number;
-			for (size_t j = 0; j < morton_part; j++) {
-				if (!voxels[j] == EMPTY_VOXEL) {
-					morton_number = start + j;
-					builder.addVoxel(morton_number);
-				}
+#ifndef BINARY_VOXELIZATION
+		if (!use_data) { // the voxel data of the partition doesn't fit in the memory limit: build it in parts, right here
+			cout << "Building SVO for partition " << i << " in parts, to stay within the memory limit ..." << endl;
+			PROFILE_SCOPE("SVO building");
+			PROFILE_SCOPE_INDEX("partition", i);
+			PERF_STAGE("SVO building");
+			std::string part_data_filename = trip_info.base_filename + string("_") + val_to_string(i) + string(".tripdata");
+			size_t nfilled_before = nfilled;
+			if (parallel) {
+				string segment_base = trip_info.base_filename + string("_seg_") + val_to_string(i);
+				OctreeBuilder segment_builder(segment_base, part_side, generate_levels, false, compact_nodes, data_format, dedup_data, build_dag, start, output_buffer_bytes);
+				buildSplitPartition(segment_builder, coarse_grids, part_data_filename, trip_info.part_tricounts[i], start, end, unitlength, voxels, data, data_limit, nfilled, part_report);
+				::uint64_t bytes_before = segment_builder.bytesWritten();
+				segments[i] = segment_builder.finalizeSubtree();
+				part_report.bytes_written += segment_builder.bytesWritten() - bytes_before;
+				has_segment[i] = true;
 			}
+			else {
+				buildSplitPartition(builder, coarse_grids, part_data_filename, trip_info.part_tricounts[i], start, end, unitlength, voxels, data, data_limit, nfilled, part_report);
+			}
+			part_report.voxels = nfilled - nfilled_before;
+			part_report.sparse = true;
+			part_report.peak_memory = peakMemoryBytes();
+			progress.partitionDone(part_report.bytes_written);
+			continue;
 		}
-#else
-		sort(data.begin(), data.end()); // sort
-		for (std::vector<VoxelData>::iterator it = data.begin(); it != data.end(); ++it){
-			if (color == COLOR_FIXED){
-				it->color = fixed_color;
+#endif
+		if (parallel) {
+			cout << "Building SVO for partition " << i << " in the background ..." << endl;
+			PROFILE_SCOPE("SVO building");
+			PROFILE_SCOPE("waiting for workers");
+			PERF_STAGE("SVO building");
+			std::thread &worker = workers[n_started % n_threads];
+			if (worker.joinable()) { worker.join(); } // wait for a free worker
+			VoxelList* part_data = new VoxelList();
+			part_data->swap(data);
+			char* part_voxels = NULL;
+			if (!use_data) {
+				part_voxels = new char[(size_t)morton_part];
+				MemoryTracker::instance().add(MEM_VOXEL_GRID, morton_part); // until the worker is done with it
+				memcpy(part_voxels, voxels, (size_t)morton_part);
 			}
-			else if (color == COLOR_LINEAR){ // linear color scale
-				it->color = mortonToRGB(it->morton, gridsize);
+			string segment_base = trip_info.base_filename + string("_seg_") + val_to_string(i);
+			worker = std::thread(buildSegment, i, segment_base, part_side, part_data, part_voxels, use_data, start, morton_part, &segments[i], &part_report);
+			has_segment[i] = true;
+			n_started++;
+			continue;
+		}
+		cout << "Building SVO for partition " << i << " ..." << endl;
+		PROFILE_SCOPE("SVO building");
+		PROFILE_SCOPE_INDEX("partition", i);
+		PERF_STAGE("SVO building");
+		buildPartition(builder, coarse_grids, data, voxels, use_data, start, morton_part, part_report);
+		part_report.peak_memory = peakMemoryBytes();
+		progress.partitionDone(part_report.bytes_written);
+	}
+	{
+		PROFILE_SCOPE("SVO building");
+		PERF_STAGE("SVO building");
+		if (parallel) { // wait for all subtrees, then stitch them together in morton order
+			{
+				PROFILE_SCOPE("waiting for workers");
+				for (size_t k = 0; k < workers.size(); k++) {
+					if (workers[k].joinable()) { workers[k].join(); }
+				}
 			}
-			else if (color == COLOR_NORMAL){ // color models using their normals
-				vec3 normal = normalize(it->normal);
-				it->color = vec3((normal[0] + 1.0f) / 2.0f, (normal[1] + 1.0f) / 2.0f, (normal[2] + 1.0f) / 2.0f);
+			cout << "Stitching " << n_started << " partition SVOs ..." << endl;
+			PROFILE_SCOPE("stitching");
+			progress.beginStage("stitching", 0);
+			for (size_t i = 0; i < segments.size(); i++) {
+				if (has_segment[i]) { builder.addSubtree(segments[i]); }
 			}
-			builder.addVoxel(*it);
 		}
-#endif
-		svo_algo_timer.stop(); svo_total_timer.stop();  // TIMING
+		PROFILE_SCOPE("finalizing");
+		progress.beginStage("finalizing", 0);
+		bool written = builder.finalizeTree(); // finalize SVO so it gets written to disk
+		report.output_bytes = builder.bytesWritten();
+		for (size_t k = 0; k < coarse_grids.size(); k++) {
+			written = coarse_grids[k]->finalizeTree() && written;
+			report.output_bytes += coarse_grids[k]->builder->bytesWritten();
+		}
+		if (!written) {
+			cout << "Could not write the octree files completely." << endl;
+			exit(1);
+		}
+	}
+	if (mesh_voxelize) {
+		report.input_triangles = tri_info.n_triangles;
+		closeMesh(mesh, mesh_memory);
+	}
+	MemoryTracker::instance().endStage("voxelizing and SVO building");
+	if (update_filename != "") {
+		old_octree.close();
+		if (!replaceOctreeFiles(output_base, trip_info.base_filename)) {
+			cout << "Could not replace " << update_filename << " with the updated octree, which is left in " << output_base << ".octree" << endl;
+			exit(1);
+		}
 	}
-	svo_total_timer.start(); svo_algo_timer.start(); // TIMING
-	builder.finalizeTree(); // finalize SVO so it gets written to disk
 	cout << "done" << endl;
 	cout << "Total amount of voxels: " << nfilled << endl;
-	svo_total_timer.stop(); svo_algo_timer.stop(); // TIMING
+	vector<string> output_bases(1, trip_info.base_filename);
+	for (size_t k = 0; k < coarse_grids.size(); k++) {
+		output_bases.push_back(coarse_grids[k]->builder->base_filename);
+		cout << "Voxels in the " << coarse_grids[k]->gridsize << " grid: " << coarse_grids[k]->n_voxels << " (" << output_bases.back() << ".octree)" << endl;
+		delete coarse_grids[k];
+	}
+	if (verbose && builder.payload_table != NULL) {
+		PayloadTable* t = builder.payload_table;
+		cout << "  deduplicated " << t->n_hits << " of " << t->n_lookups << " payloads, " << builder.b_data_pos << " payloads written (" << t->n_evictions << " table evictions)" << endl;
+	}
+	if (verbose && builder.group_table != NULL) {
+		NodeGroupTable* t = builder.group_table;
+		cout << "  shared " << t->n_hits << " of " << t->n_lookups << " sibling groups, " << builder.b_node_pos << " nodes written (" << t->n_evictions << " table evictions)" << endl;
+	}
+	if (node_order != ORDER_POSTORDER) {
+		cout << "Reordering SVO nodes in " << NODE_ORDER_NAMES[node_order] << " order ... "; cout.flush();
+		PROFILE_SCOPE("reordering nodes");
+		PERF_STAGE("reordering nodes");
+		progress.beginStage("reordering nodes", 0);
+		for (size_t k = 0; k < output_bases.size(); k++) {
+			if (!relayoutOctreeFiles(output_bases[k], node_order, async_io)) {
+				exit(1);
+			}
+		}
+		cout << "done" << endl;
+		MemoryTracker::instance().endStage("reordering nodes");
+	}
 
 	// Removing .trip files which are left by partitioner
 	removeTripFiles(trip_info);
 
 	main_timer.stop();
+	progress.finish();
+	if (report_filename != "") {
+		report.total_ms = main_timer.elapsed_time_milliseconds;
+		if (!report.write(report_filename)) {
+			cout << "Could not write report to " << report_filename << endl;
+		}
+		else if (verbose) {
+			cout << "Wrote report to " << report_filename << endl;
+		}
+	}
 	printTimerInfo();
 }
\ No newline at end of file
@@ -3,12 +3,70 @@
 #include <iostream>
 #include <fstream>
 #include "../libs/libtri/include/file_tools.h"
+#include "../libs/libtri/include/tri_util.h"
 #include "Node.h"
+#include "BufferedWriter.h"
 
 using namespace std;
 
 // File containing all the octree IO methods
 
+// Octree file format versions
+#define OCTREE_VERSION_LEGACY 1 // 24-byte nodes with an explicit data address
+#define OCTREE_VERSION_COMPACT 2 // 8-byte nodes with child/leaf masks and a relative child pointer
+
+// Size of a node record in the .octreenodes file (data, children_base and 8 child offsets)
+const size_t NODE_SIZE = 3 * sizeof(size_t);
+
+// How nodes find their data payload. Legacy nodes store a data address, compact nodes derive it from their own position.
+enum OctreeDataLayout {
+	DATA_EXPLICIT, // (version 1) every node stores the index of its payload
+	DATA_SHARED_LEAVES, // all leaf nodes refer to payload 1, internal nodes to the NULL payload 0
+	DATA_SHARED_ALL, // all nodes refer to payload 1
+	DATA_PER_NODE // node i refers to payload i+1
+};
+
+const char* const DATA_LAYOUT_NAMES[4] = { "explicit", "shared_leaves", "shared_all", "per_node" };
+
+// How data payloads are stored in the .octreedata file
+enum OctreeDataFormat {
+	DATA_FULL, // morton code + float RGB color + float normal (32 bytes)
+	DATA_QUANTIZED, // RGBA8 color + octahedral normal (8 bytes)
+	DATA_QUANTIZED_MORTON // morton code + RGBA8 color + octahedral normal (16 bytes)
+};
+
+const char* const DATA_FORMAT_NAMES[3] = { "full", "quantized", "quantized_morton" };
+
+// Order of the nodes in the .octreenodes file
+enum OctreeNodeOrder {
+	ORDER_POSTORDER, // children before their parent, root is the last node (what the builder writes)
+	ORDER_BREADTH_FIRST, // level by level, root is the first node
+	ORDER_SUBTREE, // subtrees of a few levels stored together (breadth-first inside), root is the first node
+	ORDER_PAGED // fixed-size pages of subtrees, with a page table for links between pages, root is the first node
+};
+
+const char* const NODE_ORDER_NAMES[4] = { "postorder", "breadth_first", "subtree", "paged" };
+
+// An entry in the page index (.octreepages file) of a paged octree
+struct PageInfo {
+	::uint64_t first_node; // index of the first node in this page
+	::uint32_t n_nodes; // number of nodes in use in this page (the rest is padding)
+	::uint32_t n_subtrees; // number of subtrees stored in this page
+	::uint64_t parent_page; // page which links to the first subtree in this page (PAGE_NO_PARENT for the root page)
+};
+
+const size_t PAGEINFO_SIZE = 2 * sizeof(::uint64_t) + 2 * sizeof(::uint32_t);
+const ::uint64_t PAGE_NO_PARENT = ~static_cast<::uint64_t>(0);
+
+// Size of one payload record in the .octreedata file
+inline size_t dataRecordSize(OctreeDataFormat format){
+	switch (format){
+	case DATA_QUANTIZED: return QUANTIZEDVOXELDATA_SIZE;
+	case DATA_QUANTIZED_MORTON: return sizeof(::uint64_t) + QUANTIZEDVOXELDATA_SIZE;
+	default: return VOXELDATA_SIZE;
+	}
+}
+
 // Internal format to represent an octree
 struct OctreeInfo {
 	int version;
@@ -16,9 +74,25 @@ struct OctreeInfo {
 	size_t gridlength;
 	size_t n_nodes;
 	size_t n_data;
+	OctreeDataLayout data_layout;
+	OctreeDataFormat data_format;
+	OctreeNodeOrder node_order;
+	size_t page_size; // (paged order only) size of a page, in bytes
+	size_t n_pages; // (paged order only) number of pages
+	size_t n_page_links; // (paged order only) number of links between pages, in the page table
+	bool dag; // identical subtrees are stored once, so nodes can have more than one parent
+	bool levels; // internal nodes have a payload too (built with -levels)
+	bool has_bbox; // the header stores the bounding cube of the grid (octrees built before it did, don't)
+	AABox<glm::vec3> bbox; // bounding cube of the grid in model coordinates, as in the .tri header: a voxel's position depends on it
 
-	OctreeInfo() : version(1), base_filename(string("")), gridlength(1024), n_nodes(0), n_data(0) {}
-	OctreeInfo(int version, string base_filename, size_t gridlength, size_t n_nodes, size_t n_data) : version(version), base_filename(base_filename), gridlength(gridlength), n_nodes(n_nodes), n_data(n_data) {} 
+	OctreeInfo() : version(OCTREE_VERSION_LEGACY), base_filename(string("")), gridlength(1024), n_nodes(0), n_data(0), data_layout(DATA_EXPLICIT), data_format(DATA_FULL), node_order(ORDER_POSTORDER), page_size(0), n_pages(0), n_page_links(0), dag(false), levels(false), has_bbox(false) {}
+	OctreeInfo(int version, string base_filename, size_t gridlength, size_t n_nodes, size_t n_data, OctreeDataLayout data_layout = DATA_EXPLICIT, OctreeDataFormat data_format = DATA_FULL, OctreeNodeOrder node_order = ORDER_POSTORDER) :
+		version(version), base_filename(base_filename), gridlength(gridlength), n_nodes(n_nodes), n_data(n_data), data_layout(data_layout), data_format(data_format), node_order(node_order), page_size(0), n_pages(0), n_page_links(0), dag(false), levels(false), has_bbox(false) {}
+
+	// index of the root node
+	size_t root() const{
+		return (node_order == ORDER_POSTORDER) ? n_nodes - 1 : 0;
+	}
 
 	void print() const{
 		cout << "  version: " << version << endl;
@@ -26,6 +100,24 @@ struct OctreeInfo {
 		cout << "  grid length: " << gridlength << endl;
 		cout << "  n_nodes: " << n_nodes << endl;
 		cout << "  n_data: " << n_data << endl;
+		cout << "  data layout: " << DATA_LAYOUT_NAMES[data_layout] << endl;
+		cout << "  data format: " << DATA_FORMAT_NAMES[data_format] << endl;
+		cout << "  node order: " << NODE_ORDER_NAMES[node_order] << endl;
+		if (node_order == ORDER_PAGED){
+			cout << "  page size: " << page_size << endl;
+			cout << "  n_pages: " << n_pages << endl;
+			cout << "  n_page_links: " << n_page_links << endl;
+		}
+		if (dag){
+			cout << "  dag: " << dag << endl;
+		}
+		if (levels){
+			cout << "  levels: " << levels << endl;
+		}
+		if (has_bbox){
+			cout << "  bbox min: " << bbox.min[0] << " " << bbox.min[1] << " " << bbox.min[2] << endl;
+			cout << "  bbox max: " << bbox.max[0] << " " << bbox.max[1] << " " << bbox.max[2] << endl;
+		}
 	}
 
 	// check if all files required by Tri exist
@@ -37,12 +129,80 @@ struct OctreeInfo {
 	}
 };
 
+// A node in the compact (version 2) node format, packed in one 64-bit word:
+//   bits 0-7   : child mask, bit i is set if child i exists
+//   bits 8-15  : leaf mask, bit i is set if child i exists and is a leaf
+//   bit 16     : data flag, set if this node has a data payload
+//   bit 17     : far flag, set if the child pointer is an index in the page table (paged octrees only)
+//   bits 18-23 : reserved (0)
+//   bits 24-63 : relative child pointer: distance between own index and index of the first child
+// All existing children of a node are stored next to eachother in child order. In postorder files they are always
+// stored before their parent, so child i lives at (own index - child pointer) + (number of existing children before i).
+// In the top-down node orders (breadth-first, subtree, paged) they come after their parent, at (own index + child pointer) + ...
+// In paged octrees, children in another page are found through the page table: at (page table[child pointer]) + ...
+struct CompactNode {
+	::uint64_t bits;
+
+	CompactNode() : bits(0) {}
+	CompactNode(unsigned char child_mask, unsigned char leaf_mask, bool has_data, ::uint64_t child_pointer) :
+		bits(child_mask | (static_cast<::uint64_t>(leaf_mask) << 8) | (static_cast<::uint64_t>(has_data) << 16) | (child_pointer << 24)) {}
+
+	unsigned char childMask() const { return static_cast<unsigned char>(bits & 0xFF); }
+	unsigned char leafMask() const { return static_cast<unsigned char>((bits >> 8) & 0xFF); }
+	::uint64_t childPointer() const { return bits >> 24; }
+	bool hasChild(unsigned int i) const { return (childMask() & (1 << i)) != 0; }
+	bool isChildLeaf(unsigned int i) const { return (leafMask() & (1 << i)) != 0; }
+	bool isLeaf() const { return childMask() == 0; }
+	bool hasData() const { return ((bits >> 16) & 1) != 0; }
+	bool isFar() const { return ((bits >> 17) & 1) != 0; }
+	size_t getChildPos(unsigned int i, size_t own_pos, OctreeNodeOrder order = ORDER_POSTORDER) const;
+	size_t getDataPos(size_t own_pos, OctreeDataLayout layout) const;
+};
+
+const size_t COMPACTNODE_SIZE = sizeof(::uint64_t);
+const ::uint64_t COMPACTNODE_MAX_POINTER = (static_cast<::uint64_t>(1) << 40) - 1;
+const ::uint64_t COMPACTNODE_FAR_FLAG = static_cast<::uint64_t>(1) << 17;
+
+// Count set bits in a child mask
+inline unsigned int popcount8(unsigned char v){
+	v = v - ((v >> 1) & 0x55);
+	v = (v & 0x33) + ((v >> 2) & 0x33);
+	return (v + (v >> 4)) & 0x0F;
+}
+
+// Get the full index of the child at position i, given the index of this node (0 if there is no such child)
+inline size_t CompactNode::getChildPos(unsigned int i, size_t own_pos, OctreeNodeOrder order) const{
+	if (!hasChild(i)){
+		return 0;
+	}
+	size_t first_child = (order == ORDER_POSTORDER) ? static_cast<size_t>(own_pos - childPointer()) : static_cast<size_t>(own_pos + childPointer());
+	return first_child + popcount8(childMask() & ((1 << i) - 1));
+}
+
+// Get the index of the data payload of this node, given the index of this node (0 means no data)
+inline size_t CompactNode::getDataPos(size_t own_pos, OctreeDataLayout layout) const{
+	if (!hasData()){
+		return 0;
+	}
+	switch (layout){
+	case DATA_SHARED_LEAVES:
+	case DATA_SHARED_ALL: return 1;
+	case DATA_PER_NODE: return own_pos + 1;
+	default: return 0; // explicit addresses only exist in legacy nodes
+	}
+}
+
 size_t writeVoxelData(FILE* f, const VoxelData &v, size_t &b_data_pos);
 void readVoxelData(FILE* f, VoxelData &v);
 size_t writeNode(FILE* node_out, const Node &n, size_t &b_node_pos);
+size_t writeVoxelData(BufferedWriter &out, const VoxelData &v, size_t &b_data_pos);
+size_t writeVoxelData(BufferedWriter &out, const VoxelData &v, OctreeDataFormat format, size_t &b_data_pos);
+size_t writeNode(BufferedWriter &node_out, const Node &n, size_t &b_node_pos);
 inline void readNode(FILE* f, Node &n);
+size_t writeCompactNode(BufferedWriter &node_out, const CompactNode &n, size_t &b_node_pos);
+inline void readCompactNode(FILE* f, CompactNode &n);
 
-void writeOctreeHeader(const std::string &filename, const OctreeInfo &i);
+bool writeOctreeHeader(const std::string &filename, const OctreeInfo &i);
 int parseOctreeHeader(const std::string &filename, OctreeInfo &i);
 
 // Write a data point to file
@@ -52,12 +212,54 @@ inline size_t writeVoxelData(FILE* f, const VoxelData &v, size_t &b_data_pos){
 	return b_data_pos-1;
 }
 
+// Write a data point to a buffered writer
+inline size_t writeVoxelData(BufferedWriter &out, const VoxelData &v, size_t &b_data_pos){
+	out.write(&v.morton);
+	b_data_pos++;
+	return b_data_pos-1;
+}
+
+// Write a data point to a buffered writer, in the given data format
+inline size_t writeVoxelData(BufferedWriter &out, const VoxelData &v, OctreeDataFormat format, size_t &b_data_pos){
+	if (format == DATA_FULL){
+		return writeVoxelData(out, v, b_data_pos);
+	}
+	char record[sizeof(::uint64_t) + QUANTIZEDVOXELDATA_SIZE];
+	char* q = record;
+	if (format == DATA_QUANTIZED_MORTON){
+		::uint64_t morton = v.morton;
+		memcpy(q, &morton, sizeof(::uint64_t));
+		q += sizeof(::uint64_t);
+	}
+	QuantizedVoxelData quantized(v);
+	memcpy(q, &quantized.color, QUANTIZEDVOXELDATA_SIZE);
+	out.write(record);
+	b_data_pos++;
+	return b_data_pos-1;
+}
+
 // Read a data point from a file
 inline void readDataPoint(FILE* f, VoxelData &v){
 	v.morton = 0;
 	fread(&v.morton, VOXELDATA_SIZE, 1, f);
 }
 
+// Read a data point from a file in the given data format. Quantized data is converted back to floats.
+// (Payloads without a stored morton code get morton code 0)
+inline void readDataPoint(FILE* f, VoxelData &v, OctreeDataFormat format){
+	if (format == DATA_FULL){
+		readDataPoint(f, v);
+		return;
+	}
+	::uint64_t morton = 0;
+	if (format == DATA_QUANTIZED_MORTON){
+		fread(&morton, sizeof(::uint64_t), 1, f);
+	}
+	QuantizedVoxelData quantized;
+	fread(&quantized.color, QUANTIZEDVOXELDATA_SIZE, 1, f);
+	v = quantized.toVoxelData(morton);
+}
+
 // Write an octree node to file
 inline size_t writeNode(FILE* node_out, const Node &n, size_t &b_node_pos){
 	fwrite(& n.data, sizeof(size_t), 3, node_out);
@@ -65,21 +267,95 @@ inline size_t writeNode(FILE* node_out, const Node &n, size_t &b_node_pos){
 	return b_node_pos-1;
 }
 
+// Write an octree node to a buffered writer
+inline size_t writeNode(BufferedWriter &node_out, const Node &n, size_t &b_node_pos){
+	node_out.write(&n.data);
+	b_node_pos++;
+	return b_node_pos-1;
+}
+
 // Read a Node from a file
 inline void readNode(FILE* f, Node &n){
 	fread(& n.data, sizeof(size_t), 3, f);
 }
 
-// Write an octree header to a file
-inline void writeOctreeHeader(const std::string &filename, const OctreeInfo &i){
+// Write a compact octree node to a buffered writer
+inline size_t writeCompactNode(BufferedWriter &node_out, const CompactNode &n, size_t &b_node_pos){
+	node_out.write(&n.bits);
+	b_node_pos++;
+	return b_node_pos-1;
+}
+
+// Read a compact Node from a file
+inline void readCompactNode(FILE* f, CompactNode &n){
+	fread(&n.bits, COMPACTNODE_SIZE, 1, f);
+}
+
+// Seek to an absolute position in a file, also past 2 Gb
+inline int seekFile(FILE* f, ::uint64_t offset){
+#if defined(_WIN32) || defined(_WIN64)
+	return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET);
+#else
+	return fseeko(f, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+// Move the octree files from_base_filename(.octree/...) over the files of octree to_base_filename.
+// Only call this once the new files were written completely. Returns false if a file could not be moved:
+// the files which weren't moved yet are left as they were, and the header goes last.
+inline bool replaceOctreeFiles(const std::string &from_base_filename, const std::string &to_base_filename){
+	const char* extensions[5] = { ".octreenodes", ".octreedata", ".octreepagetable", ".octreepages", ".octree" };
+	for (int e = 0; e < 5; e++){
+		string source = from_base_filename + string(extensions[e]);
+		if (!file_exists(source)){
+			continue;
+		}
+		string target = to_base_filename + string(extensions[e]);
+#if defined(_WIN32) || defined(_WIN64)
+		remove(target.c_str()); // rename doesn't replace existing files here
+#endif
+		if (rename(source.c_str(), target.c_str()) != 0){
+			cout << "Error: could not move " << source << " to " << target << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Write an octree header to a file, return false if it could not be written
+inline bool writeOctreeHeader(const std::string &filename, const OctreeInfo &i){
 	ofstream outfile;
 	outfile.open(filename.c_str(), ios::out);
-	outfile << "#octreeheader 1" << endl;
+	outfile << "#octreeheader " << i.version << endl;
 	outfile << "gridlength " << i.gridlength << endl;
 	outfile << "n_nodes " << i.n_nodes << endl;
 	outfile << "n_data " << i.n_data << endl;
+	if (i.version >= OCTREE_VERSION_COMPACT){
+		outfile << "data_layout " << DATA_LAYOUT_NAMES[i.data_layout] << endl;
+	}
+	if (i.data_format != DATA_FULL){
+		outfile << "data_format " << DATA_FORMAT_NAMES[i.data_format] << endl;
+	}
+	if (i.node_order != ORDER_POSTORDER){
+		outfile << "node_order " << NODE_ORDER_NAMES[i.node_order] << endl;
+	}
+	if (i.node_order == ORDER_PAGED){
+		outfile << "page_size " << i.page_size << endl;
+		outfile << "n_pages " << i.n_pages << endl;
+		outfile << "n_page_links " << i.n_page_links << endl;
+	}
+	if (i.dag){
+		outfile << "dag 1" << endl;
+	}
+	if (i.levels){
+		outfile << "levels 1" << endl;
+	}
+	if (i.has_bbox){
+		outfile << "bbox " << i.bbox.min[0] << " " << i.bbox.min[1] << " " << i.bbox.min[2] << " " << i.bbox.max[0] << " " << i.bbox.max[1] << " " << i.bbox.max[2] << endl;
+	}
 	outfile << "END" << endl;
 	outfile.close();
+	return !outfile.fail();
 }
 
 // Parse a given octree header, store info in OctreeInfo struct
@@ -100,6 +376,33 @@ inline int parseOctreeHeader(const std::string &filename, OctreeInfo &i){
 		else if (line.compare("gridlength") == 0) {headerfile >> i.gridlength;}
 		else if (line.compare("n_nodes") == 0) {headerfile >> i.n_nodes;}
 		else if (line.compare("n_data") == 0) {headerfile >> i.n_data;}
+		else if (line.compare("data_layout") == 0) {
+			string layout; headerfile >> layout;
+			for (int l = 0; l < 4; l++){
+				if (layout.compare(DATA_LAYOUT_NAMES[l]) == 0) { i.data_layout = static_cast<OctreeDataLayout>(l); }
+			}
+		}
+		else if (line.compare("data_format") == 0) {
+			string format; headerfile >> format;
+			for (int f = 0; f < 3; f++){
+				if (format.compare(DATA_FORMAT_NAMES[f]) == 0) { i.data_format = static_cast<OctreeDataFormat>(f); }
+			}
+		}
+		else if (line.compare("node_order") == 0) {
+			string order; headerfile >> order;
+			for (int o = 0; o < 4; o++){
+				if (order.compare(NODE_ORDER_NAMES[o]) == 0) { i.node_order = static_cast<OctreeNodeOrder>(o); }
+			}
+		}
+		else if (line.compare("page_size") == 0) {headerfile >> i.page_size;}
+		else if (line.compare("n_pages") == 0) {headerfile >> i.n_pages;}
+		else if (line.compare("n_page_links") == 0) {headerfile >> i.n_page_links;}
+		else if (line.compare("dag") == 0) {headerfile >> i.dag;}
+		else if (line.compare("levels") == 0) {headerfile >> i.levels;}
+		else if (line.compare("bbox") == 0) {
+			headerfile >> i.bbox.min[0] >> i.bbox.min[1] >> i.bbox.min[2] >> i.bbox.max[0] >> i.bbox.max[1] >> i.bbox.max[2];
+			i.has_bbox = true;
+		}
 		else { cout << "  unrecognized keyword [" << line << "], skipping" << endl;
 		char c; do { c = headerfile.get(); } while(headerfile.good() && (c != '\n'));
 		}
@@ -7,26 +7,63 @@ using namespace libmorton;
 // Fiddle with buffer sizes here: these are defined as number of triangles
 #define input_buffersize 8192
 #define output_buffersize 8192
+#define min_output_buffersize 64 // smallest output buffer we use when the memory limit is tight
 
-// Estimate the optimal amount of partitions we need, given the requested gridsize and the overall memory limit.
-size_t estimate_partitions(const size_t gridsize, const size_t memory_limit){
+// Extra margin (in partitions) around a triangle when we look up the partitions it might touch,
+// so rounding never makes us skip one. The exact test is done by the partition's BBoxBuffer.
+#define PARTITION_LOOKUP_SLACK 0.001f
+
+// Memory we need to voxelize (and build) n_partitions partitions for gridsize, in bytes.
+// A partition needs its voxel grid (a byte per voxel), its list of voxels (up to sparseness_limit of the grid) and a triangle reader.
+// With more than one thread, every worker can hold on to the grid and list of another partition.
+// The reserved bytes (the output buffers of the SVO builders) are spoken for.
+::uint64_t estimate_partition_memory(const size_t gridsize, const size_t n_partitions, const float sparseness_limit, const size_t n_threads, const ::uint64_t reserved){
+	::uint64_t grid = (::uint64_t)gridsize*gridsize*gridsize*sizeof(char);
+	::uint64_t fixed = input_buffersize*sizeof(Triangle) + reserved; // triangle reader and output buffers
+	double copies = (1.0 + sparseness_limit) * ((n_threads > 1) ? n_threads + 1 : 1);
+	return (::uint64_t)((grid / n_partitions) * copies) + fixed;
+}
+
+// Estimate the optimal amount of partitions we need, given the requested gridsize and the overall memory limit (in Mb).
+size_t estimate_partitions(const size_t gridsize, const size_t memory_limit, const float sparseness_limit, const size_t n_threads, const ::uint64_t reserved){
 	cout << "Estimating best partition count ..." << endl;
-	::uint64_t required = (gridsize*gridsize*gridsize*sizeof(char)) / 1024 / 1024;
-	cout << "  to do this in-core I would need " << required << " Mb of system memory" << endl;
-	if (required <= memory_limit){
+	::uint64_t limit = (::uint64_t)memory_limit * 1024 * 1024;
+	::uint64_t grid = (::uint64_t)gridsize*gridsize*gridsize*sizeof(char);
+	::uint64_t required = estimate_partition_memory(gridsize, 1, sparseness_limit, n_threads, reserved);
+	cout << "  to do this in-core I would need " << required / 1024 / 1024 << " Mb of system memory" << endl;
+	if (required <= limit){
 		cout << "  memory limit of " << memory_limit << " Mb allows that" << endl;
 		return 1;
 	}
 	size_t numpartitions = 1;
-	size_t required_partition = required;
-	while (required_partition > memory_limit){
-		required_partition = required_partition / 8;
+	::uint64_t required_partition = required;
+	while (required_partition > limit && grid / numpartitions > 1){
 		numpartitions = numpartitions * 8;
+		required_partition = estimate_partition_memory(gridsize, numpartitions, sparseness_limit, n_threads, reserved);
+	}
+	if (required_partition > limit){
+		cout << "  memory limit of " << memory_limit << " Mb is too low: even partitions of one voxel need " << required_partition / 1024 << " Kb" << endl;
 	}
-	cout << "  going to do it in " << numpartitions << " partitions of " << required_partition << " Mb each." << endl;
+	cout << "  going to do it in " << numpartitions << " partitions of " << required_partition / 1048576.0 << " Mb each." << endl;
 	return numpartitions;
 }
 
+// How many triangles the buffer of every partition can hold while partitioning, within the memory limit (in Mb)
+size_t estimate_buffer_size(const size_t n_partitions, const size_t memory_limit){
+	::uint64_t limit = (::uint64_t)memory_limit * 1024 * 1024;
+	::uint64_t reader = input_buffersize*sizeof(Triangle);
+	::uint64_t available = (limit > reader) ? limit - reader : 0;
+	size_t buffer_size = static_cast<size_t>(std::min< ::uint64_t>(output_buffersize, available / (n_partitions*sizeof(Triangle))));
+	if (buffer_size < min_output_buffersize){
+		buffer_size = min_output_buffersize;
+		cout << "  memory limit of " << memory_limit << " Mb is too low for " << n_partitions << " partition buffers, using " << buffer_size << " triangles per buffer anyway" << endl;
+	}
+	else if (buffer_size < output_buffersize){
+		cout << "  partition buffers of " << buffer_size << " triangles, to stay within the memory limit" << endl;
+	}
+	return buffer_size;
+}
+
 // Remove the temporary .trip files we made
 void removeTripFiles(const TripInfo &trip_info){
 	// remove header file
@@ -40,7 +77,7 @@ void removeTripFiles(const TripInfo &trip_info){
 }
 
 // Create n Buffers for a total gridsize, store them in the given vector, use tri_info for filename information
-void createBuffers(const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize, vector<BBoxBuffer*> &buffers){
+void createBuffers(const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize, const size_t buffer_size, vector<BBoxBuffer*> &buffers){
 	buffers.resize(n_partitions);
 	float unitlength = (tri_info.mesh_bbox.max[0] - tri_info.mesh_bbox.min[0]) / (float)gridsize;
 	uint_fast64_t morton_part = (gridsize*gridsize*gridsize) / n_partitions;
@@ -49,10 +86,19 @@ void createBuffers(const TriInfo& tri_info, const size_t n_partitions, const siz
 	AABox<vec3> bbox_world;
 	std::string filename;
 
+	// decode the first and last morton code of all partitions at once
+	vector< ::uint64_t> corners(2 * n_partitions);
+	for (size_t i = 0; i < n_partitions; i++){
+		corners[2 * i] = morton_part*i;
+		corners[2 * i + 1] = (morton_part*(i + 1)) - 1; // -1, because z-curve skips to first block of next partition
+	}
+	vector< ::uint32_t> corner_x(corners.size()), corner_y(corners.size()), corner_z(corners.size());
+	morton3D_64_decode_n(&corners[0], &corner_x[0], &corner_y[0], &corner_z[0], corners.size());
+
 	for (size_t i = 0; i < n_partitions; i++){
 		// compute world bounding box
-		morton3D_64_decode(morton_part*i, (uint_fast32_t&) bbox_grid.min[0], (uint_fast32_t&) bbox_grid.min[1], (uint_fast32_t&) bbox_grid.min[2]);
-		morton3D_64_decode((morton_part*(i + 1)) - 1, (uint_fast32_t&) bbox_grid.max[0], (uint_fast32_t&) bbox_grid.max[1], (uint_fast32_t&) bbox_grid.max[2]); // -1, because z-curve skips to first block of next partition
+		bbox_grid.min = uivec3(corner_x[2 * i], corner_y[2 * i], corner_z[2 * i]);
+		bbox_grid.max = uivec3(corner_x[2 * i + 1], corner_y[2 * i + 1], corner_z[2 * i + 1]);
 		bbox_world.min[0] = bbox_grid.min[0] * unitlength;
 		bbox_world.min[1] = bbox_grid.min[1] * unitlength;
 		bbox_world.min[2] = bbox_grid.min[2] * unitlength;
@@ -72,78 +118,182 @@ void createBuffers(const TriInfo& tri_info, const size_t n_partitions, const siz
 
 		// create buffer for partition
 		filename = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(n_partitions) + string("_") + val_to_string(i) + string(".tripdata");
-		buffers[i] = new BBoxBuffer(filename, bbox_world, output_buffersize);
+		buffers[i] = new BBoxBuffer(filename, bbox_world, buffer_size);
 	}
 }
 
-// Handle the special case of just needing one partition
-TripInfo partition_one(const TriInfo& tri_info, const size_t gridsize){
-	// Just copy files
-	string src = tri_info.base_filename + string(".tridata");
-	string dst = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(1) + string("_") + val_to_string(0) + string(".tripdata");
-	copy_file(src, dst);
+// Find the box of partitions (in the grid of partitions, which are numbered in morton order) a bounding box might touch
+void findPartitionBox(const AABox<vec3> &bbox, float part_length, uint_fast32_t part_axis, uint_fast32_t p_min[3], uint_fast32_t p_max[3]){
+	for (int k = 0; k < 3; k++){
+		p_min[k] = 0;
+		p_max[k] = part_axis - 1;
+		if (part_length > 0.0f){
+			float lo = floor(bbox.min[k] / part_length - PARTITION_LOOKUP_SLACK);
+			float hi = floor(bbox.max[k] / part_length + PARTITION_LOOKUP_SLACK);
+			p_min[k] = static_cast<uint_fast32_t>(clampval<float>(lo, 0.0f, (float)(part_axis - 1)));
+			p_max[k] = static_cast<uint_fast32_t>(clampval<float>(hi, 0.0f, (float)(part_axis - 1)));
+		}
+	}
+}
 
-	// Write header
+// Write the trip header of a partitioning of the mesh referenced by tri_info, with the given triangle count for every partition
+TripInfo writePartitionHeader(const TriInfo& tri_info, const size_t gridsize, const vector<size_t> &part_tricounts){
 	TripInfo trip_info = TripInfo(tri_info);
-	trip_info.part_tricounts.resize(1);
-	trip_info.part_tricounts[0] = tri_info.n_triangles;
-	trip_info.base_filename = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(1);
+	trip_info.part_tricounts = part_tricounts;
+	trip_info.base_filename = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(part_tricounts.size());
 	std::string header = trip_info.base_filename + string(".trip");
 	trip_info.gridsize = gridsize;
-	trip_info.n_partitions = 1;
-	part_io_out_timer.start(); // TIMING
+	trip_info.n_partitions = part_tricounts.size();
+	PROFILE_SCOPE("writing header");
 	writeTripHeader(header, trip_info);
-	part_io_out_timer.stop(); // TIMING
 	return trip_info;
 }
 
-// Partition the mesh referenced by tri_info into n partitions for gridsize, and store information about the partitioning in trip_info
-TripInfo partition(const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize){
-	// Special case: just one partition
-	if (n_partitions == 1) {
-		return partition_one(tri_info, gridsize);
-	}
+// Handle the special case of just needing one partition
+TripInfo partition_one(const TriInfo& tri_info, const size_t gridsize){
+	// Just copy files
+	string src = tri_info.base_filename + string(".tridata");
+	string dst = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(1) + string("_") + val_to_string(0) + string(".tripdata");
+	copy_file(src, dst);
+	return writePartitionHeader(tri_info, gridsize, vector<size_t>(1, tri_info.n_triangles));
+}
 
-	// Open tri_data stream
-	part_io_in_timer.start(); // TIMING
-	TriReader reader = TriReader(tri_info.base_filename + string(".tridata"), tri_info.n_triangles, input_buffersize);
-	part_io_in_timer.stop(); // TIMING
+// The partitioning of a mesh we voxelize straight from the mesh file: just a header, with one partition of (about) n_triangles
+// triangles, which has no .tripdata file.
+TripInfo partition_none(const TriInfo& tri_info, const size_t gridsize, const size_t n_triangles){
+	return writePartitionHeader(tri_info, gridsize, vector<size_t>(1, n_triangles));
+}
 
-	part_algo_timer.start(); // TIMING
-	// Create Mortonbuffers
-	vector<BBoxBuffer*> buffers;
-	createBuffers(tri_info, n_partitions, gridsize, buffers);
+// Send every triangle of a reader (a TriReader or a MeshTriangleReader) to the buffers of the partitions it touches
+template <typename Reader>
+void assignTriangles(Reader &reader, const TriInfo& tri_info, vector<BBoxBuffer*> &buffers, Progress* progress){
+	// the partitions form a grid of part_axis^3
+	uint_fast32_t part_axis = 1;
+	while (part_axis*part_axis*part_axis < buffers.size()){
+		part_axis *= 2;
+	}
+	float part_length = (tri_info.mesh_bbox.max[0] - tri_info.mesh_bbox.min[0]) / (float)part_axis;
 
+	PROFILE_SCOPE("assigning triangles");
+	size_t progress_count = 0; // triangles we haven't published to progress yet
 	while (reader.hasNext()) {
 		Triangle t;
-		part_algo_timer.stop(); part_io_in_timer.start(); // TIMING
-		reader.getTriangle(t);
-		part_io_in_timer.stop(); part_algo_timer.start(); // TIMING
+		readTriangle(reader, t);
+		if (progress != NULL && ++progress_count == PROGRESS_SAMPLE){
+			progress->sample(progress_count, 0);
+			progress_count = 0;
+		}
 		AABox<vec3> bbox = computeBoundingBox(t.v0, t.v1, t.v2); // compute bounding box
-		for (int j = 0; j < n_partitions; j++){ // Test against all partitions
-			buffers[j]->processTriangle(t, bbox);
+		// Test against the partitions around the bounding box: walk their morton codes, jumping over the ones outside the box
+		uint_fast32_t p_min[3], p_max[3];
+		findPartitionBox(bbox, part_length, part_axis, p_min, p_max);
+		uint_fast64_t code_min = morton3D_64_encode(p_min[0], p_min[1], p_min[2]);
+		uint_fast64_t code_max = morton3D_64_encode(p_max[0], p_max[1], p_max[2]);
+		uint_fast64_t j = code_min;
+		size_t first_hit = 0, n_hits = 0;
+		do {
+			if (buffers[static_cast<size_t>(j)]->processTriangle(t, bbox)) {
+				n_hits++;
+				if (n_hits == 1) {
+					first_hit = static_cast<size_t>(j);
+					continue;
+				}
+				if (n_hits == 2) {
+					buffers[first_hit]->n_duplicates++;
+				}
+				buffers[static_cast<size_t>(j)]->n_duplicates++;
+			}
+		} while (morton3D_64_box_next(j, code_min, code_max, j));
+	}
+	if (progress != NULL){
+		progress->sample(progress_count, 0);
+	}
+}
+
+// Close the buffers (which writes their last triangles), collect their triangle counts and write the trip header
+TripInfo closeBuffers(const TriInfo& tri_info, const size_t gridsize, vector<BBoxBuffer*> &buffers, vector<size_t>* part_duplicates){
+	vector<size_t> part_tricounts(buffers.size());
+	for (size_t j = 0; j < buffers.size(); j++){
+		part_tricounts[j] = buffers[j]->n_triangles;
+		if (part_duplicates != NULL){
+			(*part_duplicates)[j] = buffers[j]->n_duplicates;
 		}
+		delete buffers[j];
 	}
-	part_algo_timer.stop(); // TIMING
-	part_io_out_timer.start(); // TIMING
+	return writePartitionHeader(tri_info, gridsize, part_tricounts);
+}
 
-	// create TripInfo object to hold header info
-	TripInfo trip_info = TripInfo(tri_info);
+// Partition the mesh referenced by tri_info into n partitions for gridsize, and store information about the partitioning in trip_info.
+// If part_duplicates is given, it gets the number of triangles of every partition which also went to another partition.
+// If progress is given, the triangles we read are counted in it. Every partition buffers buffer_size triangles before writing them.
+TripInfo partition(const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize, vector<size_t>* part_duplicates, Progress* progress, const size_t buffer_size){
+	if (part_duplicates != NULL){
+		part_duplicates->assign(n_partitions, 0);
+	}
+	// Special case: just one partition
+	if (n_partitions == 1) {
+		PROFILE_SCOPE("copying triangles");
+		TripInfo trip_info = partition_one(tri_info, gridsize);
+		if (progress != NULL){
+			progress->sample(tri_info.n_triangles, 0);
+		}
+		return trip_info;
+	}
 
-	// Collect ntriangles and close buffers
-	trip_info.part_tricounts.resize(n_partitions);
-	for (size_t j = 0; j < n_partitions; j++){
-		trip_info.part_tricounts[j] = buffers[j]->n_triangles;
-		delete buffers[j];
+	// Create Mortonbuffers
+	vector<BBoxBuffer*> buffers;
+	createBuffers(tri_info, n_partitions, gridsize, buffer_size, buffers);
+
+	// Open tri_data stream (this reads the first triangles)
+	MemoryCharge reader_memory(MEM_TRIANGLE_READERS, input_buffersize*sizeof(Triangle));
+	TriReader* reader;
+	{
+		PROFILE_SCOPE("reading triangles");
+		reader = new TriReader(tri_info.base_filename + string(".tridata"), tri_info.n_triangles, input_buffersize);
 	}
+	assignTriangles(*reader, tri_info, buffers, progress);
+	delete reader;
+	return closeBuffers(tri_info, gridsize, buffers, part_duplicates);
+}
 
-	// Write trip header
-	trip_info.base_filename = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(n_partitions);
-	std::string header = trip_info.base_filename + string(".trip");
-	trip_info.gridsize = gridsize;
-	trip_info.n_partitions = n_partitions;
-	writeTripHeader(header, trip_info);
+// Partition the triangles of a mesh (.ply, .obj or .stl) we stream, like partition() does with a .tri file. tri_info has the
+// bounding cube and base filename of the mesh (its triangle count is only known when we're done).
+TripInfo partitionMesh(MeshTriangleReader& reader, const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize, vector<size_t>* part_duplicates, Progress* progress, const size_t buffer_size){
+	if (part_duplicates != NULL){
+		part_duplicates->assign(n_partitions, 0);
+	}
+	// Special case: just one partition, which gets all triangles (like partition_one copies the .tridata file)
+	if (n_partitions == 1) {
+		PROFILE_SCOPE("copying triangles");
+		string filename = tri_info.base_filename + val_to_string(gridsize) + string("_") + val_to_string(1) + string("_") + val_to_string(0) + string(".tripdata");
+		FILE* file = fopen(filename.c_str(), "wb");
+		if (file == NULL){
+			cout << "Could not create partition file " << filename << endl;
+			exit(0);
+		}
+		size_t progress_count = 0;
+		while (reader.hasNext()){
+			Triangle t;
+			reader.getTriangle(t);
+			writeTriangle(file, t);
+			if (progress != NULL && ++progress_count == PROGRESS_SAMPLE){
+				progress->sample(progress_count, 0);
+				progress_count = 0;
+			}
+		}
+		fclose(file);
+		if (progress != NULL){
+			progress->sample(progress_count, 0);
+		}
+		TriInfo mesh_info = tri_info;
+		mesh_info.n_triangles = reader.n_served;
+		return writePartitionHeader(mesh_info, gridsize, vector<size_t>(1, reader.n_served));
+	}
 
-	part_io_out_timer.stop(); // TIMING
-	return trip_info;
+	vector<BBoxBuffer*> buffers;
+	createBuffers(tri_info, n_partitions, gridsize, buffer_size, buffers);
+	assignTriangles(reader, tri_info, buffers, progress);
+	TriInfo mesh_info = tri_info;
+	mesh_info.n_triangles = reader.n_served;
+	return closeBuffers(mesh_info, gridsize, buffers, part_duplicates);
 }
@@ -4,11 +4,17 @@
 #include "../libs/libtri/include/trip_tools.h"
 #include "../libs/libtri/include/TriReader.h"
 #include "../libs/libmorton/include/morton.h"
+#include "../libs/libmorton/include/morton_box.h"
 #include "globals.h"
 #include "BBoxBuffer.h"
+#include "MeshTriangleReader.h"
 #include "voxelizer.h"
 
 // Partitioning-related stuff
-size_t estimate_partitions(const size_t gridsize, const size_t memory_limit);
+::uint64_t estimate_partition_memory(const size_t gridsize, const size_t n_partitions, const float sparseness_limit = 0.0f, const size_t n_threads = 1, const ::uint64_t reserved = 0);
+size_t estimate_partitions(const size_t gridsize, const size_t memory_limit, const float sparseness_limit = 0.0f, const size_t n_threads = 1, const ::uint64_t reserved = 0);
+size_t estimate_buffer_size(const size_t n_partitions, const size_t memory_limit);
 void removeTripFiles(const TripInfo &trip_info);
-TripInfo partition(const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize);
\ No newline at end of file
+TripInfo partition(const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize, vector<size_t>* part_duplicates = NULL, Progress* progress = NULL, const size_t buffer_size = 8192);
+TripInfo partitionMesh(MeshTriangleReader& reader, const TriInfo& tri_info, const size_t n_partitions, const size_t gridsize, vector<size_t>* part_duplicates = NULL, Progress* progress = NULL, const size_t buffer_size = 8192);
+TripInfo partition_none(const TriInfo& tri_info, const size_t gridsize, const size_t n_triangles);
\ No newline at end of file
@@ -42,21 +42,21 @@ struct Timer { // High performance Win64 timer using QPC events
 	}
 };
 #else
-struct Timer { // High performance timer using standard c++11 chrono
+struct Timer { // High performance timer using standard c++11 chrono (steady_clock: it never jumps)
 	double elapsed_time_milliseconds = 0;
-	high_resolution_clock::time_point t1;
-	high_resolution_clock::time_point t2;
+	steady_clock::time_point t1;
+	steady_clock::time_point t2;
 
 	inline Timer() {
 	}
 
 	inline void start() {
-		t1 = high_resolution_clock::now();
+		t1 = steady_clock::now();
 	}
 
 	inline void stop() {
-		t2 = high_resolution_clock::now();
-		elapsed_time_milliseconds += std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+		t2 = steady_clock::now();
+		elapsed_time_milliseconds += std::chrono::duration<double, std::milli>(t2 - t1).count(); // keep the fraction of a millisecond
 	}
 };
 #endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "voxelizer.h"
 #include "BarycentricCoords.h"
+#include "MeshTriangleReader.h"
 
 using namespace std;
 using namespace glm;
@@ -9,6 +10,13 @@ using namespace libmorton;
 #define Y 1
 #define Z 2
 
+// Decode a morton code into a grid position (decoding straight into a uivec3 would write uint_fast32_t's, which can be wider than its components)
+inline uivec3 decodeGridPosition(const ::uint64_t morton_number){
+	uint_fast32_t x, y, z;
+	morton3D_64_decode(morton_number, x, y, z);
+	return uivec3(x, y, z);
+}
+
 // Implementation of algorithm from http://citeseerx.ist.psu.edu/viewdoc/summary?doi=10.1.1.12.6294 (Huang et al.)
 // Adapted for mortoncode -based subgrids
 
@@ -22,8 +30,10 @@ void voxelize_huang_method(TriReader &reader, const ::uint64_t morton_start, con
 #endif
 	// compute partition min and max in grid coords
 	AABox<uivec3> p_bbox_grid;
-	morton3D_64_decode(morton_start, (uint_fast32_t&) p_bbox_grid.min[2], (uint_fast32_t&) p_bbox_grid.min[1], (uint_fast32_t&) p_bbox_grid.min[0]);
-	morton3D_64_decode(morton_end - 1, (uint_fast32_t&) p_bbox_grid.max[2], (uint_fast32_t&) p_bbox_grid.max[1], (uint_fast32_t&) p_bbox_grid.max[0]);
+	uivec3 p_min = decodeGridPosition(morton_start);
+	uivec3 p_max = decodeGridPosition(morton_end - 1);
+	p_bbox_grid.min = uivec3(p_min[2], p_min[1], p_min[0]);
+	p_bbox_grid.max = uivec3(p_max[2], p_max[1], p_max[0]);
 	// misc calc
 	float unit_div = 1.0f / unitlength;
 	float radius = unitlength / 2.0f;
@@ -135,19 +145,25 @@ void voxelize_huang_method(TriReader &reader, const ::uint64_t morton_start, con
 // Implementation of algorithm from http://research.michael-schwarz.com/publ/2010/vox/ (Schwarz & Seidel)
 // Adapted for mortoncode -based subgrids
 
-#ifdef BINARY_VOXELIZATION
-void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, vector<::uint64_t> &data, float sparseness_limit, bool &use_data, size_t &nfilled) {
-#else
-void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, vector<VoxelData> &data, float sparseness_limit, bool &use_data, size_t &nfilled) {
-#endif
-	vox_algo_timer.start();
+template <typename Reader>
+void voxelize_schwarz_method(Reader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, VoxelList &data, float sparseness_limit, bool &use_data, size_t &nfilled, Progress* progress, ::uint64_t data_limit, size_t gridsize) {
 	memset(voxels, EMPTY_VOXEL, (morton_end - morton_start)*sizeof(char));
 	data.clear();
 
-	// compute partition min and max in grid coords
+	// compute grid min and max in grid coords
 	AABox<uivec3> p_bbox_grid;
-	morton3D_64_decode(morton_start, (uint_fast32_t&) p_bbox_grid.min[0], (uint_fast32_t&) p_bbox_grid.min[1], (uint_fast32_t&) p_bbox_grid.min[2]); // note: flipped inputs here 0, 1, 2 vs 2, 1, 0
-	morton3D_64_decode(morton_end - 1, (uint_fast32_t&) p_bbox_grid.max[0], (uint_fast32_t&) p_bbox_grid.max[1], (uint_fast32_t&) p_bbox_grid.max[2]); // note: flipped inputs here 0, 1, 2 vs 2, 1, 0
+	if (gridsize == 0){
+		p_bbox_grid.min = decodeGridPosition(morton_start); // note: not flipped here, unlike the huang method
+		p_bbox_grid.max = decodeGridPosition(morton_end - 1);
+	}
+	else {
+		p_bbox_grid.min = uivec3(0, 0, 0);
+		p_bbox_grid.max = uivec3(gridsize - 1, gridsize - 1, gridsize - 1);
+	}
+	// and the part of it we fill now
+	AABox<uivec3> r_bbox_grid;
+	r_bbox_grid.min = decodeGridPosition(morton_start);
+	r_bbox_grid.max = decodeGridPosition(morton_end - 1);
 
 	// compute maximum grow size for data array
 #ifdef BINARY_VOXELIZATION
@@ -165,13 +181,16 @@ void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, c
 	vec3 delta_p = vec3(unitlength, unitlength, unitlength);
 
 	// voxelize every triangle
+	size_t progress_count = 0; // triangles we haven't published to progress yet
 	while (reader.hasNext()) {
 		// read triangle
 		Triangle t;
 
-		vox_algo_timer.stop(); vox_io_in_timer.start();
-		reader.getTriangle(t);
-		vox_io_in_timer.stop(); vox_algo_timer.start();
+		readTriangle(reader, t);
+		if (progress != NULL && ++progress_count == PROGRESS_SAMPLE){
+			progress->sample(progress_count, nfilled);
+			progress_count = 0;
+		}
 
 #ifdef BINARY_VOXELIZATION
 		if (use_data){
@@ -183,6 +202,15 @@ void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, c
 				use_data = false;
 			}
 		}
+#else
+		// a growing list can have twice the capacity it needs
+		if (data_limit != 0 && 2 * data.size() * sizeof(VoxelData) > data_limit){
+			if (verbose){
+				cout << "Voxel data outgrew the memory limit (" << data.size() << " voxels), splitting the partition." << endl;
+			}
+			use_data = false;
+			break;
+		}
 #endif
 
 		// compute triangle bbox in world and grid
@@ -203,6 +231,19 @@ void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, c
 		t_bbox_grid.max[1] = clampval<int>(t_bbox_grid.max[1], p_bbox_grid.min[1], p_bbox_grid.max[1]);
 		t_bbox_grid.max[2] = clampval<int>(t_bbox_grid.max[2], p_bbox_grid.min[2], p_bbox_grid.max[2]);
 
+		// keep the voxels in the part we fill, skip the triangle if there are none
+		if (t_bbox_grid.max[0] < (int) r_bbox_grid.min[0] || t_bbox_grid.min[0] > (int) r_bbox_grid.max[0] ||
+			t_bbox_grid.max[1] < (int) r_bbox_grid.min[1] || t_bbox_grid.min[1] > (int) r_bbox_grid.max[1] ||
+			t_bbox_grid.max[2] < (int) r_bbox_grid.min[2] || t_bbox_grid.min[2] > (int) r_bbox_grid.max[2]){
+			continue;
+		}
+		t_bbox_grid.min[0] = std::max<int>(t_bbox_grid.min[0], r_bbox_grid.min[0]);
+		t_bbox_grid.min[1] = std::max<int>(t_bbox_grid.min[1], r_bbox_grid.min[1]);
+		t_bbox_grid.min[2] = std::max<int>(t_bbox_grid.min[2], r_bbox_grid.min[2]);
+		t_bbox_grid.max[0] = std::min<int>(t_bbox_grid.max[0], r_bbox_grid.max[0]);
+		t_bbox_grid.max[1] = std::min<int>(t_bbox_grid.max[1], r_bbox_grid.max[1]);
+		t_bbox_grid.max[2] = std::min<int>(t_bbox_grid.max[2], r_bbox_grid.max[2]);
+
 		// COMMON PROPERTIES FOR THE TRIANGLE
 		vec3 e0 = t.v1 - t.v0;
 		vec3 e1 = t.v2 - t.v1;
@@ -304,8 +345,14 @@ void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, c
 			}
 		}
 	}
+	if (progress != NULL){
+		progress->sample(progress_count, nfilled);
+	}
 }
 
+template void voxelize_schwarz_method<TriReader>(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, VoxelList &data, float sparseness_limit, bool &use_data, size_t &nfilled, Progress* progress, ::uint64_t data_limit, size_t gridsize);
+template void voxelize_schwarz_method<MeshTriangleReader>(MeshTriangleReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, VoxelList &data, float sparseness_limit, bool &use_data, size_t &nfilled, Progress* progress, ::uint64_t data_limit, size_t gridsize);
+
 //#ifdef BINARY_VOXELIZATION
 //void voxelize_partition3(TriReader &reader, const uint64_t morton_start, const uint64_t morton_end, const float unitlength, char* voxels, vector<uint64_t> &data, float sparseness_limit, bool &use_data, size_t &nfilled){
 //	vox_algo_timer.start();
@@ -7,6 +7,8 @@
 #include "globals.h"
 #include "intersection.h"
 #include "VoxelData.h"
+#include "Progress.h"
+#include "MemoryTracker.h"
 
 // Voxelization-related stuff
 typedef uvec3 uivec3;
@@ -15,20 +17,43 @@ using namespace std;
 #define EMPTY_VOXEL 0
 #define FULL_VOXEL 1
 
+// The voxels found in a partition (their memory counts as voxel data)
 #ifdef BINARY_VOXELIZATION
-void voxelize_huang_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, bool* voxels, size_t &nfilled);
+typedef vector< ::uint64_t, TrackingAllocator< ::uint64_t, MEM_VOXEL_DATA> > VoxelList; // morton codes
 #else
-void voxelize_huang_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, size_t* voxels, vector<VoxelData>& voxel_data, size_t &nfilled);
+typedef vector<VoxelData, TrackingAllocator<VoxelData, MEM_VOXEL_DATA> > VoxelList;
 #endif
 
 #ifdef BINARY_VOXELIZATION
-void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, vector<::uint64_t> &data, float sparseness_limit, bool &use_data, size_t &nfilled);
+void voxelize_huang_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, bool* voxels, size_t &nfilled);
 #else
-void voxelize_schwarz_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, vector<VoxelData> &data, float sparseness_limit, bool &use_data, size_t &nfilled);
+void voxelize_huang_method(TriReader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, size_t* voxels, vector<VoxelData>& voxel_data, size_t &nfilled);
 #endif
 
+// Voxelize the triangles of a partition. use_data is cleared when the list of voxels outgrows its limit: in the binary
+// version, the sparseness limit (and the voxels are in the voxel array), in the colored version, data_limit bytes (0: no limit).
+// Colored voxelization then stops, and the caller has to voxelize the partition in smaller parts.
+// Triangles are clamped to the whole grid (gridsize, 0: the morton range is the whole grid) before they're cut to the morton range,
+// so triangles near a border are tested against the same voxels whatever way we partition: every partitioning gives the same voxels.
+// The reader is a TriReader, or a MeshTriangleReader when we voxelize straight from a mesh.
+template <typename Reader>
+void voxelize_schwarz_method(Reader &reader, const ::uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, VoxelList &data, float sparseness_limit, bool &use_data, size_t &nfilled, Progress* progress = NULL, ::uint64_t data_limit = 0, size_t gridsize = 0);
+
 //#ifdef BINARY_VOXELIZATION
 //void voxelize_partition3(TriReader &reader, const uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, vector<::uint64_t> &data, float sparseness_limit, bool &use_data, size_t &nfilled);
 //#else
 //void voxelize_partition3(TriReader &reader, const uint64_t morton_start, const ::uint64_t morton_end, const float unitlength, char* voxels, vector<::uint64_t> &data, float sparseness_limit, bool &use_data, size_t &nfilled);
-//#endif
\ No newline at end of file
+//#endif
+
+// Get the next triangle from a reader, profiling only the reads which go to disk
+template <typename Reader>
+inline void readTriangle(Reader &reader, Triangle &t){
+#ifdef SVO_PROFILING
+	if (reader.bufferEmpty()){
+		PROFILE_SCOPE("reading triangles");
+		reader.getTriangle(t);
+		return;
+	}
+#endif
+	reader.getTriangle(t);
+}
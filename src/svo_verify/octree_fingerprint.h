@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "../svo_builder/OctreeReader.h"
+
+using namespace std;
+
+// Fingerprints of an octree which don't depend on how it is stored: node format, node order, pages, shared subtrees
+// (DAG) or shared payloads (-dedup) all give the same fingerprint. The tree is walked depth-first with the children in
+// morton order, so the voxels come out sorted by morton code, whatever the order of the nodes in the file.
+//  - voxels: hash of the sorted morton codes of all leaves
+//  - structure: hash of the child masks of all nodes, in the order of the walk
+//  - payloads: hash of the color and normal of all leaves (not their morton code, which -dedup shares)
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+inline void fnvAdd(::uint64_t &hash, const void* bytes, size_t n){
+	const unsigned char* b = static_cast<const unsigned char*>(bytes);
+	for (size_t i = 0; i < n; i++){
+		hash = (hash ^ b[i]) * FNV_PRIME;
+	}
+}
+
+struct OctreeFingerprint{
+	::uint64_t n_voxels;
+	::uint64_t n_nodes; // nodes of the tree (a subtree which a DAG stores once counts every time it is used)
+	::uint64_t voxel_hash;
+	::uint64_t structure_hash;
+	::uint64_t payload_hash;
+	::uint64_t n_bad_pointers; // child pointers outside of the node file (always 0 in a good octree, so not in golden files)
+
+	OctreeFingerprint() : n_voxels(0), n_nodes(0), voxel_hash(FNV_OFFSET), structure_hash(FNV_OFFSET), payload_hash(FNV_OFFSET), n_bad_pointers(0){}
+
+	bool operator==(const OctreeFingerprint &o) const{
+		return n_voxels == o.n_voxels && n_nodes == o.n_nodes && voxel_hash == o.voxel_hash && structure_hash == o.structure_hash && payload_hash == o.payload_hash
+			&& n_bad_pointers == o.n_bad_pointers;
+	}
+	bool operator!=(const OctreeFingerprint &o) const{ return !(*this == o); }
+
+	string toString() const{
+		char s[160];
+		sprintf(s, "%llu %llu %016llx %016llx %016llx", (unsigned long long) n_voxels, (unsigned long long) n_nodes, (unsigned long long) voxel_hash,
+			(unsigned long long) structure_hash, (unsigned long long) payload_hash);
+		return s;
+	}
+
+	bool fromString(const string &s){
+		unsigned long long v[5];
+		if (sscanf(s.c_str(), "%llu %llu %llx %llx %llx", &v[0], &v[1], &v[2], &v[3], &v[4]) != 5){
+			return false;
+		}
+		n_voxels = v[0]; n_nodes = v[1]; voxel_hash = v[2]; structure_hash = v[3]; payload_hash = v[4];
+		return true;
+	}
+};
+
+// A voxel of an octree, for voxel-level diffs
+struct OctreeVoxel{
+	::uint64_t morton;
+	bool has_data;
+	float color[3];
+	float normal[3];
+};
+
+// Walk the subtree of a node (at level: 0 is a voxel), add it to the fingerprint and (if not NULL) to the list of voxels
+inline void fingerprintNode(const OctreeReader &reader, size_t node, ::uint64_t morton, int level, OctreeFingerprint &f, vector<OctreeVoxel>* voxels){
+	if (node >= reader.info.n_nodes){ // a broken octree: don't follow the pointer
+		f.n_bad_pointers++;
+		return;
+	}
+	f.n_nodes++;
+	if (level == 0){
+		OctreeVoxel v;
+		v.morton = morton;
+		VoxelData data;
+		v.has_data = reader.getData(node, data);
+		for (int k = 0; k < 3; k++){
+			v.color[k] = v.has_data ? data.color[k] : 0.0f;
+			v.normal[k] = v.has_data ? data.normal[k] : 0.0f;
+		}
+		f.n_voxels++;
+		fnvAdd(f.voxel_hash, &morton, sizeof(morton));
+		fnvAdd(f.payload_hash, &v.has_data, sizeof(v.has_data));
+		fnvAdd(f.payload_hash, v.color, sizeof(v.color));
+		fnvAdd(f.payload_hash, v.normal, sizeof(v.normal));
+		if (voxels != NULL){
+			voxels->push_back(v);
+		}
+		return;
+	}
+	unsigned char mask = 0;
+	for (unsigned int i = 0; i < 8; i++){
+		if (reader.hasChild(node, i)){ mask |= static_cast<unsigned char>(1 << i); }
+	}
+	fnvAdd(f.structure_hash, &mask, 1);
+	for (unsigned int i = 0; i < 8; i++){
+		if (mask & (1 << i)){
+			fingerprintNode(reader, reader.getChild(node, i), (morton << 3) | i, level - 1, f, voxels);
+		}
+	}
+}
+
+// Fingerprint an octree (and collect its voxels, if voxels isn't NULL). Returns false if it can't be read.
+inline bool fingerprintOctree(const string &header_filename, OctreeFingerprint &f, vector<OctreeVoxel>* voxels = NULL){
+	OctreeReader reader;
+	if (!reader.open(header_filename)){
+		return false;
+	}
+	f = OctreeFingerprint();
+	fingerprintNode(reader, reader.root(), 0, reader.maxdepth, f, voxels);
+	reader.close();
+	return true;
+}
+
+inline bool samePayload(const OctreeVoxel &a, const OctreeVoxel &b){
+	return a.has_data == b.has_data && memcmp(a.color, b.color, sizeof(a.color)) == 0 && memcmp(a.normal, b.normal, sizeof(a.normal)) == 0;
+}
+
+inline void printVoxel(const char* what, const OctreeVoxel &v){
+	uint_fast32_t x, y, z;
+	libmorton::morton3D_64_decode(v.morton, x, y, z);
+	char line[256];
+	sprintf(line, "    %-10s voxel %llu (%u, %u, %u)", what, (unsigned long long) v.morton, (unsigned int) x, (unsigned int) y, (unsigned int) z);
+	cout << line;
+	if (v.has_data){
+		sprintf(line, " color (%g, %g, %g) normal (%g, %g, %g)", v.color[0], v.color[1], v.color[2], v.normal[0], v.normal[1], v.normal[2]);
+		cout << line;
+	}
+	cout << endl;
+}
+
+// Print the voxels which are only in a, only in b, or in both with another payload (the first max_listed of each).
+// Returns the number of voxels which differ.
+inline size_t printVoxelDiff(const vector<OctreeVoxel> &a, const vector<OctreeVoxel> &b, size_t max_listed){
+	size_t only_a = 0, only_b = 0, payload = 0;
+	size_t i = 0, j = 0;
+	while (i < a.size() || j < b.size()){
+		if (j == b.size() || (i < a.size() && a[i].morton < b[j].morton)){
+			if (only_a++ < max_listed){ printVoxel("only in A", a[i]); }
+			i++;
+		}
+		else if (i == a.size() || b[j].morton < a[i].morton){
+			if (only_b++ < max_listed){ printVoxel("only in B", b[j]); }
+			j++;
+		}
+		else {
+			if (!samePayload(a[i], b[j]) && payload++ < max_listed){
+				printVoxel("payload A", a[i]);
+				printVoxel("payload B", b[j]);
+			}
+			i++;
+			j++;
+		}
+	}
+	cout << "    " << only_a << " voxels only in A, " << only_b << " voxels only in B, " << payload << " voxels with another payload" << endl;
+	return only_a + only_b + payload;
+}
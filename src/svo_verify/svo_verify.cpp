@@ -0,0 +1,657 @@
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#define WINDOWS_LEAN_AND_MEAN
+#endif
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "../libs/libmorton/include/morton_batch.h"
+#include "../svo_bench/mesh_generators.h"
+#include "../svo_bench/bench_options.h"
+#include "octree_fingerprint.h"
+
+using namespace std;
+
+// Program version
+string version = "1.6.4";
+
+#ifdef BINARY_VOXELIZATION
+#define VERIFY_MODE "binary"
+#define BUILDER_NAME "svo_builder_binary"
+#else
+#define VERIFY_MODE "color"
+#define BUILDER_NAME "svo_builder"
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NULL_OUTPUT " > NUL 2>&1"
+#define EXE_SUFFIX ".exe"
+#else
+#define NULL_OUTPUT " > /dev/null 2>&1"
+#define EXE_SUFFIX ""
+#endif
+
+// A way of building the octree which must give the same octree as the reference build (or as another variant, for options which
+// change the payloads): the options we pass to svo_builder
+struct Variant{
+	string name;
+	string options;
+	bool partitioned; // also pass a memory limit which splits the grid in many partitions
+	string same_as; // the variant whose octree this one must equal ("": the reference build, or none if this is a group's first)
+	bool update; // build, then rebuild the partitions in a region of the model with -update and -dirty
+	bool same_bytes; // the .octreenodes and .octreedata files must also equal those of the build it's compared with, byte for byte
+	string update_options; // (update only) options which don't match the first build: svo_builder must reject the update
+
+	Variant(const string &name, const string &options, bool partitioned, const string &same_as = "", bool update = false, bool same_bytes = false, const string &update_options = "") :
+		name(name), options(options), partitioned(partitioned), same_as(same_as), update(update), same_bytes(same_bytes), update_options(update_options) {}
+};
+
+#define NEW_GROUP "-" // same_as of a variant whose payloads differ from the reference build: the first of its own group
+
+// Program parameters
+vector<BenchMesh> meshes;
+vector<size_t> gridsizes;
+size_t n_triangles = 50000;
+string output_base = "svo_verify";
+string builder = "";
+vector<string> variant_names; // empty: all variants
+string golden_filename = "";
+string record_filename = "";
+string compare_a = "";
+string compare_b = "";
+size_t max_listed = 10;
+bool keep_files = false;
+bool verbose = false;
+
+void printInfo(){
+	cout << "-------------------------------------------------------------" << endl;
+#ifdef BINARY_VOXELIZATION
+	cout << "SVO Builder Verification " << version << " - Geometry only version" << endl;
+#else
+	cout << "SVO Builder Verification " << version << endl;
+#endif
+	cout << "Jeroen Baert - jeroen.baert@cs.kuleuven.be - www.forceflow.be" << endl;
+	cout << "-------------------------------------------------------------" << endl << endl;
+}
+
+void printHelp(){
+	std::cout << "Example: svo_verify -m sphere,boxes -s 128,256 -golden golden.txt" << endl;
+	std::cout << "         svo_verify -a old.octree -b new.octree" << endl;
+	std::cout << "" << endl;
+	std::cout << "All available program options:" << endl;
+	std::cout << "" << endl;
+	std::cout << "-m <meshes>           Comma-separated test meshes (sphere, terrain, soup, slivers, boxes) or all. Default all." << endl;
+	std::cout << "-s <gridsizes>        Comma-separated voxel gridsizes, powers of 2. Default 128,256. Partitioned variants need 128 or more." << endl;
+	std::cout << "-n <triangles>        Number of triangles per mesh (approximately). Default 50000." << endl;
+	std::cout << "-variants <names>     Comma-separated variants to build and compare with the reference build. Default all." << endl;
+	std::cout << "-builder <path>       svo_builder executable to run. Default " << BUILDER_NAME << " next to this program." << endl;
+	std::cout << "-golden <file>        Compare the reference builds with the fingerprints in a golden file." << endl;
+	std::cout << "-record <file>        Write the fingerprints of the reference builds to a golden file." << endl;
+	std::cout << "-a <file.octree>      Compare two existing octrees (with -b) instead of building any." << endl;
+	std::cout << "-b <file.octree>      See -a." << endl;
+	std::cout << "-diff <n>             List at most n voxels of every kind of difference. Default 10." << endl;
+	std::cout << "-o <base>             Base filename for the generated .tri files. Default svo_verify." << endl;
+	std::cout << "-keep                 Keep the generated .tri files and the octree of the last variant." << endl;
+	std::cout << "-v                    Be very verbose." << endl;
+	std::cout << "-h                    Print help and exit." << endl;
+	std::cout << "" << endl;
+	std::cout << "The exit code is 1 if any octree differs from its reference or golden fingerprint, or if a build failed." << endl;
+}
+
+void printInvalid(){
+	std::cout << "Not enough or invalid arguments, please try again.\n" << endl;
+	printHelp();
+}
+
+// All variants this build of svo_builder has: partitioning, sparse and dense voxelization, threads, output formats and orders,
+// and every batched morton code method this CPU supports
+vector<Variant> allVariants(){
+	vector<Variant> v;
+	Variant reference("reference", "", false); v.push_back(reference);
+	Variant dense("dense", "-d 0", false, "", false, true); v.push_back(dense); // binary: voxel array (addVoxel) instead of the sorted morton list (addVoxels)
+	Variant partitioned("partitioned", "", true); v.push_back(partitioned);
+	Variant threads("threads", "-threads 4", true); v.push_back(threads);
+	Variant async("async", "-async", true); v.push_back(async);
+	Variant compact("compact", "-compact", false); v.push_back(compact);
+#ifdef BINARY_VOXELIZATION
+	Variant dag("dag", "-dag", false); v.push_back(dag);
+#else
+	Variant dedup("dedup", "-dedup", false); v.push_back(dedup);
+#endif
+	Variant breadth_first("breadth_first", "-order breadth_first", false); v.push_back(breadth_first);
+	Variant subtree("subtree", "-order subtree", true); v.push_back(subtree);
+	Variant paged("paged", "-compact -order paged", false); v.push_back(paged);
+	Variant update("update", "", true, "", true); v.push_back(update);
+	Variant update_mismatch("update_mismatch", "", true, "", true, false, "-levels"); v.push_back(update_mismatch);
+	// options which change the payloads: these are compared with their own unpartitioned build
+	Variant levels("levels", "-levels", false, NEW_GROUP); v.push_back(levels);
+	Variant levels_partitioned("levels_part", "-levels", true, "levels"); v.push_back(levels_partitioned);
+	Variant levels_update("levels_update", "-levels", true, "levels", true); v.push_back(levels_update);
+	Variant quantized("quantized", "-payload quantized", false, NEW_GROUP); v.push_back(quantized);
+	Variant quantized_partitioned("quantized_part", "-payload quantized", true, "quantized"); v.push_back(quantized_partitioned);
+	Variant quantized_morton("quantized_morton", "-payload quantized_morton", false, NEW_GROUP); v.push_back(quantized_morton);
+	Variant quantized_morton_partitioned("qmorton_part", "-payload quantized_morton", true, "quantized_morton"); v.push_back(quantized_morton_partitioned);
+	bool supported[5], preferred[5];
+	libmorton::batch_detail::detectSupport(supported, preferred);
+	for (int m = 0; m < 5; m++){
+		if (!supported[m]){ continue; }
+		Variant morton(string("morton_") + libmorton::MORTON_BATCH_METHOD_NAMES[m], string("-morton ") + libmorton::MORTON_BATCH_METHOD_NAMES[m], true);
+		v.push_back(morton);
+	}
+	return v;
+}
+
+void parseProgramParameters(int argc, char* argv[]){
+	for (int i = 1; i < argc; i++){
+		if (string(argv[i]) == "-m" && i + 1 < argc){
+			if (!parseMeshList(argv[i + 1], meshes)){
+				printInvalid(); exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-s" && i + 1 < argc){
+			if (!parseGridsizeList(argv[i + 1], gridsizes)){
+				printInvalid(); exit(0);
+			}
+			i++;
+		}
+		else if (string(argv[i]) == "-n" && i + 1 < argc){
+			int n = atoi(argv[i + 1]);
+			if (n < 1){
+				cout << "Requested number of triangles is nonsensical. Use a value >= 1" << endl;
+				printInvalid(); exit(0);
+			}
+			n_triangles = static_cast<size_t>(n);
+			i++;
+		}
+		else if (string(argv[i]) == "-variants" && i + 1 < argc){
+			variant_names = splitList(argv[i + 1]);
+			i++;
+		}
+		else if (string(argv[i]) == "-builder" && i + 1 < argc){
+			builder = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-golden" && i + 1 < argc){
+			golden_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-record" && i + 1 < argc){
+			record_filename = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-a" && i + 1 < argc){
+			compare_a = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-b" && i + 1 < argc){
+			compare_b = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-diff" && i + 1 < argc){
+			int n = atoi(argv[i + 1]);
+			if (n < 0){
+				cout << "Requested number of listed voxels is nonsensical. Use a value >= 0" << endl;
+				printInvalid(); exit(0);
+			}
+			max_listed = static_cast<size_t>(n);
+			i++;
+		}
+		else if (string(argv[i]) == "-o" && i + 1 < argc){
+			output_base = argv[i + 1];
+			i++;
+		}
+		else if (string(argv[i]) == "-keep"){
+			keep_files = true;
+		}
+		else if (string(argv[i]) == "-v"){
+			verbose = true;
+		}
+		else if (string(argv[i]) == "-h"){
+			printHelp(); exit(0);
+		}
+		else {
+			printInvalid(); exit(0);
+		}
+	}
+	if ((compare_a != "") != (compare_b != "")){
+		cout << "Comparing octrees needs both -a and -b" << endl;
+		printInvalid(); exit(0);
+	}
+	if (meshes.empty()){
+		for (int m = 0; m < BENCH_MESH_COUNT; m++){ meshes.push_back(static_cast<BenchMesh>(m)); }
+	}
+	if (gridsizes.empty()){
+		gridsizes.push_back(128);
+		gridsizes.push_back(256);
+	}
+}
+
+// Default builder: the one next to this program
+string defaultBuilder(const char* argv0){
+	string path(argv0);
+	size_t slash = path.find_last_of("/\\");
+	string dir = (slash == string::npos) ? string(".") : path.substr(0, slash);
+	return dir + string("/") + string(BUILDER_NAME) + string(EXE_SUFFIX);
+}
+
+// Memory limit (in Mb) for the partitioned variants: the grid doesn't fit, so svo_builder splits it in 8 or more partitions
+// (svo_builder needs at least 2 Mb, which holds a 64^3 grid: grids below 128 stay in one partition, and their partitioned variants fail)
+size_t partitionedLimit(size_t gridsize){
+	::uint64_t grid = (::uint64_t) gridsize * gridsize * gridsize;
+	return static_cast<size_t>(std::max< ::uint64_t>(2, grid / 32 / 1048576));
+}
+
+// Output files svo_builder writes for a .tri file and gridsize: base_filename<gridsize>_<partitions>
+string octreeBase(const string &base_filename, size_t gridsize, size_t n_partitions){
+	return base_filename + val_to_string(gridsize) + string("_") + val_to_string(n_partitions);
+}
+
+void removeOctreeFiles(const string &octree_base){
+	remove((octree_base + string(".octree")).c_str());
+	remove((octree_base + string(".octreenodes")).c_str());
+	remove((octree_base + string(".octreedata")).c_str());
+	remove((octree_base + string(".octreepagetable")).c_str());
+	remove((octree_base + string(".octreepages")).c_str());
+}
+
+// Remove what svo_builder wrote for any partition count
+void removeAllOctreeFiles(const string &base_filename, size_t gridsize){
+	::uint64_t voxels = (::uint64_t) gridsize * gridsize * gridsize;
+	for (::uint64_t p = 1; p <= voxels; p *= 8){
+		removeOctreeFiles(octreeBase(base_filename, gridsize, (size_t) p));
+	}
+}
+
+// Where we keep the node and payload files of a build which other variants are compared with byte for byte
+string keptBase(const string &base_filename, size_t gridsize, const string &variant_name){
+	return base_filename + val_to_string(gridsize) + string("_") + variant_name + string("_kept");
+}
+
+void keepOctreeFiles(const string &octree_base, const string &kept_base){
+	copy_file(octree_base + string(".octreenodes"), kept_base + string(".octreenodes"));
+	copy_file(octree_base + string(".octreedata"), kept_base + string(".octreedata"));
+}
+
+// Check if two files have the same contents
+bool sameFileBytes(const string &a, const string &b){
+	FILE* fa = fopen(a.c_str(), "rb");
+	FILE* fb = fopen(b.c_str(), "rb");
+	bool same = (fa != NULL && fb != NULL);
+	vector<char> buffer_a(1 << 16), buffer_b(1 << 16);
+	while (same){
+		size_t n_a = fread(&buffer_a[0], 1, buffer_a.size(), fa);
+		size_t n_b = fread(&buffer_b[0], 1, buffer_b.size(), fb);
+		same = (n_a == n_b) && memcmp(&buffer_a[0], &buffer_b[0], n_a) == 0;
+		if (n_a == 0){ break; }
+	}
+	if (fa != NULL){ fclose(fa); }
+	if (fb != NULL){ fclose(fb); }
+	return same;
+}
+
+bool sameOctreeBytes(const string &octree_base, const string &kept_base){
+	return sameFileBytes(octree_base + string(".octreenodes"), kept_base + string(".octreenodes"))
+		&& sameFileBytes(octree_base + string(".octreedata"), kept_base + string(".octreedata"));
+}
+
+// Changed regions for the update variants: a box around the lowest corner of the model, which covers some partitions but not all
+string dirtyFilename(const string &base_filename){
+	return base_filename + string("_dirty.txt");
+}
+
+void writeDirtyFile(const string &base_filename, const TriInfo &tri_info){
+	ofstream out(dirtyFilename(base_filename).c_str());
+	vec3 lo = tri_info.mesh_bbox.min;
+	vec3 hi = tri_info.mesh_bbox.min + (tri_info.mesh_bbox.max - tri_info.mesh_bbox.min) * 0.3f;
+	out << lo[0] << " " << lo[1] << " " << lo[2] << " " << hi[0] << " " << hi[1] << " " << hi[2] << endl;
+}
+
+bool runCommand(string command){
+	if (verbose){
+		cout << "  running " << command << endl;
+	}
+	command += NULL_OUTPUT;
+	return system(command.c_str()) == 0;
+}
+
+// The svo_builder command line for a variant
+string builderCommand(const string &base_filename, size_t gridsize, const Variant &variant){
+	string command = string("\"") + builder + string("\" -f \"") + base_filename + string(".tri\" -s ") + val_to_string(gridsize);
+	if (variant.partitioned){
+		command += string(" -l ") + val_to_string(partitionedLimit(gridsize));
+	}
+	if (variant.options != ""){
+		command += string(" ") + variant.options;
+	}
+	return command;
+}
+
+// Run svo_builder for a variant. Returns the number of partitions it used (found from the name of its output), 0 if it failed.
+size_t runBuilder(const string &base_filename, size_t gridsize, const Variant &variant){
+	removeAllOctreeFiles(base_filename, gridsize);
+	if (!runCommand(builderCommand(base_filename, gridsize, variant))){
+		return 0;
+	}
+	size_t n_partitions = 0;
+	::uint64_t voxels = (::uint64_t) gridsize * gridsize * gridsize;
+	for (::uint64_t p = 1; p <= voxels && n_partitions == 0; p *= 8){
+		if (file_exists(octreeBase(base_filename, gridsize, (size_t) p) + string(".octree"))){
+			n_partitions = (size_t) p;
+		}
+	}
+	return n_partitions;
+}
+
+// Update the octree of an update variant, which was built first: the model didn't change, so the result must equal a full build.
+// The first build is moved aside, so it can't pass for the result of an update which didn't run (svo_builder exits with 0 on errors).
+// Returns false if there is no updated octree.
+bool runUpdate(const string &base_filename, size_t gridsize, size_t n_partitions, const Variant &variant){
+	string octree_base = octreeBase(base_filename, gridsize, n_partitions);
+	string old_base = octree_base + string("_old");
+	removeOctreeFiles(old_base);
+	if (!replaceOctreeFiles(octree_base, old_base)){
+		return false;
+	}
+	string command = builderCommand(base_filename, gridsize, variant);
+	if (variant.update_options != ""){
+		command += string(" ") + variant.update_options;
+	}
+	command += string(" -update \"") + old_base + string(".octree\" -dirty \"") + dirtyFilename(base_filename) + string("\"");
+	bool ran = runCommand(command);
+	removeOctreeFiles(old_base);
+	removeOctreeFiles(octree_base + string("_update"));
+	return ran && file_exists(octree_base + string(".octree"));
+}
+
+// Fingerprint the octree svo_builder wrote (quietly, unless we're verbose: the octree reader reports what it reads)
+bool readOctree(const string &octree_base, OctreeFingerprint &f, vector<OctreeVoxel>* voxels){
+	streambuf* out = cout.rdbuf();
+	ostringstream quiet;
+	if (!verbose){ cout.rdbuf(quiet.rdbuf()); }
+	bool ok = fingerprintOctree(octree_base + string(".octree"), f, voxels);
+	cout.rdbuf(out);
+	return ok;
+}
+
+// Fingerprints of the reference builds in a golden file, one line per mesh and gridsize: mode mesh gridsize triangles fingerprint
+struct GoldenEntry{
+	string key;
+	OctreeFingerprint fingerprint;
+};
+
+string goldenKey(const string &mesh, size_t gridsize){
+	return string(VERIFY_MODE) + string(" ") + mesh + string(" ") + val_to_string(gridsize) + string(" ") + val_to_string(n_triangles);
+}
+
+vector<GoldenEntry> readGolden(const string &filename){
+	vector<GoldenEntry> entries;
+	ifstream in(filename.c_str());
+	if (!in.good()){
+		cout << "Could not read golden file " << filename << endl;
+		exit(1);
+	}
+	string line;
+	while (getline(in, line)){
+		if (line.empty() || line[0] == '#'){ continue; }
+		char mode[32], mesh[32];
+		unsigned int gridsize, triangles;
+		int n = 0;
+		if (sscanf(line.c_str(), "%31s %31s %u %u %n", mode, mesh, &gridsize, &triangles, &n) < 4){ continue; }
+		GoldenEntry e;
+		e.key = string(mode) + string(" ") + mesh + string(" ") + val_to_string(gridsize) + string(" ") + val_to_string(triangles);
+		if (e.fingerprint.fromString(line.substr(n))){
+			entries.push_back(e);
+		}
+	}
+	return entries;
+}
+
+// Say which parts of two fingerprints differ
+void printFingerprintDiff(const OctreeFingerprint &a, const OctreeFingerprint &b){
+	if (a.n_voxels != b.n_voxels || a.voxel_hash != b.voxel_hash){ cout << "    voxel sets differ (" << a.n_voxels << " vs " << b.n_voxels << " voxels)" << endl; }
+	if (a.n_nodes != b.n_nodes || a.structure_hash != b.structure_hash){ cout << "    structures differ (" << a.n_nodes << " vs " << b.n_nodes << " nodes)" << endl; }
+	if (a.payload_hash != b.payload_hash){ cout << "    payloads differ" << endl; }
+	if (a.n_bad_pointers != b.n_bad_pointers){ cout << "    broken child pointers (" << a.n_bad_pointers << " vs " << b.n_bad_pointers << ")" << endl; }
+}
+
+// One line of the results table
+void printResult(const string &mesh, size_t gridsize, const string &variant, size_t n_partitions, const OctreeFingerprint &f, const char* result){
+	char line[256];
+	sprintf(line, "%-8s %6u  %-16s %10u %12llu %12llu  %016llx  %s", mesh.c_str(), (unsigned int) gridsize, variant.c_str(), (unsigned int) n_partitions,
+		(unsigned long long) f.n_voxels, (unsigned long long) f.n_nodes, (unsigned long long) f.voxel_hash, result);
+	cout << line << endl;
+}
+
+// Compare two existing octrees (-a, -b). Returns false if they differ.
+bool compareOctrees(){
+	OctreeFingerprint a, b;
+	vector<OctreeVoxel> voxels_a, voxels_b;
+	if (!fingerprintOctree(compare_a, a, &voxels_a)){
+		cout << "Could not read octree " << compare_a << endl;
+		return false;
+	}
+	if (!fingerprintOctree(compare_b, b, &voxels_b)){
+		cout << "Could not read octree " << compare_b << endl;
+		return false;
+	}
+	cout << "A: " << compare_a << ": " << a.toString() << endl;
+	cout << "B: " << compare_b << ": " << b.toString() << endl;
+	if (a == b){
+		cout << "Octrees are the same." << endl;
+		return true;
+	}
+	cout << "Octrees differ:" << endl;
+	printFingerprintDiff(a, b);
+	printVoxelDiff(voxels_a, voxels_b, max_listed);
+	return false;
+}
+
+// Build the reference octree and all variants of a mesh at a gridsize, compare them. Returns the number of failures.
+size_t verifyGridsize(const string &mesh, const string &base_filename, size_t gridsize, const vector<Variant> &variants,
+	const vector<GoldenEntry> &golden, ofstream* record){
+	size_t failures = 0;
+	// the builds other variants are compared with: the reference build and the first build of every group
+	vector<string> base_names;
+	vector<OctreeFingerprint> bases;
+	vector< vector<OctreeVoxel> > base_voxels;
+	vector<string> kept_bases; // bases whose files are compared byte for byte
+	for (size_t v = 0; v < variants.size(); v++){
+		const Variant &variant = variants[v];
+		size_t n_partitions = runBuilder(base_filename, gridsize, variant);
+		if (variant.partitioned && n_partitions == 1){
+			OctreeFingerprint none;
+			printResult(mesh, gridsize, variant.name, n_partitions, none, "NOT PARTITIONED");
+			failures++;
+			continue;
+		}
+		if (variant.update && n_partitions != 0){
+			bool updated = runUpdate(base_filename, gridsize, n_partitions, variant);
+			if (variant.update_options != ""){
+				OctreeFingerprint none;
+				if (updated){
+					failures++;
+					printResult(mesh, gridsize, variant.name, n_partitions, none, "MISMATCHED UPDATE RAN");
+				}
+				else {
+					printResult(mesh, gridsize, variant.name, n_partitions, none, "update rejected");
+				}
+				continue;
+			}
+			if (!updated){
+				n_partitions = 0;
+			}
+		}
+		OctreeFingerprint f;
+		vector<OctreeVoxel> voxels;
+		bool is_reference = (v == 0);
+		bool is_base = is_reference || variant.same_as == NEW_GROUP;
+		if (n_partitions == 0 || !readOctree(octreeBase(base_filename, gridsize, n_partitions), f, is_base ? &voxels : NULL)){
+			printResult(mesh, gridsize, variant.name, n_partitions, f, "BUILD FAILED");
+			failures++;
+			if (is_reference){ break; } // nothing to compare with
+			continue;
+		}
+		if (is_base){
+			base_names.push_back(variant.name);
+			bases.push_back(f);
+			base_voxels.push_back(vector<OctreeVoxel>());
+			base_voxels.back().swap(voxels);
+			for (size_t w = v + 1; w < variants.size(); w++){
+				string compared_with = (variants[w].same_as == "") ? variants[0].name : variants[w].same_as;
+				if (variants[w].same_bytes && compared_with == variant.name){
+					kept_bases.push_back(keptBase(base_filename, gridsize, variant.name));
+					keepOctreeFiles(octreeBase(base_filename, gridsize, n_partitions), kept_bases.back());
+					break;
+				}
+			}
+		}
+		if (variant.same_as == NEW_GROUP){
+			printResult(mesh, gridsize, variant.name, n_partitions, f, "reference of its group");
+			continue;
+		}
+		if (is_reference){
+			string key = goldenKey(mesh, gridsize);
+			if (record != NULL){
+				*record << key << " " << f.toString() << endl;
+			}
+			if (golden_filename == ""){
+				printResult(mesh, gridsize, variant.name, n_partitions, f, "reference");
+				continue;
+			}
+			size_t g = 0;
+			while (g < golden.size() && golden[g].key != key){ g++; }
+			if (g == golden.size()){
+				printResult(mesh, gridsize, variant.name, n_partitions, f, "reference, not in golden file");
+			}
+			else if (golden[g].fingerprint == f){
+				printResult(mesh, gridsize, variant.name, n_partitions, f, "reference, same as golden");
+			}
+			else {
+				failures++;
+				printResult(mesh, gridsize, variant.name, n_partitions, f, "DIFFERS FROM GOLDEN");
+				printFingerprintDiff(golden[g].fingerprint, f);
+			}
+			continue;
+		}
+		string base_name = (variant.same_as == "") ? variants[0].name : variant.same_as;
+		size_t b = 0;
+		while (b < base_names.size() && base_names[b] != base_name){ b++; }
+		if (b == base_names.size()){
+			failures++;
+			printResult(mesh, gridsize, variant.name, n_partitions, f, "NOTHING TO COMPARE WITH");
+			continue;
+		}
+		if (f == bases[b] && !variant.same_bytes){
+			printResult(mesh, gridsize, variant.name, n_partitions, f, "same");
+			continue;
+		}
+		if (f == bases[b]){
+			if (sameOctreeBytes(octreeBase(base_filename, gridsize, n_partitions), keptBase(base_filename, gridsize, base_name))){
+				printResult(mesh, gridsize, variant.name, n_partitions, f, "same, byte for byte");
+			}
+			else {
+				failures++;
+				printResult(mesh, gridsize, variant.name, n_partitions, f, "SAME OCTREE, FILES DIFFER");
+			}
+			continue;
+		}
+		failures++;
+		printResult(mesh, gridsize, variant.name, n_partitions, f, "DIFFERS");
+		printFingerprintDiff(bases[b], f);
+		readOctree(octreeBase(base_filename, gridsize, n_partitions), f, &voxels);
+		cout << "    A is " << base_name << ", B is " << variant.name << ":" << endl;
+		printVoxelDiff(base_voxels[b], voxels, max_listed);
+	}
+	if (!keep_files){
+		removeAllOctreeFiles(base_filename, gridsize);
+	}
+	for (size_t k = 0; k < kept_bases.size(); k++){
+		removeOctreeFiles(kept_bases[k]);
+	}
+	return failures;
+}
+
+int main(int argc, char *argv[]){
+	printInfo();
+	parseProgramParameters(argc, argv);
+	if (compare_a != ""){
+		return compareOctrees() ? 0 : 1;
+	}
+	if (builder == ""){
+		builder = defaultBuilder(argv[0]);
+	}
+
+	// the reference build always comes first, and every variant comes after the build it is compared with
+	vector<Variant> all = allVariants();
+	vector<bool> selected(all.size(), variant_names.empty());
+	selected[0] = true;
+	for (size_t k = 0; k < variant_names.size(); k++){
+		size_t v = 0;
+		while (v < all.size() && all[v].name != variant_names[k]){ v++; }
+		if (v == all.size()){
+			cout << "Unknown (or, on this CPU, unsupported) variant: " << variant_names[k] << endl;
+			printInvalid(); exit(0);
+		}
+		selected[v] = true;
+	}
+	vector<Variant> variants;
+	for (size_t v = 0; v < all.size(); v++){
+		for (size_t b = 0; b < v; b++){
+			if (selected[v] && all[b].name == all[v].same_as){ selected[b] = true; }
+		}
+	}
+	for (size_t v = 0; v < all.size(); v++){
+		if (selected[v]){ variants.push_back(all[v]); }
+	}
+	vector<GoldenEntry> golden;
+	if (golden_filename != ""){
+		golden = readGolden(golden_filename);
+	}
+	ofstream* record = NULL;
+	if (record_filename != ""){
+		record = new ofstream(record_filename.c_str());
+		*record << "# svo_verify " << version << " golden fingerprints: mode mesh gridsize triangles voxels nodes voxel_hash structure_hash payload_hash" << endl;
+	}
+
+	char header[256];
+	sprintf(header, "%-8s %6s  %-16s %10s %12s %12s  %-16s  %s", "mesh", "grid", "variant", "partitions", "voxels", "nodes", "voxel hash", "result");
+	cout << header << endl;
+	size_t failures = 0;
+	for (size_t m = 0; m < meshes.size(); m++){
+		string mesh = BENCH_MESH_NAMES[meshes[m]];
+		string base_filename = output_base + string("_") + mesh;
+		vector<Triangle> triangles;
+		generateMesh(meshes[m], n_triangles, triangles);
+		TriInfo tri_info = writeTriFile(base_filename, triangles);
+		writeDirtyFile(base_filename, tri_info);
+		if (verbose){
+			cout << "  generated " << base_filename << ".tri: " << tri_info.n_triangles << " triangles" << endl;
+		}
+		triangles = vector<Triangle>();
+
+		for (size_t g = 0; g < gridsizes.size(); g++){
+			failures += verifyGridsize(mesh, base_filename, gridsizes[g], variants, golden, record);
+		}
+		if (!keep_files){
+			remove((base_filename + string(".tri")).c_str());
+			remove((base_filename + string(".tridata")).c_str());
+			remove(dirtyFilename(base_filename).c_str());
+		}
+	}
+	if (record != NULL){
+		record->close();
+		delete record;
+		cout << "Wrote golden fingerprints to " << record_filename << endl;
+	}
+	if (failures > 0){
+		cout << failures << " builds failed or differ." << endl;
+		return 1;
+	}
+	cout << "All builds are the same." << endl;
+	return 0;
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <atomic>
+#include "../libs/libtri/include/tri_tools.h"
+#include "../libs/libmorton/include/morton.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <process.h>
+#define SORT_PROCESS_ID _getpid()
+#else
+#include <unistd.h>
+#define SORT_PROCESS_ID getpid()
+#endif
+
+using namespace std;
+
+// Sorts triangles by the morton code of their centroid in a coarse grid (2^MORTON_SORT_BITS cells per axis), so triangles
+// which are close in space end up close in the .tridata file: the partitioner of svo_builder then fills one partition buffer
+// after the other, and the voxelizer walks the voxel grid in order. Triangles in the same cell keep the order they came in.
+// The sort is external: triangles are gathered in runs which fit in the memory limit, every run is sorted and written to a
+// temporary file, and the runs are merged (SORT_MAX_RUNS at a time, in more passes if there are more of them).
+#define MORTON_SORT_BITS 10
+#define SORT_MAX_RUNS 64 // runs we merge at once, so we don't open too many files
+#define SORT_MIN_READ 1024 // triangles we read from a run at once, at least
+#define SORT_WRITE_BLOCK 4096 // triangles we write at once
+
+class TriangleSorter{
+public:
+	size_t n_triangles;
+	size_t n_runs; // runs we wrote to disk (0: all triangles fit in memory)
+	size_t n_merge_passes; // merges into temporary runs, before the final merge
+
+	// side: side of the bounding cube (the triangles have been moved to the origin), memory_limit: in bytes
+	TriangleSorter(const string &run_base, float side, ::uint64_t memory_limit);
+	~TriangleSorter();
+
+	void add(const Triangle* triangles, size_t n);
+	// Write all triangles we got, sorted, to f
+	void finish(FILE* f);
+
+private:
+	string run_base;
+	float cell_scale; // cells per unit of length
+	::uint64_t memory_limit;
+	size_t run_capacity; // triangles in memory before we write a run
+	vector<Triangle> run;
+	vector<string> run_files;
+
+	string runFilename() const;
+	::uint64_t key(const Triangle &t) const;
+	void writeSorted(FILE* f);
+	void writeRun();
+	void merge(const vector<string> &inputs, FILE* f);
+
+	TriangleSorter(const TriangleSorter&);
+	TriangleSorter& operator=(const TriangleSorter&);
+};
+
+inline TriangleSorter::TriangleSorter(const string &run_base, float side, ::uint64_t memory_limit) : n_triangles(0), n_runs(0), n_merge_passes(0),
+	run_base(run_base), cell_scale((side > 0.0f) ? (1 << MORTON_SORT_BITS) / side : 0.0f), memory_limit(memory_limit){
+	// a triangle in a run takes its own memory, and a key and index to sort it by
+	run_capacity = std::max<size_t>(SORT_WRITE_BLOCK, static_cast<size_t>(memory_limit / (sizeof(Triangle) + 2 * sizeof(::uint64_t))));
+}
+
+inline TriangleSorter::~TriangleSorter(){
+	for (size_t i = 0; i < run_files.size(); i++){
+		remove(run_files[i].c_str());
+	}
+}
+
+// Morton code of the cell the centroid of a triangle is in (outside the grid: the nearest cell)
+inline ::uint64_t TriangleSorter::key(const Triangle &t) const{
+	glm::vec3 centroid = (t.v0 + t.v1 + t.v2) / 3.0f;
+	uint_fast32_t cell[3];
+	for (int k = 0; k < 3; k++){
+		float c = centroid[k] * cell_scale;
+		if (!(c >= 0.0f)){ c = 0.0f; } // (NaN too)
+		if (c > (float) ((1 << MORTON_SORT_BITS) - 1)){ c = (float) ((1 << MORTON_SORT_BITS) - 1); }
+		cell[k] = static_cast<uint_fast32_t>(c);
+	}
+	return libmorton::morton3D_64_encode(cell[0], cell[1], cell[2]);
+}
+
+inline void TriangleSorter::add(const Triangle* triangles, size_t n){
+	if (run.capacity() < run_capacity){ // once: a run never grows past its capacity, so vector growth can't overshoot the limit
+		run.reserve(run_capacity);
+	}
+	for (size_t i = 0; i < n; i++){
+		run.push_back(triangles[i]);
+		if (run.size() == run_capacity){
+			writeRun();
+		}
+	}
+	n_triangles += n;
+}
+
+// Sort the triangles in memory and write them to f. Sorting (key, index) pairs keeps triangles with the same key in order.
+inline void TriangleSorter::writeSorted(FILE* f){
+	vector<pair< ::uint64_t, ::uint64_t> > order(run.size());
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t) run.size(); i++){
+		order[i] = make_pair(key(run[i]), static_cast< ::uint64_t>(i));
+	}
+	std::sort(order.begin(), order.end());
+	vector<Triangle> block(std::min(run.size(), static_cast<size_t>(SORT_WRITE_BLOCK)));
+	for (size_t start = 0; start < order.size(); start += block.size()){
+		size_t n = std::min(block.size(), order.size() - start);
+		for (size_t i = 0; i < n; i++){
+			block[i] = run[static_cast<size_t>(order[start + i].second)];
+		}
+		writeTriangles(f, block[0], n);
+	}
+}
+
+// Temporary file for a run, next to the output: <output>.<pid>_<n>.run. With the process id, two sorts into the same output
+// at the same time don't overwrite each other's runs.
+inline string TriangleSorter::runFilename() const{
+	static std::atomic<unsigned int> counter(0);
+	return run_base + string(".") + val_to_string(SORT_PROCESS_ID) + string("_") + val_to_string(counter++) + string(".run");
+}
+
+inline void TriangleSorter::writeRun(){
+	string filename = runFilename();
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == NULL){
+		cout << "Could not create temporary sort file " << filename << endl;
+		exit(0);
+	}
+	run_files.push_back(filename);
+	writeSorted(f);
+	fclose(f);
+	run.clear();
+	n_runs++;
+}
+
+// A sorted run we're merging, read a buffer at a time
+struct SortRunReader{
+	FILE* file;
+	vector<Triangle> buffer;
+	size_t pos;
+	size_t end;
+
+	bool fill(){
+		end = fread(&buffer[0], TRIANGLE_SIZE * sizeof(float), buffer.size(), file);
+		pos = 0;
+		return end > 0;
+	}
+};
+
+// Merge sorted runs into f. On equal keys, the triangle of the earlier run goes first, so the merge is stable too.
+inline void TriangleSorter::merge(const vector<string> &inputs, FILE* f){
+	size_t read_size = std::max<size_t>(SORT_MIN_READ, static_cast<size_t>(memory_limit / (inputs.size() + 1) / sizeof(Triangle)));
+	vector<SortRunReader> readers(inputs.size());
+	typedef pair< ::uint64_t, size_t> Head; // key of the next triangle of a run, and the run
+	priority_queue<Head, vector<Head>, greater<Head> > heads;
+	for (size_t r = 0; r < inputs.size(); r++){
+		readers[r].file = fopen(inputs[r].c_str(), "rb");
+		if (readers[r].file == NULL){
+			cout << "Could not read back temporary sort file " << inputs[r] << endl;
+			exit(0);
+		}
+		readers[r].buffer.resize(read_size);
+		if (readers[r].fill()){
+			heads.push(Head(key(readers[r].buffer[0]), r));
+		}
+	}
+	vector<Triangle> block(SORT_WRITE_BLOCK);
+	size_t n_block = 0;
+	while (!heads.empty()){
+		size_t r = heads.top().second;
+		heads.pop();
+		SortRunReader &reader = readers[r];
+		block[n_block++] = reader.buffer[reader.pos++];
+		if (n_block == block.size()){
+			writeTriangles(f, block[0], n_block);
+			n_block = 0;
+		}
+		if (reader.pos < reader.end || reader.fill()){
+			heads.push(Head(key(reader.buffer[reader.pos]), r));
+		}
+	}
+	if (n_block > 0){
+		writeTriangles(f, block[0], n_block);
+	}
+	for (size_t r = 0; r < readers.size(); r++){
+		fclose(readers[r].file);
+	}
+}
+
+inline void TriangleSorter::finish(FILE* f){
+	if (run_files.empty()){ // everything fit in memory
+		writeSorted(f);
+		vector<Triangle>().swap(run);
+		return;
+	}
+	if (!run.empty()){
+		writeRun();
+	}
+	vector<Triangle>().swap(run); // the merge gets all memory (it only uses the buffers of the run readers)
+	// merge groups of runs until there are few enough to merge at once
+	while (run_files.size() > SORT_MAX_RUNS){
+		vector<string> merged;
+		for (size_t first = 0; first < run_files.size(); first += SORT_MAX_RUNS){
+			vector<string> group(run_files.begin() + first, run_files.begin() + std::min(run_files.size(), first + SORT_MAX_RUNS));
+			string filename = runFilename();
+			FILE* out = fopen(filename.c_str(), "wb");
+			if (out == NULL){
+				cout << "Could not create temporary sort file " << filename << endl;
+				exit(0);
+			}
+			merge(group, out);
+			fclose(out);
+			for (size_t i = 0; i < group.size(); i++){
+				remove(group[i].c_str());
+			}
+			merged.push_back(filename);
+		}
+		run_files.swap(merged);
+		n_merge_passes++;
+	}
+	merge(run_files, f);
+	for (size_t i = 0; i < run_files.size(); i++){
+		remove(run_files[i].c_str());
+	}
+	run_files.clear();
+}
@@ -7,6 +7,8 @@
 #include <string>
 #include <sstream>
 #include "tri_convert_util.h"
+#include "TriangleSorter.h"
+#include "../libs/libtri/include/MeshReader.h"
 
 using namespace std;
 using namespace trimesh;
@@ -17,6 +19,9 @@ string version = "1.6.4";
 // Program parameters
 string filename = "";
 bool recompute_normals = false;
+size_t memory_limit = 1024; // for the vertices of streamed meshes, in Mb
+bool use_trimesh = false;
+bool morton_sort = false;
 glm::vec3 fixed_color = glm::vec3(1.0f, 1.0f, 1.0f);
 
 void printInfo(){
@@ -44,8 +49,11 @@ void printHelp(){
 	std::cout << "" << endl;
 	std::cout << "All available program options:" << endl;
 	std::cout << "" << endl;
-	std::cout << "-f <filename>         Path to a model input file (.ply, .obj, .3ds, .sm, .ray or .off)." << endl;
+	std::cout << "-f <filename>         Path to a model input file (.ply, .obj, .stl, .3ds, .sm, .ray or .off)." << endl;
 	std::cout << "-r                    Recompute face normals." << endl;
+	std::cout << "-l <memory limit>     Memory limit for the vertices of .ply and .obj files (and for -sort), in Mb. Default 1024." << endl;
+	std::cout << "-trimesh              Load .ply, .obj and .stl files in memory with TriMesh, instead of streaming them." << endl;
+	std::cout << "-sort                 Sort the triangles in space (by the morton code of their centroid), within the memory limit." << endl;
 	std::cout << "-h                    Print help and exit." << endl;
 }
 
@@ -65,6 +73,18 @@ void parseProgramParameters(int argc, char* argv[]){
 				i++;
 			} else if (string(argv[i]) == "-r") {
 				recompute_normals = true;
+			} else if (string(argv[i]) == "-l") {
+				int limit_input = atoi(argv[i + 1]);
+				if (limit_input <= 0) {
+					cout << "Requested memory limit is nonsensical. Use a value > 0" << endl;
+					exit(0);
+				}
+				memory_limit = static_cast<size_t>(limit_input);
+				i++;
+			} else if (string(argv[i]) == "-trimesh") {
+				use_trimesh = true;
+			} else if (string(argv[i]) == "-sort") {
+				morton_sort = true;
 			} else if(string(argv[i]) == "-h") {
 				printHelp(); exit(0);
 			} else {
@@ -73,16 +93,55 @@ void parseProgramParameters(int argc, char* argv[]){
 	}
 	cout << "  filename: " << filename << endl;
 	cout << "  recompute normals: " << recompute_normals << endl;
+	cout << "  memory limit: " << memory_limit << endl;
+	cout << "  sort triangles: " << morton_sort << endl;
 }
 
-int main(int argc, char *argv[]){
-	printInfo();
+// Memory for the vertices of a streamed mesh, or for sorting triangles, in bytes: with -sort, they get half of the memory limit each
+::uint64_t memoryShare(){
+	::uint64_t limit = static_cast< ::uint64_t>(memory_limit) * 1024 * 1024;
+	return morton_sort ? limit / 2 : limit;
+}
 
-	// Parse parameters
-	parseProgramParameters(argc,argv);
+// Write the triangles a TriangleSorter got to the .tridata file, sorted
+void finishSort(TriangleSorter* sorter, FILE* tri_out){
+	cout << "Sorting " << sorter->n_triangles << " triangles in space ... "; cout.flush();
+	Timer timer = Timer();
+	timer.start();
+	sorter->finish(tri_out);
+	timer.stop();
+	cout << "done in " << timer.elapsed_time_milliseconds << " ms." << endl;
+	if (sorter->n_runs > 0){
+		cout << "  merged " << sorter->n_runs << " sorted runs from disk";
+		if (sorter->n_merge_passes > 0){ cout << ", in " << sorter->n_merge_passes + 1 << " passes"; }
+		cout << endl;
+	}
+}
+
+// Write the .tri header for the triangles we wrote
+void writeHeader(const string &tri_header_out_name, const AABox<glm::vec3> &mesh_bbox, size_t n_triangles){
+	cout << "Writing header to " << tri_header_out_name << " ... " << endl;
+	TriInfo tri_info;
+	tri_info.version = 1;
+	tri_info.mesh_bbox = mesh_bbox;
+	tri_info.n_triangles = n_triangles;
+#ifdef BINARY_VOXELIZATION
+	tri_info.geometry_only = 1;
+#else
+	tri_info.geometry_only = 0;
+#endif
+	writeTriHeader(tri_header_out_name, tri_info);
+	tri_info.print();
+}
 
+// Convert a mesh after loading it in memory with TriMesh
+void convertTriMesh(const string &tri_header_out_name, const string &tri_out_name){
 	// Read mesh
 	TriMesh *themesh = TriMesh::read(filename.c_str());
+	if (themesh == NULL){
+		cout << "Could not read " << filename << endl;
+		exit(0);
+	}
 	themesh->need_faces(); // unpack triangle strips so we have faces
 	themesh->need_bbox(); // compute the bounding box
 #ifndef BINARY_VOXELIZATION
@@ -94,33 +153,35 @@ int main(int argc, char *argv[]){
 	// Moving mesh to origin
 	cout << "Moving mesh to origin ... "; 
 	Timer timer = Timer();
+	timer.start();
 #pragma omp parallel for
 	for(int64_t i = 0; i < (int64_t) themesh->vertices.size() ; i++){
 		themesh->vertices[i] = themesh->vertices[i] - toTriMesh(mesh_bbox.min);
 	}
-	cout << "done in " << timer.elapsed_time_milliseconds << " s." << endl;
-
-	// Write mesh to format we can stream in
-	string base = filename.substr(0,filename.find_last_of("."));
-	std::string tri_header_out_name = base + string(".tri");
-	std::string tri_out_name = base + string(".tridata");
+	timer.stop();
+	cout << "done in " << timer.elapsed_time_milliseconds << " ms." << endl;
 
+	// Write mesh to format we can stream in (with -sort, the triangles go through the sorter first)
 	FILE* tri_out = fopen(tri_out_name.c_str(), "wb");
+	TriangleSorter* sorter = morton_sort ? new TriangleSorter(tri_out_name, mesh_bbox.max[0] - mesh_bbox.min[0], memoryShare()) : NULL;
 
-	cout << "Writing mesh triangles ... "; timer.reset();
-	Triangle t = Triangle();
-	// Write all triangles to data file
-	for(size_t i = 0; i < themesh->faces.size(); i++){
-		t.v0 = toGLM(themesh->vertices[themesh->faces[i][0]]);
-		t.v1 = toGLM(themesh->vertices[themesh->faces[i][1]]);
-		t.v2 = toGLM(themesh->vertices[themesh->faces[i][2]]);
+	cout << "Writing mesh triangles ... "; timer.reset(); timer.start();
+	// Write all triangles to data file, building them in parallel
+	writeTrianglesInBlocks(themesh->faces.size(), [&](size_t i, Triangle &t){
+		const TriMesh::Face &face = themesh->faces[i];
+		t.v0 = toGLM(themesh->vertices[face[0]]);
+		t.v1 = toGLM(themesh->vertices[face[1]]);
+		t.v2 = toGLM(themesh->vertices[face[2]]);
 #ifndef BINARY_VOXELIZATION
 		// COLLECT VERTEX COLORS
 		if(!themesh->colors.empty()){ // if this mesh has colors, we're going to use them
-			t.v0_color = toGLM(themesh->colors[themesh->faces[i][0]]);
-			t.v1_color = toGLM(themesh->colors[themesh->faces[i][1]]);
-			t.v2_color = toGLM(themesh->colors[themesh->faces[i][2]]);
-		} 
+			t.v0_color = toGLM(themesh->colors[face[0]]);
+			t.v1_color = toGLM(themesh->colors[face[1]]);
+			t.v2_color = toGLM(themesh->colors[face[2]]);
+		}
+		else {
+			t.v0_color = t.v1_color = t.v2_color = glm::vec3();
+		}
 		// COLLECT NORMALS
 		if(recompute_normals){
 			t.normal = computeFaceNormal(themesh,i); // recompute normals
@@ -128,22 +189,96 @@ int main(int argc, char *argv[]){
 			t.normal = getShadingFaceNormal(themesh,i); // use mesh provided normals
 		}
 #endif
-		writeTriangle(tri_out,t);
-	}
+	}, [&](Triangle* triangles, size_t n){
+		if (sorter != NULL){ sorter->add(triangles, n); }
+		else { writeTriangles(tri_out, *triangles, n); }
+	});
+	timer.stop();
 	cout << "done in " << timer.elapsed_time_milliseconds << " ms." << endl;
+	if (sorter != NULL){
+		finishSort(sorter, tri_out);
+		delete sorter;
+	}
+	fclose(tri_out);
 
-	// Prepare tri_info and write header
-	cout << "Writing header to " << tri_header_out_name << " ... " << endl;
-	TriInfo tri_info;
-	tri_info.version = 1;
-	tri_info.mesh_bbox = mesh_bbox;
-	tri_info.n_triangles = themesh->faces.size();
-#ifdef BINARY_VOXELIZATION
-	tri_info.geometry_only = 1;
-#else
-	tri_info.geometry_only = 0;
+	writeHeader(tri_header_out_name, mesh_bbox, themesh->faces.size());
+}
+
+// Convert a .ply, .obj or .stl mesh without loading it: its vertices are kept within the memory limit (the rest goes to disk),
+// its faces are read, made into triangles and written a batch at a time
+void convertStreaming(const string &tri_header_out_name, const string &tri_out_name){
+	MeshReader reader;
+	cout << "Reading vertices and bounding box ... "; cout.flush();
+	Timer timer = Timer();
+	timer.start();
+	if (!reader.open(filename, memoryShare(), recompute_normals)){
+		exit(0);
+	}
+	timer.stop();
+	cout << "done in " << timer.elapsed_time_milliseconds << " ms." << endl;
+	cout << "  " << reader.n_faces << " faces";
+	if (reader.vertexCount() > 0){ // (STL facets have their own vertices)
+		cout << ", " << reader.vertexCount() << " vertices" << (reader.verticesOnDisk() ? ", more than fit in the memory limit: the faces will read them back from disk" : "");
+	}
+	cout << endl;
+#ifndef BINARY_VOXELIZATION
+	if (!reader.has_normals && !recompute_normals){
+		cout << "  the mesh has no normals: using the normals of the triangles" << endl;
+	}
 #endif
-	writeTriHeader(tri_header_out_name, tri_info);
-	tri_info.print();
+	AABox<glm::vec3> mesh_bbox = createMeshBBCube(reader.bbox); // pad the mesh BBOX out to be a cube
+
+	// Write triangles, moved to the origin, a batch of faces at a time (with -sort, they go through the sorter first)
+	FILE* tri_out = fopen(tri_out_name.c_str(), "wb");
+	TriangleSorter* sorter = morton_sort ? new TriangleSorter(tri_out_name, mesh_bbox.max[0] - mesh_bbox.min[0], memoryShare()) : NULL;
+	cout << "Writing mesh triangles ... "; cout.flush(); timer.reset(); timer.start();
+	vector<Triangle> triangles;
+	while (reader.getTriangles(triangles)){
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t) triangles.size(); i++){
+			Triangle &t = triangles[i];
+			t.v0 = t.v0 - mesh_bbox.min;
+			t.v1 = t.v1 - mesh_bbox.min;
+			t.v2 = t.v2 - mesh_bbox.min;
+		}
+		if (triangles.empty()){
+			continue;
+		}
+		if (sorter != NULL){ sorter->add(&triangles[0], triangles.size()); }
+		else { writeTriangles(tri_out, triangles[0], triangles.size()); }
+	}
+	timer.stop();
+	cout << "done in " << timer.elapsed_time_milliseconds << " ms." << endl;
+	if (reader.n_skipped > 0){
+		cout << "  skipped " << reader.n_skipped << " triangles which use vertices the mesh doesn't have" << endl;
+	}
+	if (reader.verticesOnDisk()){
+		cout << "  read " << reader.vertexPageReads() << " pages of vertices back from disk" << endl;
+	}
+	if (sorter != NULL){
+		finishSort(sorter, tri_out);
+		delete sorter;
+	}
+	fclose(tri_out);
+
+	writeHeader(tri_header_out_name, mesh_bbox, reader.n_triangles);
+}
+
+int main(int argc, char *argv[]){
+	printInfo();
+
+	// Parse parameters
+	parseProgramParameters(argc,argv);
+
+	string base = filename.substr(0,filename.find_last_of("."));
+	std::string tri_header_out_name = base + string(".tri");
+	std::string tri_out_name = base + string(".tridata");
+
+	if (!use_trimesh && MeshReader::formatOf(filename) != MESH_UNKNOWN){
+		convertStreaming(tri_header_out_name, tri_out_name);
+	}
+	else {
+		convertTriMesh(tri_header_out_name, tri_out_name);
+	}
 	cout << "Done." << endl;
 }
\ No newline at end of file
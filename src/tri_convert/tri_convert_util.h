@@ -1,11 +1,16 @@
 #pragma once
 
 #include <TriMesh.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include "timer.h"
 #include "../libs/libtri/include/tri_util.h"
 #include "../libs/libtri/include/tri_tools.h"
 
+#define TRIANGLE_WRITE_BLOCK 65536 // triangles we build and write to the .tridata file at once
+
 // convert between trimesh::vec3 and glm::vec3
 inline glm::vec3 toGLM(trimesh::vec3 v) {
 	return glm::vec3(v[0], v[1], v[2]);
@@ -16,24 +21,42 @@ inline trimesh::vec3 toTriMesh(glm::vec3 v) {
 	return trimesh::vec3(v[0], v[1], v[2]);
 }
 
-// create bounding cube around a mesh (pad if the bbox is not a cube)
+// create bounding cube around a mesh
 inline AABox<glm::vec3> createMeshBBCube(const trimesh::TriMesh *themesh){
-	glm::vec3 mesh_min = toGLM(themesh->bbox.min);
-	glm::vec3 mesh_max = toGLM(themesh->bbox.max);
-	glm::vec3 lengths = mesh_max-mesh_min;
-	float maxlength = glm::max(glm::max(lengths.x, lengths.y), lengths.z);
-	for(int i=0; i<3;i++){
-		float delta = maxlength - lengths[i];
-		if(delta != 0){
-			mesh_min[i] = mesh_min[i] - (delta / 2.0f);
-			mesh_max[i] = mesh_max[i] + (delta / 2.0f);
+	return createMeshBBCube(AABox<glm::vec3>(toGLM(themesh->bbox.min), toGLM(themesh->bbox.max)));
+}
+
+// Output n_triangles triangles, in order: build(i, t) makes triangle i, output(triangles, n) writes n of them. Blocks of TRIANGLE_WRITE_BLOCK
+// triangles are built in parallel, while one of the threads outputs the block before.
+template <typename BuildTriangle, typename OutputTriangles>
+inline void writeTrianglesInBlocks(size_t n_triangles, BuildTriangle build, OutputTriangles output){
+	size_t block_size = std::min(n_triangles, static_cast<size_t>(TRIANGLE_WRITE_BLOCK));
+	std::vector<Triangle> blocks[2] = { std::vector<Triangle>(block_size), std::vector<Triangle>(block_size) };
+	size_t n_blocks = (n_triangles + TRIANGLE_WRITE_BLOCK - 1) / TRIANGLE_WRITE_BLOCK;
+	for (size_t b = 0; b <= n_blocks; b++){
+		std::vector<Triangle> &building = blocks[b % 2];
+		std::vector<Triangle> &writing = blocks[(b + 1) % 2];
+		size_t start = b * TRIANGLE_WRITE_BLOCK;
+		size_t n_build = (b < n_blocks) ? std::min(static_cast<size_t>(TRIANGLE_WRITE_BLOCK), n_triangles - start) : 0;
+		size_t n_write = (b > 0) ? std::min(static_cast<size_t>(TRIANGLE_WRITE_BLOCK), n_triangles - (start - TRIANGLE_WRITE_BLOCK)) : 0;
+#pragma omp parallel
+		{
+#pragma omp single nowait
+			{
+				if (n_write > 0){
+					output(&writing[0], n_write);
+				}
+			}
+#pragma omp for schedule(dynamic, 1024)
+			for (int64_t i = 0; i < (int64_t) n_build; i++){
+				build(start + static_cast<size_t>(i), building[static_cast<size_t>(i)]);
+			}
 		}
 	}
-	return AABox<glm::vec3>(mesh_min,mesh_max);
 }
 
 inline glm::vec3 computeFaceNormal(trimesh::TriMesh *themesh, size_t facenumber){
-	trimesh::TriMesh::Face face = themesh->faces[facenumber];
+	const trimesh::TriMesh::Face &face = themesh->faces[facenumber];
 	trimesh::vec3 &v0 = themesh->vertices[face[0]];
 	trimesh::vec3 &v1 = themesh->vertices[face[1]];
 	trimesh::vec3 &v2 = themesh->vertices[face[2]];
@@ -41,7 +64,7 @@ inline glm::vec3 computeFaceNormal(trimesh::TriMesh *themesh, size_t facenumber)
 }
 
 inline glm::vec3 getShadingFaceNormal(trimesh::TriMesh *themesh, size_t facenumber){
-	trimesh::TriMesh::Face face = themesh->faces[facenumber];
+	const trimesh::TriMesh::Face &face = themesh->faces[facenumber];
 	trimesh::vec3 &n0 = themesh->normals[face[0]];
 	trimesh::vec3 &n1 = themesh->normals[face[1]];
 	trimesh::vec3 &n2 = themesh->normals[face[2]];